@@ -0,0 +1,131 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "util.h"
+
+// Offset of the first allocation (past the header, in persistent arenas; kept
+// the same in volatile arenas so that offset 0 is never allocated).
+#define DATA_START                                                             \
+  ((sizeof(struct arena_header) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+void arena_open(const char *fname, size_t size, arena_t *arena) {
+  assert(arena);
+  assert(size ? size > DATA_START : 1);
+  char *tpath = malloc(strlen(fname) + 5);
+  strcpy(tpath, fname);
+  strcat(tpath, ".arn");
+  DEBUG_PRINT("opening %s\n", tpath);
+
+  mm_open(tpath, size, &arena->mm_region);
+  free(tpath);
+
+  arena->header = arena->mm_region.start;
+  arena->persistent = 1;
+  if (size) {
+    // new arena; nothing is allocated yet.
+    memcpy(arena->header->hdr, "ARNA", 4);
+    arena->header->pad = 0;
+    arena->header->size = arena->mm_region.size;
+    arena->header->used = DATA_START;
+    arena->header->root = 0;
+  }
+
+  // validate that this is an arena, and that its size was stored correctly.
+  assert(!strncmp(arena->header->hdr, "ARNA", 4));
+  assert(arena->header->size == arena->mm_region.size);
+  assert(arena->header->used <= arena->header->size);
+}
+
+void arena_volatile(size_t size, arena_t *arena) {
+  assert(arena);
+  size = size ? size : ARENA_SIZE;
+  assert(size > DATA_START);
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  assert(base != MAP_FAILED);
+
+  arena->mm_region.start = base;
+  arena->mm_region.size = size;
+  arena->mm_region.fd = -1;
+  arena->mm_region.flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  arena->header = &arena->local;
+  arena->persistent = 0;
+  memcpy(arena->header->hdr, "ARNA", 4);
+  arena->header->pad = 0;
+  arena->header->size = size;
+  arena->header->used = DATA_START;
+  arena->header->root = 0;
+}
+
+void arena_close(arena_t *arena) {
+  if (arena->persistent) {
+    mm_close(&arena->mm_region);
+  } else {
+    munmap(arena->mm_region.start, arena->mm_region.size);
+  }
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+  struct arena_header *h = arena->header;
+  uint64_t len = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+  if (len < size || len > h->size - h->used) {
+    DEBUG_PRINT("arena full; %lu of %lu bytes used\n", h->used, h->size);
+    return NULL;
+  }
+  void *ptr = arena->mm_region.start + h->used;
+  h->used += len;
+  return ptr;
+}
+
+char *arena_strdup(arena_t *arena, const char *str) {
+  size_t len = strlen(str) + 1;
+  char *copy = arena_alloc(arena, len);
+  if (copy) {
+    memcpy(copy, str, len);
+  }
+  return copy;
+}
+
+size_t arena_mark(arena_t *arena) { return arena->header->used; }
+
+void arena_release(arena_t *arena, size_t mark) {
+  assert(mark >= DATA_START && mark <= arena->header->used);
+  arena->header->used = mark;
+}
+
+void arena_reset(arena_t *arena) {
+  if (!arena->persistent) {
+    // give the used scratch pages back.
+    madvise(arena->mm_region.start, arena->header->used, MADV_DONTNEED);
+  }
+  arena->header->used = DATA_START;
+  arena->header->root = 0;
+}
+
+uint64_t arena_off(arena_t *arena, void *ptr) {
+  if (!ptr) {
+    return 0;
+  }
+  assert(ptr >= arena->mm_region.start + DATA_START &&
+         ptr < arena->mm_region.start + arena->mm_region.size);
+  return ptr - arena->mm_region.start;
+}
+
+void *arena_ptr(arena_t *arena, uint64_t off) {
+  if (!off) {
+    return NULL;
+  }
+  assert(off >= DATA_START && off < arena->mm_region.size);
+  return arena->mm_region.start + off;
+}
+
+void arena_set_root(arena_t *arena, void *ptr) {
+  arena->header->root = arena_off(arena, ptr);
+}
+
+void *arena_root(arena_t *arena) {
+  return arena_ptr(arena, arena->header->root);
+}
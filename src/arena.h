@@ -0,0 +1,121 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mm_util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct arena_t arena_t;
+
+// -----------------------------
+// arena (bump) allocation
+// -----------------------------
+//
+// An arena hands out memory from one mapped region by advancing a pointer, and
+// frees it all at once (or everything allocated after a mark), instead of
+// allocating and freeing each object through malloc.
+//
+// Volatile arenas are anonymous mappings, for scratch memory:
+//
+//    arena_t scratch;
+//    arena_volatile(0, &scratch);
+//    for (...) {
+//      size_t mark = arena_mark(&scratch);
+//      char *buf = arena_alloc(&scratch, len);
+//      ...
+//      arena_release(&scratch, mark); // frees buf
+//    }
+//    arena_close(&scratch);
+//
+// Persistent arenas are files (with the ".arn" extension), so their contents
+// outlive the process. As the file may be mapped at a different address in
+// each run, objects in it refer to each other by offset rather than by pointer,
+// and one object (the root) can be found from the arena itself:
+//
+//    arena_open(filename, 1 << 20, &arena);       // create
+//    struct index *idx = arena_alloc(&arena, sizeof(struct index));
+//    idx->entries = arena_off(&arena, arena_alloc(&arena, n * sizeof(...)));
+//    arena_set_root(&arena, idx);
+//    arena_close(&arena);
+//    ...
+//    arena_open(filename, 0, &arena);             // in a later run
+//    struct index *idx = arena_root(&arena);
+//    uint32_t *entries = arena_ptr(&arena, idx->entries);
+//
+// The persistent file format is a header, followed by allocations:
+//
+// | ARNA | pad | size | used | root | data .... |
+//
+// used is the offset of the first free byte and root the offset of the root
+// object (0 if none); offset 0 is never allocated, so it serves as a null
+// offset. Allocations are aligned to ARENA_ALIGN bytes and never move.
+//
+// Arenas are not thread-safe; use one arena per thread for scratch memory.
+
+// Alignment of allocations.
+#define ARENA_ALIGN 16
+// Default size of volatile arenas. Pages of volatile arenas are only backed by
+// memory once used, so reserving a large arena is cheap.
+#define ARENA_SIZE ((size_t)1 << 30)
+
+// persistent arena header
+struct arena_header {
+  char hdr[4];   // header chars
+  uint32_t pad;  // unused
+  uint64_t size; // total size of the arena
+  uint64_t used; // offset of first free byte
+  uint64_t root; // offset of root object, or 0
+};
+
+// arena struct
+struct arena_t {
+  struct arena_header *header; // header (in the region if persistent)
+  struct arena_header local;   // header of a volatile arena
+  mm_region_t mm_region;       // memory map info
+  int persistent;              // nonzero if the arena is a file
+};
+
+// Open a persistent arena. If size is nonzero, the arena is created with the
+// given size (replacing any existing contents); otherwise the existing arena
+// is opened.
+void arena_open(const char *fname, size_t size, arena_t *arena);
+
+// Create a volatile arena of size bytes (ARENA_SIZE if 0).
+void arena_volatile(size_t size, arena_t *arena);
+
+// Close an arena. Volatile arenas are freed.
+void arena_close(arena_t *arena);
+
+// Allocate size bytes (aligned to ARENA_ALIGN) from the arena. Returns NULL if
+// the arena is full.
+void *arena_alloc(arena_t *arena, size_t size);
+
+// Copy the string str into the arena. Returns NULL if the arena is full.
+char *arena_strdup(arena_t *arena, const char *str);
+
+// Return a mark of the current allocation point, and free everything
+// allocated after a mark.
+size_t arena_mark(arena_t *arena);
+void arena_release(arena_t *arena, size_t mark);
+
+// Free everything in the arena (including the root).
+void arena_reset(arena_t *arena);
+
+// Convert between pointers into the arena and offsets (NULL is offset 0).
+uint64_t arena_off(arena_t *arena, void *ptr);
+void *arena_ptr(arena_t *arena, uint64_t off);
+
+// Set and get the root object (NULL if none).
+void arena_set_root(arena_t *arena, void *ptr);
+void *arena_root(arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
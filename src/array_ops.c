@@ -0,0 +1,441 @@
+#include "array_ops.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// The part of an array processed by one thread. Operations embed a slice at
+// the start of their own per-thread state.
+struct slice {
+  disk_array_t *arr; // array being processed
+  uint64_t lo;       // first element of slice
+  uint64_t hi;       // one past last element of slice
+};
+
+// per-thread reduce state.
+struct reduce_slice {
+  struct slice slice;
+  enum array_op op; // reduce operation
+  uint64_t result;  // reduction of slice
+};
+
+// per-thread histogram state.
+struct hist_slice {
+  struct slice slice;
+  uint64_t lo;      // start of first bin
+  uint64_t hi;      // end of last bin
+  uint64_t width;   // width of each bin
+  uint64_t nbins;   // number of bins
+  uint64_t *counts; // count of each bin
+};
+
+// per-thread top-k state.
+struct top_slice {
+  struct slice slice;
+  uint64_t k;     // number of elements to keep
+  uint64_t len;   // number of elements in heap
+  uint64_t *heap; // min-heap of largest elements
+};
+
+// per-thread sort state.
+struct sort_slice {
+  struct slice slice;
+  disk_array_t *runs; // output of sorted runs
+  uint64_t run_len;   // elements per run
+  int nthreads;       // stride between this thread's runs
+  int first;          // first run sorted by this thread
+};
+
+// Helper function that returns the elements of arr, which must be uint64_t.
+static uint64_t *elements(disk_array_t *arr) {
+  assert(*arr->element_size == sizeof(uint64_t));
+  return arr->array;
+}
+
+// Helper function that releases elements [lo, hi) of arr.
+static void release(disk_array_t *arr, uint64_t lo, uint64_t hi) {
+  mm_release(&arr->mm_region, elements(arr) + lo,
+             (hi - lo) * sizeof(uint64_t));
+}
+
+// Run fn on nthreads slices of arr. args holds nthreads per-thread states of
+// arg_size bytes each, each starting with a struct slice (which is filled in
+// here).
+static void parallel(disk_array_t *arr, int nthreads, void *(*fn)(void *),
+                     void *args, size_t arg_size) {
+  uint64_t n = *arr->n;
+  uint64_t width = (n + nthreads - 1) / nthreads;
+  pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+
+  // the array is read once, front to back, by each thread.
+  madvise(arr->mm_region.start, arr->mm_region.size, MADV_SEQUENTIAL);
+  for (int t = 0; t < nthreads; t++) {
+    struct slice *s = args + t * arg_size;
+    s->arr = arr;
+    s->lo = t * width < n ? t * width : n;
+    s->hi = s->lo + width < n ? s->lo + width : n;
+    pthread_create(&threads[t], NULL, fn, s);
+  }
+  for (int t = 0; t < nthreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  free(threads);
+}
+
+// Helper function that returns the number of threads to use.
+static int thread_count(int nthreads) {
+  return nthreads ? nthreads : sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+// Helper function that creates the array fname holding the n elements of src.
+static void write_array(const char *fname, const uint64_t *src, uint64_t n) {
+  disk_array_t dst;
+  // arrays can't be empty; an empty result is a single zero element.
+  array_open(fname, n ? n : 1, sizeof(uint64_t), &dst);
+  memcpy(dst.array, src, n * sizeof(uint64_t));
+  *dst.n = n;
+  array_close(&dst);
+}
+
+static void *reduce_run(void *arg) {
+  struct reduce_slice *r = arg;
+  uint64_t *data = elements(r->slice.arr);
+  uint64_t result = r->op == ARRAY_MIN ? UINT64_MAX : 0;
+
+  for (uint64_t lo = r->slice.lo; lo < r->slice.hi; lo += ARRAY_CHUNK) {
+    uint64_t hi = lo + ARRAY_CHUNK < r->slice.hi ? lo + ARRAY_CHUNK
+                                                 : r->slice.hi;
+    // one loop per op, so each can be vectorized.
+    switch (r->op) {
+    case ARRAY_SUM:
+      for (uint64_t i = lo; i < hi; i++) {
+        result += data[i];
+      }
+      break;
+    case ARRAY_MIN:
+      for (uint64_t i = lo; i < hi; i++) {
+        result = data[i] < result ? data[i] : result;
+      }
+      break;
+    case ARRAY_MAX:
+      for (uint64_t i = lo; i < hi; i++) {
+        result = data[i] > result ? data[i] : result;
+      }
+      break;
+    }
+    release(r->slice.arr, lo, hi);
+  }
+  r->result = result;
+  return NULL;
+}
+
+uint64_t array_reduce(disk_array_t *arr, enum array_op op, int nthreads) {
+  assert(arr);
+  nthreads = thread_count(nthreads);
+  struct reduce_slice *slices = calloc(nthreads, sizeof(struct reduce_slice));
+  for (int t = 0; t < nthreads; t++) {
+    slices[t].op = op;
+  }
+  parallel(arr, nthreads, reduce_run, slices, sizeof(struct reduce_slice));
+
+  uint64_t result = slices[0].result;
+  for (int t = 1; t < nthreads; t++) {
+    uint64_t r = slices[t].result;
+    if (op == ARRAY_SUM) {
+      result += r;
+    } else if (op == ARRAY_MIN) {
+      result = r < result ? r : result;
+    } else {
+      result = r > result ? r : result;
+    }
+  }
+  free(slices);
+  return result;
+}
+
+static void *hist_run(void *arg) {
+  struct hist_slice *h = arg;
+  uint64_t *data = elements(h->slice.arr);
+
+  for (uint64_t lo = h->slice.lo; lo < h->slice.hi; lo += ARRAY_CHUNK) {
+    uint64_t hi = lo + ARRAY_CHUNK < h->slice.hi ? lo + ARRAY_CHUNK
+                                                 : h->slice.hi;
+    for (uint64_t i = lo; i < hi; i++) {
+      uint64_t v = data[i];
+      if (v >= h->lo && v < h->hi) {
+        h->counts[(v - h->lo) / h->width]++;
+      }
+    }
+    release(h->slice.arr, lo, hi);
+  }
+  return NULL;
+}
+
+void array_histogram(disk_array_t *arr, uint64_t lo, uint64_t hi,
+                     uint64_t nbins, const char *dst_fname, int nthreads) {
+  assert(arr);
+  assert(nbins);
+  assert(lo < hi);
+  nthreads = thread_count(nthreads);
+  uint64_t width = (hi - lo) / nbins + ((hi - lo) % nbins != 0);
+
+  struct hist_slice *slices = calloc(nthreads, sizeof(struct hist_slice));
+  for (int t = 0; t < nthreads; t++) {
+    slices[t].lo = lo;
+    slices[t].hi = hi;
+    slices[t].width = width;
+    slices[t].nbins = nbins;
+    slices[t].counts = calloc(nbins, sizeof(uint64_t));
+  }
+  parallel(arr, nthreads, hist_run, slices, sizeof(struct hist_slice));
+
+  // sum the per-thread counts into the first thread's.
+  for (int t = 1; t < nthreads; t++) {
+    for (uint64_t b = 0; b < nbins; b++) {
+      slices[0].counts[b] += slices[t].counts[b];
+    }
+    free(slices[t].counts);
+  }
+  DEBUG_PRINT("writing %lu bins of width %lu to %s\n", nbins, width,
+              dst_fname);
+  write_array(dst_fname, slices[0].counts, nbins);
+  free(slices[0].counts);
+  free(slices);
+}
+
+// Restore the min-heap property of heap (of len elements) below position i.
+static void sift_down(uint64_t *heap, uint64_t len, uint64_t i) {
+  while (2 * i + 1 < len) {
+    uint64_t c = 2 * i + 1;
+    if (c + 1 < len && heap[c + 1] < heap[c]) {
+      c++;
+    }
+    if (heap[i] <= heap[c]) {
+      return;
+    }
+    uint64_t tmp = heap[i];
+    heap[i] = heap[c];
+    heap[c] = tmp;
+    i = c;
+  }
+}
+
+// Add v to the top-k heap of t, if it is among the k largest seen.
+static void top_add(struct top_slice *t, uint64_t v) {
+  if (t->len < t->k) {
+    // heap not full; sift v up from the end.
+    uint64_t i = t->len++;
+    while (i && t->heap[(i - 1) / 2] > v) {
+      t->heap[i] = t->heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    t->heap[i] = v;
+  } else if (v > t->heap[0]) {
+    // replace the smallest kept element.
+    t->heap[0] = v;
+    sift_down(t->heap, t->len, 0);
+  }
+}
+
+static void *top_run(void *arg) {
+  struct top_slice *t = arg;
+  uint64_t *data = elements(t->slice.arr);
+
+  for (uint64_t lo = t->slice.lo; lo < t->slice.hi; lo += ARRAY_CHUNK) {
+    uint64_t hi = lo + ARRAY_CHUNK < t->slice.hi ? lo + ARRAY_CHUNK
+                                                 : t->slice.hi;
+    for (uint64_t i = lo; i < hi; i++) {
+      top_add(t, data[i]);
+    }
+    release(t->slice.arr, lo, hi);
+  }
+  return NULL;
+}
+
+void array_top_k(disk_array_t *arr, uint64_t k, const char *dst_fname,
+                 int nthreads) {
+  assert(arr);
+  assert(k);
+  nthreads = thread_count(nthreads);
+
+  struct top_slice *slices = calloc(nthreads, sizeof(struct top_slice));
+  for (int t = 0; t < nthreads; t++) {
+    slices[t].k = k;
+    slices[t].heap = malloc(k * sizeof(uint64_t));
+  }
+  parallel(arr, nthreads, top_run, slices, sizeof(struct top_slice));
+
+  // merge the per-thread heaps into the first thread's.
+  for (int t = 1; t < nthreads; t++) {
+    for (uint64_t i = 0; i < slices[t].len; i++) {
+      top_add(&slices[0], slices[t].heap[i]);
+    }
+    free(slices[t].heap);
+  }
+
+  // heap sort: repeatedly move the smallest to the end, leaving the elements
+  // largest first.
+  uint64_t *heap = slices[0].heap;
+  uint64_t len = slices[0].len;
+  for (uint64_t end = len; end > 1; end--) {
+    uint64_t tmp = heap[0];
+    heap[0] = heap[end - 1];
+    heap[end - 1] = tmp;
+    sift_down(heap, end - 1, 0);
+  }
+  write_array(dst_fname, heap, len);
+  free(heap);
+  free(slices);
+}
+
+// Compare two uint64_t elements.
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(uint64_t *)a;
+  uint64_t y = *(uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Thread function that sorts every nthreads-th run, starting at first, into
+// the runs array.
+static void *sort_runs(void *arg) {
+  struct sort_slice *s = arg;
+  disk_array_t *arr = s->slice.arr;
+  uint64_t n = *arr->n;
+  uint64_t *buf = malloc(s->run_len * sizeof(uint64_t));
+
+  for (uint64_t lo = s->first * s->run_len; lo < n;
+       lo += s->nthreads * s->run_len) {
+    uint64_t hi = lo + s->run_len < n ? lo + s->run_len : n;
+    memcpy(buf, elements(arr) + lo, (hi - lo) * sizeof(uint64_t));
+    release(arr, lo, hi);
+    qsort(buf, hi - lo, sizeof(uint64_t), cmp_u64);
+    memcpy(elements(s->runs) + lo, buf, (hi - lo) * sizeof(uint64_t));
+    release(s->runs, lo, hi);
+  }
+  free(buf);
+  return NULL;
+}
+
+// A run being merged: the position of its next element, and its end.
+struct cursor {
+  uint64_t pos; // next element
+  uint64_t end; // one past last element
+};
+
+// Restore the heap property below position i of a heap of run indicies,
+// ordered by each run's next element.
+static void sift_runs(uint32_t *heap, uint32_t len, uint32_t i,
+                      struct cursor *runs, uint64_t *data) {
+  while (2 * i + 1 < len) {
+    uint32_t c = 2 * i + 1;
+    if (c + 1 < len && data[runs[heap[c + 1]].pos] < data[runs[heap[c]].pos]) {
+      c++;
+    }
+    if (data[runs[heap[i]].pos] <= data[runs[heap[c]].pos]) {
+      return;
+    }
+    uint32_t tmp = heap[i];
+    heap[i] = heap[c];
+    heap[c] = tmp;
+    i = c;
+  }
+}
+
+// Merge the sorted runs (of run_len elements each) of src into dst.
+static void merge_runs(disk_array_t *src, disk_array_t *dst, uint64_t run_len) {
+  uint64_t n = *src->n;
+  uint32_t nruns = (n + run_len - 1) / run_len;
+  uint64_t *in = elements(src);
+  uint64_t *out = elements(dst);
+  struct cursor *runs = malloc(nruns * sizeof(struct cursor));
+  uint32_t *heap = malloc(nruns * sizeof(uint32_t));
+
+  for (uint32_t r = 0; r < nruns; r++) {
+    runs[r].pos = r * run_len;
+    runs[r].end = runs[r].pos + run_len < n ? runs[r].pos + run_len : n;
+    heap[r] = r;
+  }
+  uint32_t len = nruns;
+  for (uint32_t i = len / 2; i-- > 0;) {
+    sift_runs(heap, len, i, runs, in);
+  }
+
+  madvise(src->mm_region.start, src->mm_region.size, MADV_SEQUENTIAL);
+  for (uint64_t k = 0; k < n; k++) {
+    struct cursor *c = &runs[heap[0]];
+    out[k] = in[c->pos++];
+    if (c->pos % ARRAY_CHUNK == 0 || c->pos == c->end) {
+      // done with a chunk of this run.
+      uint64_t lo = c->pos - 1 - (c->pos - 1) % ARRAY_CHUNK;
+      release(src, lo, c->pos);
+    }
+    if ((k + 1) % ARRAY_CHUNK == 0) {
+      release(dst, k + 1 - ARRAY_CHUNK, k + 1);
+    }
+    if (c->pos == c->end) {
+      // run finished; remove it from the heap.
+      heap[0] = heap[--len];
+    }
+    sift_runs(heap, len, 0, runs, in);
+  }
+
+  free(heap);
+  free(runs);
+}
+
+void array_sort(disk_array_t *arr, const char *dst_fname, size_t mem,
+                int nthreads) {
+  assert(arr);
+  assert(*arr->element_size == sizeof(uint64_t));
+  nthreads = thread_count(nthreads);
+  uint64_t n = *arr->n;
+  if (!mem) {
+    mem = ARRAY_SORT_MEM;
+  }
+  uint64_t run_len = mem / sizeof(uint64_t) / nthreads;
+  if (run_len < ARRAY_CHUNK) {
+    run_len = ARRAY_CHUNK;
+  }
+  uint64_t nruns = (n + run_len - 1) / run_len;
+  if (nthreads > nruns) {
+    nthreads = nruns ? nruns : 1;
+  }
+
+  disk_array_t dst;
+  array_open(dst_fname, n ? n : 1, sizeof(uint64_t), &dst);
+  *dst.n = n;
+
+  // a single run is sorted straight into dst.
+  char *runs_fname = NULL;
+  disk_array_t runs = dst;
+  if (nruns > 1) {
+    runs_fname = malloc(strlen(dst_fname) + 10);
+    strcpy(runs_fname, dst_fname);
+    strcat(runs_fname, ".runs");
+    array_open(runs_fname, n, sizeof(uint64_t), &runs);
+  }
+  DEBUG_PRINT("sorting %lu elements in %lu runs of %lu\n", n, nruns, run_len);
+
+  struct sort_slice *slices = calloc(nthreads, sizeof(struct sort_slice));
+  for (int t = 0; t < nthreads; t++) {
+    slices[t].runs = &runs;
+    slices[t].run_len = run_len;
+    slices[t].nthreads = nthreads;
+    slices[t].first = t;
+  }
+  parallel(arr, nthreads, sort_runs, slices, sizeof(struct sort_slice));
+  free(slices);
+
+  if (runs_fname) {
+    merge_runs(&runs, &dst, run_len);
+    array_close(&runs);
+    strcat(runs_fname, ".arr");
+    unlink(runs_fname);
+    free(runs_fname);
+  }
+  array_close(&dst);
+}
@@ -0,0 +1,72 @@
+#ifndef __ARRAY_OPS_H__
+#define __ARRAY_OPS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "disk_array.h"
+
+// ----------------------------------
+// out-of-core disk array operations
+// ----------------------------------
+//
+// Sort, reduce, histogram and top-k operations on disk arrays of uint64_t
+// elements, for arrays that may be much larger than memory.
+//
+// Typical usage:
+//
+//    disk_array_t samples;
+//    array_open("samples", 0, 0, &samples);
+//
+//    uint64_t max = array_reduce(&samples, ARRAY_MAX, 0);
+//    array_histogram(&samples, 0, max + 1, 100, "samples-hist", 0);
+//    array_top_k(&samples, 10, "samples-top", 0);
+//    array_sort(&samples, "samples-sorted", 0, 0);
+//    array_close(&samples);
+//
+// Results are written as new disk arrays (of uint64_t), except for reductions,
+// which are returned.
+//
+// Each operation splits the array into one contiguous slice per thread (one
+// thread per CPU if nthreads is 0). Threads stream through their slice in
+// chunks of ARRAY_CHUNK elements, and release each chunk's pages (see
+// mm_release) once done with it, so memory use does not grow with the size of
+// the array.
+//
+// array_sort is an external merge sort: runs of the array that fit in the
+// memory budget are sorted in parallel and written to a temporary array
+// (dst_fname.runs.arr), and the runs are then merged into dst_fname in a single
+// pass.
+
+// Number of elements processed at a time by each thread (512 KiB).
+#define ARRAY_CHUNK (1 << 16)
+
+// Default memory budget for array_sort.
+#define ARRAY_SORT_MEM ((size_t)256 << 20)
+
+enum array_op {
+  ARRAY_SUM, // sum of elements (modulo 2^64)
+  ARRAY_MIN, // smallest element (UINT64_MAX for an empty array)
+  ARRAY_MAX, // largest element (0 for an empty array)
+};
+
+// Reduce the elements of arr with op.
+uint64_t array_reduce(disk_array_t *arr, enum array_op op, int nthreads);
+
+// Count the elements of arr in nbins equal-width bins covering [lo, hi),
+// writing the counts to the new array dst_fname. Elements outside [lo, hi) are
+// not counted.
+void array_histogram(disk_array_t *arr, uint64_t lo, uint64_t hi,
+                     uint64_t nbins, const char *dst_fname, int nthreads);
+
+// Write the k largest elements of arr, largest first, to the new array
+// dst_fname (which has fewer than k elements if arr does).
+void array_top_k(disk_array_t *arr, uint64_t k, const char *dst_fname,
+                 int nthreads);
+
+// Write the elements of arr, in ascending order, to the new array dst_fname,
+// using about mem bytes of memory for sorting (ARRAY_SORT_MEM if mem is 0).
+void array_sort(disk_array_t *arr, const char *dst_fname, size_t mem,
+                int nthreads);
+
+#endif
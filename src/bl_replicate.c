@@ -0,0 +1,148 @@
+#include "block_list.h"
+#include "block_list_follow.h"
+#include "block_list_repl.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+void usage(const char *name) {
+  printf("usage: %s lead list sock [idle_ms]\n"
+         "       %s follow list size sock\n"
+         "       %s load list n block_size [pause_us]\n"
+         "  lead:   ships the blocks appended to list to a follower\n"
+         "          connecting on sock, until no block is appended for\n"
+         "          idle_ms.\n"
+         "  follow: replicates from a leader on sock into list (created with\n"
+         "          size bytes if size is nonzero).\n"
+         "  load:   appends n blocks of block_size bytes to list, pausing\n"
+         "          pause_us microseconds between appends.\n",
+         name, name, name);
+}
+
+uint64_t parse(const char *str) { return strtoull(str, NULL, 10); }
+
+double seconds(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int lead(char *name, char *sock, int idle_ms) {
+  block_list_t lst;
+  bl_follow_t follow;
+  bl_leader_t leader;
+  bl_open(name, 0, &lst);
+  bl_follow_open(name, &follow);
+
+  int listen_fd = bl_repl_listen(sock);
+  if (listen_fd < 0) {
+    printf("could not listen on %s\n", sock);
+    return 1;
+  }
+  if (bl_leader_accept(listen_fd, &lst, &follow, &leader)) {
+    printf("follower's replica does not match %s\n", name);
+    return 1;
+  }
+  printf("follower connected at offset %lu\n", leader.sent);
+
+  int64_t n;
+  while ((n = bl_leader_ship(&leader, idle_ms)) > 0) {
+  }
+  if (n < 0) {
+    printf("follower disconnected\n");
+  }
+  bl_leader_close(&leader);
+  close(listen_fd);
+  unlink(sock);
+
+  printf("shipped %lu messages up to offset %lu, acknowledged up to %lu\n",
+         leader.messages, leader.sent, leader.acked);
+  if (leader.lag_count) {
+    printf("lag: mean %.3f ms, max %.3f ms\n",
+           leader.lag_total_ns / 1e6 / leader.lag_count,
+           leader.lag_max_ns / 1e6);
+  }
+  bl_follow_close(&follow, NULL);
+  bl_close(&lst);
+  return 0;
+}
+
+int follow(char *name, uint64_t size, char *sock) {
+  block_list_t lst;
+  bl_replica_t replica;
+  bl_open(name, size, &lst);
+
+  // give the leader a moment to start listening.
+  int tries = 0;
+  while (bl_replica_connect(sock, &lst, &replica)) {
+    if (++tries == 100) {
+      printf("could not connect to %s\n", sock);
+      return 1;
+    }
+    usleep(10000);
+  }
+  printf("connected at offset %lu\n", replica.applied);
+
+  uint64_t messages = 0;
+  int64_t n;
+  while ((n = bl_replica_apply(&replica)) > 0) {
+    messages++;
+  }
+  if (n < 0) {
+    printf("replication failed at offset %lu\n", replica.applied);
+  }
+  printf("applied %lu messages up to offset %lu\n", messages,
+         replica.applied);
+  bl_replica_close(&replica);
+  bl_close(&lst);
+  return n < 0;
+}
+
+int load(char *name, uint64_t n, uint32_t block_size, uint64_t pause_us) {
+  block_list_t lst;
+  bl_follow_t follow;
+  bl_open(name, 0, &lst);
+  bl_follow_attach(name, &lst, &follow);
+
+  char *block = malloc(block_size);
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint64_t i;
+  for (i = 0; i < n; i++) {
+    memset(block, 'a' + i % 26, block_size);
+    if (!bl_append(block, block_size, &lst)) {
+      printf("%s is full!\n", name);
+      break;
+    }
+    if (pause_us) {
+      usleep(pause_us);
+    }
+  }
+  printf("appended %lu blocks in %.3f s\n", i, seconds(&start));
+  free(block);
+  bl_follow_close(&follow, &lst);
+  bl_close(&lst);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  // a follower going away shows up as failed writes.
+  signal(SIGPIPE, SIG_IGN);
+
+  if (argc >= 4 && !strcmp(argv[1], "lead")) {
+    return lead(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : -1);
+  }
+  if (argc >= 5 && !strcmp(argv[1], "follow")) {
+    return follow(argv[2], parse(argv[3]), argv[4]);
+  }
+  if (argc >= 5 && !strcmp(argv[1], "load")) {
+    return load(argv[2], parse(argv[3]), parse(argv[4]),
+                argc > 5 ? parse(argv[5]) : 0);
+  }
+  usage(argv[0]);
+  return 1;
+}
@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "mm_util.h"
+#include "stats.h"
 #include "util.h"
 
 // Helper macro that takes an address/pointer argument and dereferences it as a
@@ -14,7 +15,7 @@
 // dereferences (address+offset) as an unsigned 32-bit integer.
 #define AS_INT_OFFSET(expr, offset) *((uint32_t *)((expr) + (offset)))
 
-void bl_open(const char *fname, uint32_t size, block_list_t *lst) {
+void bl_open(const char *fname, uint64_t size, block_list_t *lst) {
   assert(lst);
   assert(size ? size > 4 * sizeof(uint32_t) : 1);
   char *tpath = malloc(strlen(fname) + 5);
@@ -30,9 +31,25 @@ void bl_open(const char *fname, uint32_t size, block_list_t *lst) {
   }
   lst->start = lst->mm_region.start;
   lst->tail = NULL; // tail is uninitialized.
+  lst->notify = NULL;
+  lst->notify_arg = NULL;
   free(tpath);
 }
 
+void bl_view(void *start, size_t size, uint64_t tail, block_list_t *lst) {
+  assert(lst);
+  assert(size > 4 * sizeof(uint32_t));
+  assert(tail < size);
+  lst->mm_region.start = start;
+  lst->mm_region.size = size;
+  lst->mm_region.fd = -1;
+  lst->mm_region.flags = 0;
+  lst->start = start;
+  lst->tail = tail ? start + tail : NULL;
+  lst->notify = NULL;
+  lst->notify_arg = NULL;
+}
+
 void bl_close(block_list_t *lst) {
   // Just close the mmap-ed region.
   mm_close(&lst->mm_region);
@@ -63,6 +80,8 @@ void init_tail(block_list_t *lst) {
 }
 
 char *bl_append(char *block, uint32_t block_size, block_list_t *lst) {
+  STATS_BEGIN(STATS_BL_APPEND);
+  void *data_start = NULL;
   assert(block);
   assert(block_size);
 
@@ -80,14 +99,14 @@ char *bl_append(char *block, uint32_t block_size, block_list_t *lst) {
   if (lst->tail + block_size + 4 * sizeof(uint32_t) >
       lst->start + lst->mm_region.size) {
     // new tail would be outsie of possible range!
-    return NULL;
+    goto out;
   }
 
   // set tail value to be the new block size.
   AS_INT(lst->tail) = block_size;
 
   // copy the block to the tail's data region.
-  void *data_start = lst->tail + sizeof(uint32_t);
+  data_start = lst->tail + sizeof(uint32_t);
   memcpy(data_start, block, block_size);
 
   // update the tail to point past the block we just added.
@@ -98,10 +117,77 @@ char *bl_append(char *block, uint32_t block_size, block_list_t *lst) {
   AS_INT(lst->tail) = 0;
   AS_INT_OFFSET(lst->tail, sizeof(uint32_t)) = 0;
 
+  if (lst->notify) {
+    lst->notify(lst);
+  }
+
+out:
+  STATS_END(STATS_BL_APPEND);
   return data_start;
 }
 
+char *bl_append_v(const struct iovec *iov, int iovcnt, int atomic,
+                  block_list_t *lst) {
+  assert(iov);
+  if (iovcnt <= 0) {
+    // nothing to append.
+    return NULL;
+  }
+
+  // initialize tail, as we need to append there.
+  init_tail(lst);
+
+  // Each block needs its size plus a header and footer, and there must still
+  // be room for the 8 byte tail afterwards (see bl_append).
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    if (!iov[i].iov_len || iov[i].iov_len > UINT32_MAX) {
+      // not a valid block size.
+      return NULL;
+    }
+    total += iov[i].iov_len + 2 * sizeof(uint32_t);
+  }
+  if (lst->tail + total + 2 * sizeof(uint32_t) >
+      lst->start + lst->mm_region.size) {
+    // new tail would be outside of possible range!
+    return NULL;
+  }
+
+  // Lay out the blocks back to back. The first block's header is the current
+  // tail (which is zero); when committing atomically it is written last, so
+  // that readers stop at the old tail until every block is in place.
+  void *first = lst->tail;
+  void *cur = lst->tail;
+  for (int i = 0; i < iovcnt; i++) {
+    uint32_t block_size = iov[i].iov_len;
+    if (i || !atomic) {
+      AS_INT(cur) = block_size;
+    }
+    memcpy(cur + sizeof(uint32_t), iov[i].iov_base, block_size);
+    AS_INT_OFFSET(cur, sizeof(uint32_t) + block_size) = block_size;
+    cur += block_size + 2 * sizeof(uint32_t);
+  }
+
+  // write the new tail once.
+  AS_INT(cur) = 0;
+  AS_INT_OFFSET(cur, sizeof(uint32_t)) = 0;
+  lst->tail = cur;
+
+  if (atomic) {
+    // commit: publish the first block.
+    __atomic_store_n((uint32_t *)first, (uint32_t)iov[0].iov_len,
+                     __ATOMIC_RELEASE);
+  }
+
+  if (lst->notify) {
+    lst->notify(lst);
+  }
+
+  return first + sizeof(uint32_t);
+}
+
 char *bl_next(char *last, uint32_t *block_size, block_list_t *lst) {
+  STATS_BEGIN(STATS_BL_NEXT);
   if (!last) {
     // last is null, so we are starting a new traversal.
     // start at start of head block (size 0).
@@ -118,12 +204,14 @@ char *bl_next(char *last, uint32_t *block_size, block_list_t *lst) {
     // at tail, return NULL
     // TODO: as an optimization, make this initialize lst->tail if it has not
     //       already been initialized.
-    return NULL;
+    last = NULL;
   }
+  STATS_END(STATS_BL_NEXT);
   return last;
 }
 
 char *bl_prev(char *last, uint32_t *block_size, block_list_t *lst) {
+  STATS_BEGIN(STATS_BL_PREV);
   if (!last) {
     // last is null, so we are starting a new traversal.
     // initialize the tail pointer if we already haven't done so.
@@ -135,9 +223,49 @@ char *bl_prev(char *last, uint32_t *block_size, block_list_t *lst) {
   *block_size = AS_INT_OFFSET(last, 2 * -(int)sizeof(uint32_t));
   if (!*block_size) {
     // at head, return NULL
-    return NULL;
+    last = NULL;
+  } else {
+    // Go back a block and two ints.
+    last = (char *)(last - 2 * sizeof(uint32_t) - *block_size);
   }
-  // Go back a block and two ints.
-  last = (char *)(last - 2 * sizeof(uint32_t) - *block_size);
+  STATS_END(STATS_BL_PREV);
   return last;
 }
+
+void bl_window_open(const char *fname, size_t window_size, int nwindows,
+                    bl_window_t *lst) {
+  assert(lst);
+  char *tpath = malloc(strlen(fname) + 5);
+  strcpy(tpath, fname);
+  strcat(tpath, ".ll");
+  mm_window_open(tpath, window_size, nwindows, &lst->win);
+  free(tpath);
+  // start at first real block (skip 8 bytes zero padding).
+  lst->pos = 2 * sizeof(uint32_t);
+}
+
+char *bl_window_next(uint32_t *block_size, bl_window_t *lst) {
+  *block_size = 0;
+  void *header = mm_window_get(&lst->win, lst->pos, sizeof(uint32_t));
+  if (!header || !AS_INT(header)) {
+    // at tail, return NULL (and stay at the tail).
+    return NULL;
+  }
+  uint32_t size = AS_INT(header);
+  // map the whole block, header and footer included.
+  header = mm_window_get(&lst->win, lst->pos, size + 2 * sizeof(uint32_t));
+  if (!header) {
+    // block runs past the end of the file (a corrupt size); stop here.
+    return NULL;
+  }
+  lst->pos += size + 2 * sizeof(uint32_t);
+  *block_size = size;
+  return header + sizeof(uint32_t);
+}
+
+void bl_window_release(bl_window_t *lst) {
+  // the last block read ends at pos; keep its window.
+  mm_window_release(&lst->win, lst->pos - 1);
+}
+
+void bl_window_close(bl_window_t *lst) { mm_window_close(&lst->win); }
@@ -2,6 +2,7 @@
 #define __BLOCK_LIST_H__
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "mm_util.h"
 
@@ -49,19 +50,30 @@ typedef struct block_list_t block_list_t;
 // Internally, blocks are navigated as a linked list, by examining the
 // header/footer of blocks in order to determine where to find the next
 // header/footer.
+//
+// Blocks are located by their position in the file rather than by stored
+// offsets, so lists may be larger than 4 GiB; only each block is limited to
+// 32-bit sizes.
 
 // block list struct.
 struct block_list_t {
   mm_region_t mm_region; // memory-mapped region data
   void *start;           // pointer to base address of block list.
   void *tail; // pointer to list tail (do not read, may not be initialized).
+  void (*notify)(block_list_t *lst); // called after each append, or NULL.
+  void *notify_arg;                  // data for notify.
 };
 
 // Open a disk-backed append-only block list format.
 //
 // If table exists, size should be zero.  When size is nonzero, the table will
 // be created with the given size.
-void bl_open(const char *fname, uint32_t size, block_list_t *lst);
+void bl_open(const char *fname, uint64_t size, block_list_t *lst);
+
+// Set up lst to use the list file contents at start (size bytes) in memory that
+// is already mapped, as a borrowed region (see mm_util.h). If tail is nonzero,
+// it is the offset of the list's tail, which is then not searched for.
+void bl_view(void *start, size_t size, uint64_t tail, block_list_t *lst);
 
 // Close a list.
 void bl_close(block_list_t *lst);
@@ -73,6 +85,17 @@ void bl_close(block_list_t *lst);
 // if the list was full.
 char *bl_append(char *block, uint32_t block_size, block_list_t *lst);
 
+// Append several blocks to a block list at once.
+//
+// iov is an array of iovcnt buffers (struct iovec, from sys/uio.h), each of
+// which is appended as one block. Space is checked once for all of them: if
+// they do not all fit, nothing is appended. If atomic is nonzero, the blocks
+// become visible to readers together -- a reader walking the list sees either
+// all of them or none. Returns pointer to the first appended block, or NULL if
+// the list was full (or iovcnt is not positive, or a buffer is empty).
+char *bl_append_v(const struct iovec *iov, int iovcnt, int atomic,
+                  block_list_t *lst);
+
 // Reads a block from the list.
 //
 // Blocks are read in order. last should be a pointer returned by
@@ -83,4 +106,59 @@ char *bl_append(char *block, uint32_t block_size, block_list_t *lst);
 char *bl_next(char *last, uint32_t *block_size, block_list_t *lst);
 char *bl_prev(char *last, uint32_t *block_size, block_list_t *lst);
 
+// Find the tail of the list, if it has not been found yet. After this call,
+// lst->tail points at the zero-size block that ends the list.
+void init_tail(block_list_t *lst);
+
+// ---------------------------
+// windowed block list reading
+// ---------------------------
+//
+// Lists too large to map whole can be read front to back through a windowed
+// mapping instead (see mm_window_open):
+//
+//    bl_window_t list;
+//    bl_window_open(filename, 0, 0, &list);
+//    uint32_t cur_size = 0;
+//    char *cur_block = bl_window_next(&cur_size, &list);
+//    while (cur_block) {
+//      // process block
+//      // done with blocks before this one
+//      bl_window_release(&list);
+//      cur_block = bl_window_next(&cur_size, &list);
+//    }
+//    bl_window_close(&list);
+//
+// A returned block is valid as long as the window holding it is (at least until
+// the next bl_window_next). Once the end of the list is reached,
+// bl_window_next returns NULL until more blocks are appended.
+//
+// Windowed lists are a separate type, rather than a mode of block_list_t,
+// because code that uses a block_list_t relies on the whole list being mapped:
+// bl_prev and bl_append reach the tail through lst->start, and the follow,
+// export, validation and index modules compute offsets from it. A windowed
+// list is only read forward, which is what scans of large lists need.
+
+typedef struct bl_window_t bl_window_t;
+struct bl_window_t {
+  mm_window_t win; // windowed file
+  uint64_t pos;    // file offset of next block's header
+};
+
+// Open an existing list for windowed reading (see mm_window_open for
+// window_size and nwindows).
+void bl_window_open(const char *fname, size_t window_size, int nwindows,
+                    bl_window_t *lst);
+
+// Read the next block of the list, setting block_size to its size. Returns
+// NULL (and size 0) at the end of the list, or at a block whose size runs past
+// the end of the file.
+char *bl_window_next(uint32_t *block_size, bl_window_t *lst);
+
+// Release the windows holding only blocks before the last block read.
+void bl_window_release(bl_window_t *lst);
+
+// Close a windowed list.
+void bl_window_close(bl_window_t *lst);
+
 #endif
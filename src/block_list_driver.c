@@ -1,8 +1,14 @@
+#include "arena.h"
 #include "block_list.h"
+#include "block_list_export.h"
+#include "block_list_follow.h"
+#include "block_list_reader.h"
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define BUFF_LEN 80
 
@@ -12,6 +18,13 @@ void usage() {
          "n                next element\n"
          "p                prev element\n"
          "r                reset iterator\n"
+         "v size c1 c2 ... append one block of each char atomically\n"
+         "x idx n file     export n blocks starting at idx to file\n"
+         "i file           import blocks exported to file\n"
+         "f                publish appends to followers (other drivers)\n"
+         "w ms             wait up to ms for blocks after iterator\n"
+         "s name size      scan list name through windows of size bytes\n"
+         "y name b         scan list name with async reads (b: a, u or p)\n"
          "c                close list\n"
          "q                quit\n");
 }
@@ -24,12 +37,27 @@ int main(int argc, char **argv) {
   uint32_t tmp_int;
   char *tmp_str;
   char *last = NULL;
+  char *path = NULL;
   block_list_t lst;
   char tmp_char;
+  uint64_t off, range_len;
+  int fd;
+  bl_follow_t follow;
+  int follow_opened = 0;
+  bl_cursor_t cursor;
+  char *blocks[16];
+  struct iovec iov[16];
+  int iovcnt;
+  uint32_t sizes[16];
+  bl_window_t window;
+  bl_reader_t reader;
+  arena_t scratch; // buffers for the current command
 
+  arena_volatile(0, &scratch);
   usage();
   printf("> ");
   while (fgets(input, BUFF_LEN, stdin)) {
+    arena_reset(&scratch);
     int len = strlen(input);
     input[--len] = '\0';
     char *op = strtok(input, " ");
@@ -43,20 +71,41 @@ int main(int argc, char **argv) {
       }
       printf("Opening file %s (size %d)\n", str, tmp_int);
       bl_open(str, tmp_int, &lst);
+      free(path);
+      path = strdup(str);
       break;
     case 'a':
       tmp_int = atoi(str);
       tmp_str = strtok(NULL, " ");
       tmp_char = *tmp_str;
-      tmp_str = malloc(tmp_int);
-      memset(tmp_str, tmp_char, tmp_int);
-      tmp_str = bl_append(tmp_str, tmp_int, &lst);
+      tmp_str = arena_alloc(&scratch, tmp_int);
+      if (tmp_str) {
+        memset(tmp_str, tmp_char, tmp_int);
+        tmp_str = bl_append(tmp_str, tmp_int, &lst);
+      }
       if (tmp_str) {
         printf("appended element (%d * %c)\n", tmp_int, tmp_char);
       } else {
         printf("could not append %d of %c!\n", tmp_int, tmp_char);
       }
       break;
+    case 'v':
+      tmp_int = atoi(str);
+      iovcnt = 0;
+      while (iovcnt < 16 && (tmp_str = strtok(NULL, " "))) {
+        iov[iovcnt].iov_base = arena_alloc(&scratch, tmp_int);
+        if (!iov[iovcnt].iov_base) {
+          iovcnt = 0;
+          break;
+        }
+        iov[iovcnt].iov_len = tmp_int;
+        memset(iov[iovcnt].iov_base, *tmp_str, tmp_int);
+        iovcnt++;
+      }
+      tmp_str = bl_append_v(iov, iovcnt, 1, &lst);
+      printf("%s %d elements of size %d\n",
+             tmp_str ? "appended" : "could not append", iovcnt, tmp_int);
+      break;
     case 'r':
       last = NULL;
       printf("reset iterator\n");
@@ -73,8 +122,90 @@ int main(int argc, char **argv) {
              tmp_str != NULL ? *tmp_str : 'X', tmp_str != NULL ? 'N' : 'Y');
       last = tmp_str;
       break;
+    case 's':
+      bl_window_open(str, parse(strtok(NULL, " ")), 2, &window);
+      off = 0;
+      range_len = 0;
+      while ((tmp_str = bl_window_next(&tmp_int, &window))) {
+        off++;
+        range_len += tmp_int;
+        bl_window_release(&window);
+      }
+      bl_window_close(&window);
+      printf("scanned %lu blocks (%lu bytes)\n", off, range_len);
+      break;
+    case 'y':
+      tmp_str = strtok(NULL, " ");
+      tmp_char = tmp_str ? *tmp_str : 'a';
+      if (bl_reader_open(str, 0, 0,
+                         tmp_char == 'u'   ? BL_READ_URING
+                         : tmp_char == 'p' ? BL_READ_POOL
+                                           : BL_READ_AUTO,
+                         &reader)) {
+        printf("could not open %s\n", str);
+        break;
+      }
+      off = 0;
+      range_len = 0;
+      while (bl_reader_next(&tmp_int, &reader)) {
+        off++;
+        range_len += tmp_int;
+      }
+      printf("scanned %lu blocks (%lu bytes) with %s%s\n", off, range_len,
+             reader.backend == BL_READ_URING ? "io_uring" : "pread threads",
+             reader.error ? " (stopped at an error)" : "");
+      bl_reader_close(&reader);
+      break;
+    case 'x':
+      tmp_int = atoi(str);
+      tmp_int = bl_index_range(tmp_int, atoi(strtok(NULL, " ")), &lst, &off,
+                               &range_len);
+      tmp_str = strtok(NULL, " ");
+      fd = open(tmp_str, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+      printf("exported %d blocks (%ld bytes at offset %lu) to %s\n", tmp_int,
+             bl_export(off, range_len, fd, &lst), off, tmp_str);
+      close(fd);
+      break;
+    case 'i':
+      fd = open(str, O_RDONLY);
+      range_len = lseek(fd, 0, SEEK_END);
+      lseek(fd, 0, SEEK_SET);
+      tmp_str = bl_import(fd, range_len, &lst);
+      printf("import of %lu bytes from %s: %s\n", range_len, str,
+             tmp_str ? "OK" : "FAILED");
+      close(fd);
+      break;
+    case 'f':
+      if (follow_opened) {
+        bl_follow_close(&follow, &lst);
+      }
+      bl_follow_attach(path, &lst, &follow);
+      follow_opened = 1;
+      printf("publishing appends to %s.llf\n", path);
+      break;
+    case 'w':
+      if (!follow_opened) {
+        // follow appends by another driver.
+        bl_follow_open(path, &follow);
+        follow_opened = 1;
+      }
+      bl_cursor_init(&cursor, &lst, &follow, last);
+      tmp_int = bl_follow(&cursor, blocks, sizes, 16, atoi(str));
+      for (int i = 0; i < tmp_int; i++) {
+        printf("new: %d of %c\n", sizes[i], *blocks[i]);
+      }
+      if (tmp_int) {
+        last = blocks[tmp_int - 1];
+      } else {
+        printf("timed out\n");
+      }
+      break;
     case 'c':
       printf("closing...\n");
+      if (follow_opened) {
+        bl_follow_close(&follow, &lst);
+        follow_opened = 0;
+      }
       bl_close(&lst);
       break;
     case 'q':
@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+#include "block_list_export.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// Helper macro that takes an address/pointer argument and dereferences it as a
+// pointer to an unsigned 32-bit integer.
+#define AS_INT(expr) *((uint32_t *)(expr))
+
+void bl_range(char *first, char *last, block_list_t *lst, uint64_t *off,
+              uint64_t *len) {
+  assert(first <= last);
+  // range starts at the header of first and ends after the footer of last.
+  void *start = first - sizeof(uint32_t);
+  void *end = last + AS_INT(last - sizeof(uint32_t)) + sizeof(uint32_t);
+  *off = start - lst->start;
+  *len = end - start;
+}
+
+uint32_t bl_index_range(uint32_t idx, uint32_t count, block_list_t *lst,
+                        uint64_t *off, uint64_t *len) {
+  uint32_t size = 0;
+  char *cur = bl_next(NULL, &size, lst);
+  for (uint32_t i = 0; cur && i < idx; i++) {
+    cur = bl_next(cur, &size, lst);
+  }
+  if (!cur || !count) {
+    // range is empty.
+    *off = 0;
+    *len = 0;
+    return 0;
+  }
+
+  char *first = cur;
+  char *last = cur;
+  uint32_t n = 1;
+  while (n < count && (cur = bl_next(cur, &size, lst))) {
+    last = cur;
+    n++;
+  }
+  bl_range(first, last, lst, off, len);
+  return n;
+}
+
+int64_t bl_export(uint64_t off, uint64_t len, int fd, block_list_t *lst) {
+  assert(off + len <= lst->mm_region.size);
+  off_t pos = off;
+  uint64_t left = len;
+  while (left) {
+    ssize_t n = sendfile(fd, lst->mm_region.fd, &pos, left);
+    if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+      // sendfile can't write to this fd; write from the mapping instead.
+      n = write(fd, lst->start + pos, left);
+      if (n > 0) {
+        pos += n;
+      }
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      DEBUG_PRINT("export failed at offset %ld\n", pos);
+      return -1;
+    }
+    left -= n;
+  }
+  return len;
+}
+
+// Helper function that moves len bytes from fd into the list's file at offset
+// off, using the cheapest method that fd supports. Returns 0 on success.
+static int read_range(int fd, uint64_t off, uint64_t len, block_list_t *lst) {
+  loff_t pos = off;
+  uint64_t left = len;
+  int method = 0; // 0: splice, 1: copy_file_range, 2: read
+  while (left) {
+    ssize_t n = -1;
+    if (method == 0) {
+      // fd is a pipe
+      n = splice(fd, NULL, lst->mm_region.fd, &pos, left, SPLICE_F_MOVE);
+    } else if (method == 1) {
+      // fd is a regular file
+      n = copy_file_range(fd, NULL, lst->mm_region.fd, &pos, left, 0);
+    } else {
+      // anything else; read straight into the mapping.
+      n = read(fd, lst->start + pos, left);
+      if (n > 0) {
+        pos += n;
+      }
+    }
+    if (n < 0 && method < 2 && errno != EINTR && errno != EAGAIN) {
+      // method not supported for this fd; try the next one.
+      method++;
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    left -= n;
+  }
+  return 0;
+}
+
+char *bl_import(int fd, uint64_t len, block_list_t *lst) {
+  // initialize tail, as we need to append there.
+  init_tail(lst);
+
+  // the range and a new (8 byte) tail must fit in the region.
+  if (len < 3 * sizeof(uint32_t) ||
+      lst->tail + len + 2 * sizeof(uint32_t) >
+          lst->start + lst->mm_region.size) {
+    DEBUG_PRINT("range of %lu bytes does not fit\n", len);
+    return NULL;
+  }
+
+  // read the first header separately, so that the list's tail stays zero (and
+  // the list unchanged) until the range is validated.
+  uint32_t first_size = 0;
+  uint64_t got = 0;
+  while (got < sizeof(uint32_t)) {
+    ssize_t n = read(fd, ((char *)&first_size) + got, sizeof(uint32_t) - got);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return NULL;
+    }
+    got += n;
+  }
+  uint64_t tail_off = lst->tail - lst->start;
+  int err = read_range(fd, tail_off + sizeof(uint32_t), len - sizeof(uint32_t),
+                       lst);
+
+  // validate the range: headers match footers and blocks fill the range.
+  uint64_t pos = 0;
+  while (!err && pos < len) {
+    uint32_t size = pos ? AS_INT(lst->tail + pos) : first_size;
+    if (!size || pos + size + 2 * sizeof(uint32_t) > len ||
+        AS_INT(lst->tail + pos + sizeof(uint32_t) + size) != size) {
+      DEBUG_PRINT("invalid block at range offset %lu\n", pos);
+      err = 1;
+      break;
+    }
+    pos += size + 2 * sizeof(uint32_t);
+  }
+  if (err) {
+    // throw away what was read; the tail is still intact.
+    memset(lst->tail + sizeof(uint32_t), 0, len - sizeof(uint32_t));
+    return NULL;
+  }
+
+  // write the new tail, then publish the range by writing its first header.
+  void *new_tail = lst->tail + len;
+  AS_INT(new_tail) = 0;
+  AS_INT(new_tail + sizeof(uint32_t)) = 0;
+  __atomic_store_n((uint32_t *)lst->tail, first_size, __ATOMIC_RELEASE);
+
+  char *data_start = lst->tail + sizeof(uint32_t);
+  lst->tail = new_tail;
+  if (lst->notify) {
+    lst->notify(lst);
+  }
+  return data_start;
+}
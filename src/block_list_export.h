@@ -0,0 +1,56 @@
+#ifndef __BLOCK_LIST_EXPORT_H__
+#define __BLOCK_LIST_EXPORT_H__
+
+#include <stdint.h>
+
+#include "block_list.h"
+
+// --------------------------------
+// block list range export / import
+// --------------------------------
+//
+// Consecutive blocks of a block list are stored contiguously in its file, as
+// headers, data and footers (see block_list.h). A run of blocks can therefore
+// be copied to another list as a single range of bytes, without walking the
+// blocks one at a time.
+//
+// Typical usage (shipping blocks 10 through 19 of one list to another):
+//
+//    uint64_t off, len;
+//    bl_index_range(10, 10, &src_list, &off, &len);
+//    bl_export(off, len, fd, &src_list);
+//    ...
+//    // on the receiving side
+//    bl_import(fd, len, &dst_list);
+//
+// bl_export streams the range from the list's file to any file descriptor
+// (file, pipe or socket) with sendfile, so the data does not pass through user
+// space. bl_import appends an exported range to a list, with splice or
+// copy_file_range where possible. The imported range is validated (every
+// header must match its footer, and the blocks must exactly fill the range)
+// before it becomes visible: the first header is written last.
+
+// Find the range of bytes holding the blocks first through last (inclusive).
+// first and last are block pointers returned by bl_next/bl_prev, and first
+// must not come after last. off is set to the offset of the range from the
+// start of the list and len to its length.
+void bl_range(char *first, char *last, block_list_t *lst, uint64_t *off,
+              uint64_t *len);
+
+// Find the range of bytes holding count blocks, starting at the block with
+// index idx (the first block has index 0). Returns the number of blocks in the
+// range, which is less than count if the list ends first.
+uint32_t bl_index_range(uint32_t idx, uint32_t count, block_list_t *lst,
+                        uint64_t *off, uint64_t *len);
+
+// Write len bytes, starting at offset off of the list, to fd. Returns the
+// number of bytes written, or -1 on error.
+int64_t bl_export(uint64_t off, uint64_t len, int fd, block_list_t *lst);
+
+// Read a range of len bytes written by bl_export from fd and append its blocks
+// to the list. Returns a pointer to the first appended block, or NULL if the
+// range did not fit, could not be read, or was not a valid range of blocks (in
+// which case the list is unchanged).
+char *bl_import(int fd, uint64_t len, block_list_t *lst);
+
+#endif
@@ -0,0 +1,169 @@
+#include "block_list_follow.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// Helper macro that takes an address/pointer argument and dereferences it as a
+// pointer to an unsigned 32-bit integer.
+#define AS_INT(expr) *((uint32_t *)(expr))
+
+// Helper function for the futex syscall (glibc has no wrapper). The futex word
+// is in a shared file mapping, so the non-private operations are used.
+static long futex(uint32_t *uaddr, int op, uint32_t val,
+                  const struct timespec *timeout) {
+  return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+void bl_follow_open(const char *fname, bl_follow_t *follow) {
+  assert(follow);
+  char *tpath = malloc(strlen(fname) + 5);
+  strcpy(tpath, fname);
+  strcat(tpath, ".llf");
+  DEBUG_PRINT("opening %s\n", tpath);
+
+  // create the follow page unless it exists (it may already be mapped by the
+  // list's writer or another reader).
+  struct stat st;
+  int exists = !stat(tpath, &st) && st.st_size >= sizeof(struct bl_follow_page);
+  mm_open(tpath, exists ? 0 : sizeof(struct bl_follow_page),
+          &follow->mm_region);
+  free(tpath);
+
+  follow->page = follow->mm_region.start;
+  if (strncmp(follow->page->hdr, "BLFW", 4)) {
+    // new follow page; nothing has been published yet.
+    memset(follow->page, 0, sizeof(struct bl_follow_page));
+    memcpy(follow->page->hdr, "BLFW", 4);
+  }
+}
+
+// Append callback: publish the list's tail and wake waiting readers.
+static void publish(block_list_t *lst) {
+  bl_follow_t *follow = lst->notify_arg;
+  struct bl_follow_page *page = follow->page;
+  __atomic_store_n(&page->tail, (uint64_t)(lst->tail - lst->start),
+                   __ATOMIC_RELEASE);
+  // seq_cst, so that the load of waiters cannot move before the increment of
+  // seq: either a reader counted in waiters sees the new seq in FUTEX_WAIT,
+  // or this sees the reader and wakes it (see bl_follow).
+  __atomic_add_fetch(&page->seq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&page->waiters, __ATOMIC_SEQ_CST)) {
+    futex(&page->seq, FUTEX_WAKE, INT_MAX, NULL);
+  }
+}
+
+void bl_follow_attach(const char *fname, block_list_t *lst,
+                      bl_follow_t *follow) {
+  bl_follow_open(fname, follow);
+  init_tail(lst);
+  lst->notify = publish;
+  lst->notify_arg = follow;
+  publish(lst);
+}
+
+void bl_follow_close(bl_follow_t *follow, block_list_t *lst) {
+  if (lst && lst->notify_arg == follow) {
+    lst->notify = NULL;
+    lst->notify_arg = NULL;
+  }
+  mm_close(&follow->mm_region);
+}
+
+void bl_cursor_init(bl_cursor_t *cursor, block_list_t *lst,
+                    bl_follow_t *follow, char *last) {
+  cursor->lst = lst;
+  cursor->follow = follow;
+  cursor->last = last;
+}
+
+// Helper function that collects up to max published blocks after the cursor.
+static int collect(bl_cursor_t *cursor, uint64_t tail, char **blocks,
+                   uint32_t *sizes, int max) {
+  block_list_t *lst = cursor->lst;
+  int n = 0;
+  while (n < max) {
+    // the next block's header follows the last block's footer (or is the
+    // first header, right after the 8 byte head).
+    void *hdr = cursor->last
+                    ? cursor->last + AS_INT(cursor->last - sizeof(uint32_t)) +
+                          sizeof(uint32_t)
+                    : lst->start + 2 * sizeof(uint32_t);
+    if (hdr - lst->start >= tail) {
+      // not published yet.
+      break;
+    }
+    uint32_t size = 0;
+    char *cur = bl_next(cursor->last, &size, lst);
+    if (!cur) {
+      break;
+    }
+    blocks[n] = cur;
+    sizes[n] = size;
+    cursor->last = cur;
+    n++;
+  }
+  return n;
+}
+
+int bl_follow(bl_cursor_t *cursor, char **blocks, uint32_t *sizes, int max,
+              int timeout_ms) {
+  struct bl_follow_page *page = cursor->follow->page;
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  if (timeout_ms >= 0) {
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  while (1) {
+    // read seq before tail, so that a publish after reading tail changes seq
+    // and the wait below returns immediately.
+    uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+    uint64_t tail = __atomic_load_n(&page->tail, __ATOMIC_ACQUIRE);
+    int n = collect(cursor, tail, blocks, sizes, max);
+    if (n) {
+      return n;
+    }
+
+    struct timespec left;
+    struct timespec *timeout = NULL;
+    if (timeout_ms >= 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      left.tv_sec = deadline.tv_sec - now.tv_sec;
+      left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+      if (left.tv_nsec < 0) {
+        left.tv_sec--;
+        left.tv_nsec += 1000000000L;
+      }
+      if (left.tv_sec < 0) {
+        // timed out.
+        return 0;
+      }
+      timeout = &left;
+    }
+
+    // seq_cst, pairing with publish: the kernel reads seq for FUTEX_WAIT after
+    // waiters is incremented.
+    __atomic_add_fetch(&page->waiters, 1, __ATOMIC_SEQ_CST);
+    long err = futex(&page->seq, FUTEX_WAIT, seq, timeout);
+    __atomic_sub_fetch(&page->waiters, 1, __ATOMIC_SEQ_CST);
+    if (err && errno == ETIMEDOUT) {
+      return 0;
+    }
+  }
+}
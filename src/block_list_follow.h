@@ -0,0 +1,104 @@
+#ifndef __BLOCK_LIST_FOLLOW_H__
+#define __BLOCK_LIST_FOLLOW_H__
+
+#include <stdint.h>
+
+#include "block_list.h"
+#include "mm_util.h"
+
+typedef struct bl_follow_t bl_follow_t;
+typedef struct bl_cursor_t bl_cursor_t;
+
+// -------------------------------------
+// following the tail of a block list
+// -------------------------------------
+//
+// Readers (in the same or other processes) can wait for blocks to be appended
+// to a list instead of polling it with bl_next. The writer attaches a follow
+// page to its list, and every append then publishes the new tail and wakes
+// any waiting readers. Each reader keeps a cursor, and bl_follow returns the
+// blocks appended after the cursor in batches.
+//
+// Typical usage:
+//
+//    // writer
+//    bl_follow_t follow;
+//    bl_open(filename, 0, &list);
+//    bl_follow_attach(filename, &list, &follow);
+//    bl_append(buffer, block_size, &list);   // wakes readers
+//    ...
+//    bl_follow_close(&follow, &list);
+//
+//    // reader (any process)
+//    bl_follow_t follow;
+//    bl_cursor_t cursor;
+//    bl_open(filename, 0, &list);
+//    bl_follow_open(filename, &follow);
+//    bl_cursor_init(&cursor, &list, &follow, NULL);
+//    while ((n = bl_follow(&cursor, blocks, sizes, MAX_BLOCKS, -1)) >= 0) {
+//      // process blocks[0..n-1]
+//    }
+//    bl_follow_close(&follow, NULL);
+//
+// The follow page is a small file next to the list, with the ".llf"
+// extension:
+//
+// | BLFW | seq | waiters | pad | tail |
+//
+// tail is the offset (from the start of the list) of the list's tail as of
+// the last append; readers never read blocks at or past it, so they never see
+// a partially written block. seq is a 32-bit counter incremented after each
+// publish, and is used as a futex word: readers sleep on it with FUTEX_WAIT
+// and the writer wakes them with FUTEX_WAKE, but only when waiters (the number
+// of sleeping readers) is nonzero.
+//
+// Only one process may append to a list at a time.
+
+// follow page layout
+struct bl_follow_page {
+  char hdr[4];      // header chars
+  uint32_t seq;     // futex word; incremented on each publish
+  uint32_t waiters; // number of readers waiting on seq
+  uint32_t pad;     // unused
+  uint64_t tail;    // offset of last published tail
+};
+
+// follow page struct
+struct bl_follow_t {
+  struct bl_follow_page *page; // pointer to the mapped follow page
+  mm_region_t mm_region;       // memory map info
+};
+
+// reader cursor struct
+struct bl_cursor_t {
+  block_list_t *lst;   // list being followed
+  bl_follow_t *follow; // follow page of lst
+  char *last;          // last block returned, or NULL if none yet
+};
+
+// Open (or create) the follow page for the list at fname.
+void bl_follow_open(const char *fname, bl_follow_t *follow);
+
+// Open the follow page for the list at fname and publish lst's appends to it.
+// The current tail is published immediately.
+void bl_follow_attach(const char *fname, block_list_t *lst,
+                      bl_follow_t *follow);
+
+// Close a follow page. If it was attached to lst, lst stops publishing; readers
+// pass NULL.
+void bl_follow_close(bl_follow_t *follow, block_list_t *lst);
+
+// Initialize a reader cursor that returns blocks after last (a block pointer
+// returned by bl_next/bl_prev, or NULL to start at the head of the list).
+void bl_cursor_init(bl_cursor_t *cursor, block_list_t *lst,
+                    bl_follow_t *follow, char *last);
+
+// Wait for blocks to be published after the cursor, and return up to max of
+// them in blocks (with their sizes in sizes), advancing the cursor past them.
+//
+// Waits at most timeout_ms milliseconds, or forever if timeout_ms is negative.
+// Returns the number of blocks returned, or 0 on timeout.
+int bl_follow(bl_cursor_t *cursor, char **blocks, uint32_t *sizes, int max,
+              int timeout_ms);
+
+#endif
@@ -0,0 +1,401 @@
+#define _GNU_SOURCE
+#include "block_list_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// chunk length of a read that has not completed.
+#define IN_FLIGHT INT64_MIN
+
+// ------------------------------
+// io_uring (raw system calls)
+// ------------------------------
+
+// Helper function that sets up an io_uring with room for entries reads.
+// Returns 0, or -1 if io_uring is not available.
+static int uring_setup(struct bl_uring *r, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  memset(r, 0, sizeof(*r));
+  r->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0) {
+    DEBUG_PRINT("io_uring not available (errno %d)\n", errno);
+    return -1;
+  }
+
+  r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    // both rings are in one mapping.
+    if (r->cq_ring_size > r->sq_ring_size) {
+      r->sq_ring_size = r->cq_ring_size;
+    }
+    r->cq_ring_size = 0;
+  }
+  r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  r->cq_ring = r->sq_ring;
+  if (r->cq_ring_size) {
+    r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  }
+  r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED ||
+      r->sqes == MAP_FAILED) {
+    close(r->fd);
+    return -1;
+  }
+
+  r->sq_tail = r->sq_ring + p.sq_off.tail;
+  r->sq_mask = r->sq_ring + p.sq_off.ring_mask;
+  r->sq_array = r->sq_ring + p.sq_off.array;
+  r->cq_head = r->cq_ring + p.cq_off.head;
+  r->cq_tail = r->cq_ring + p.cq_off.tail;
+  r->cq_mask = r->cq_ring + p.cq_off.ring_mask;
+  r->cqes = r->cq_ring + p.cq_off.cqes;
+  return 0;
+}
+
+static void uring_close(struct bl_uring *r) {
+  munmap(r->sqes, r->sqes_size);
+  if (r->cq_ring != r->sq_ring) {
+    munmap(r->cq_ring, r->cq_ring_size);
+  }
+  munmap(r->sq_ring, r->sq_ring_size);
+  close(r->fd);
+}
+
+// Helper function that queues a read of chunk k (submitted by uring_submit).
+static void uring_queue(bl_reader_t *reader, uint64_t k) {
+  struct bl_uring *r = &reader->ring;
+  struct bl_chunk *chunk = &reader->chunks[k % reader->depth];
+  unsigned tail = *r->sq_tail;
+  unsigned idx = tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = (struct io_uring_sqe *)r->sqes + idx;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = reader->fd;
+  sqe->off = chunk->off;
+  sqe->addr = (uint64_t)&chunk->iov;
+  sqe->len = 1;
+  sqe->user_data = k;
+  r->sq_array[idx] = idx;
+  // the entry must be written before the kernel sees the new tail.
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Helper function that submits n queued reads with one system call.
+static void uring_submit(bl_reader_t *reader, unsigned n) {
+  while (n) {
+    long done = syscall(__NR_io_uring_enter, reader->ring.fd, n, 0, 0, NULL, 0);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      reader->error = 1;
+      return;
+    }
+    n -= done;
+  }
+}
+
+// Helper function that waits for at least one read to complete, and records
+// the results of all completed reads.
+static void uring_wait(bl_reader_t *reader) {
+  struct bl_uring *r = &reader->ring;
+  long err = syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS,
+                     NULL, 0);
+  if (err < 0 && errno != EINTR) {
+    reader->error = 1;
+    return;
+  }
+  unsigned head = *r->cq_head;
+  unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    struct io_uring_cqe *cqe =
+        (struct io_uring_cqe *)r->cqes + (head & *r->cq_mask);
+    reader->chunks[cqe->user_data % reader->depth].len = cqe->res;
+  }
+  __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// -------------------------
+// pread thread pool
+// -------------------------
+
+static void *pool_run(void *arg) {
+  bl_reader_t *reader = arg;
+  pthread_mutex_lock(&reader->lock);
+  while (1) {
+    while (!reader->stop && reader->queued == reader->next_read) {
+      pthread_cond_wait(&reader->cond, &reader->lock);
+    }
+    if (reader->stop) {
+      break;
+    }
+    struct bl_chunk *chunk = &reader->chunks[reader->queued++ % reader->depth];
+    pthread_mutex_unlock(&reader->lock);
+
+    // read the whole chunk (or up to the end of the file).
+    int64_t got = 0;
+    while (got < reader->chunk_size) {
+      ssize_t n = pread(reader->fd, chunk->buf + got, reader->chunk_size - got,
+                        chunk->off + got);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        got = -errno;
+        break;
+      }
+      if (n == 0) {
+        break;
+      }
+      got += n;
+    }
+
+    pthread_mutex_lock(&reader->lock);
+    chunk->len = got;
+    pthread_cond_broadcast(&reader->cond);
+  }
+  pthread_mutex_unlock(&reader->lock);
+  return NULL;
+}
+
+// -------------------------
+// reading
+// -------------------------
+
+// Helper function that starts reads of the chunks after the last one read,
+// up to depth chunks from base (the first chunk still needed).
+static void refill(bl_reader_t *reader, uint64_t base) {
+  uint64_t first = reader->next_read;
+  uint64_t last = base + reader->depth;
+  uint64_t end = (reader->size + reader->chunk_size - 1) / reader->chunk_size;
+  if (last > end) {
+    last = end;
+  }
+  if (first >= last) {
+    return;
+  }
+
+  if (reader->backend == BL_READ_POOL) {
+    pthread_mutex_lock(&reader->lock);
+  }
+  for (uint64_t k = first; k < last; k++) {
+    struct bl_chunk *chunk = &reader->chunks[k % reader->depth];
+    chunk->off = k * reader->chunk_size;
+    chunk->len = IN_FLIGHT;
+    if (reader->backend == BL_READ_URING) {
+      uring_queue(reader, k);
+    }
+  }
+  reader->next_read = last;
+  if (reader->backend == BL_READ_POOL) {
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->lock);
+  } else {
+    uring_submit(reader, last - first);
+  }
+}
+
+// Helper function that waits for chunk k (which must have been started) to be
+// read. Returns the chunk, or NULL on a read error.
+static struct bl_chunk *wait_chunk(bl_reader_t *reader, uint64_t k) {
+  struct bl_chunk *chunk = &reader->chunks[k % reader->depth];
+  if (reader->backend == BL_READ_POOL) {
+    pthread_mutex_lock(&reader->lock);
+    while (chunk->len == IN_FLIGHT) {
+      pthread_cond_wait(&reader->cond, &reader->lock);
+    }
+    pthread_mutex_unlock(&reader->lock);
+  } else {
+    while (chunk->len == IN_FLIGHT && !reader->error) {
+      uring_wait(reader);
+    }
+  }
+  if (chunk->len < 0 || reader->error) {
+    DEBUG_PRINT("read of chunk %lu failed (%ld)\n", k, chunk->len);
+    reader->error = 1;
+    return NULL;
+  }
+  return chunk;
+}
+
+// Helper function that copies len bytes at file offset off into dst. If
+// recycle is set, chunks are reused for later reads as soon as they are
+// copied. Returns 0, or -1 if the bytes are past the end of the file or could
+// not be read.
+static int copy_out(bl_reader_t *reader, uint64_t off, uint64_t len, char *dst,
+                    int recycle) {
+  while (len) {
+    uint64_t k = off / reader->chunk_size;
+    uint64_t in = off % reader->chunk_size;
+    refill(reader, recycle ? k : reader->pos / reader->chunk_size);
+    if (k >= reader->next_read) {
+      // past the end of the file.
+      return -1;
+    }
+    struct bl_chunk *chunk = wait_chunk(reader, k);
+    if (!chunk || chunk->len <= in) {
+      return -1;
+    }
+    uint64_t n = chunk->len - in < len ? chunk->len - in : len;
+    memcpy(dst, chunk->buf + in, n);
+    dst += n;
+    off += n;
+    len -= n;
+  }
+  return 0;
+}
+
+int bl_reader_open(const char *fname, size_t chunk_size, int depth,
+                   enum bl_read_backend backend, bl_reader_t *reader) {
+  assert(reader);
+  memset(reader, 0, sizeof(*reader));
+  size_t page = sysconf(_SC_PAGESIZE);
+  chunk_size = chunk_size ? chunk_size : BL_READ_CHUNK;
+  reader->chunk_size = (chunk_size + page - 1) / page * page;
+  reader->depth = depth ? depth : BL_READ_DEPTH;
+  // a header, the chunk holding a block's data and its footer may all be in
+  // different chunks.
+  assert(reader->depth >= 4);
+
+  char *tpath = malloc(strlen(fname) + 5);
+  strcpy(tpath, fname);
+  strcat(tpath, ".ll");
+  DEBUG_PRINT("opening %s for async reading\n", tpath);
+  reader->fd = open(tpath, O_RDONLY);
+  free(tpath);
+  if (reader->fd < 0) {
+    return -1;
+  }
+  struct stat stat;
+  assert(!fstat(reader->fd, &stat));
+  reader->size = stat.st_size;
+  posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  if (backend != BL_READ_POOL && !uring_setup(&reader->ring, reader->depth)) {
+    reader->backend = BL_READ_URING;
+  } else if (backend != BL_READ_URING) {
+    reader->backend = BL_READ_POOL;
+  } else {
+    close(reader->fd);
+    return -1;
+  }
+
+  char *bufs = NULL;
+  assert(!posix_memalign((void **)&bufs, page,
+                         reader->depth * reader->chunk_size));
+  reader->chunks = calloc(reader->depth, sizeof(struct bl_chunk));
+  for (int i = 0; i < reader->depth; i++) {
+    struct bl_chunk *chunk = &reader->chunks[i];
+    chunk->buf = bufs + i * reader->chunk_size;
+    chunk->iov.iov_base = chunk->buf;
+    chunk->iov.iov_len = reader->chunk_size;
+  }
+
+  if (reader->backend == BL_READ_POOL) {
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->cond, NULL);
+    reader->threads = malloc(BL_READ_THREADS * sizeof(pthread_t));
+    for (int t = 0; t < BL_READ_THREADS; t++) {
+      pthread_create(&reader->threads[t], NULL, pool_run, reader);
+    }
+  }
+  DEBUG_PRINT("reading with %s\n",
+              reader->backend == BL_READ_URING ? "io_uring" : "pread threads");
+
+  // the first block follows the 8 byte head.
+  reader->pos = 2 * sizeof(uint32_t);
+  refill(reader, 0);
+  return 0;
+}
+
+char *bl_reader_next(uint32_t *block_size, bl_reader_t *reader) {
+  *block_size = 0;
+  if (reader->error) {
+    return NULL;
+  }
+  uint64_t pos = reader->pos;
+  uint32_t size = 0;
+  if (copy_out(reader, pos, sizeof(uint32_t), (char *)&size, 0) || !size) {
+    // end of file, or tail.
+    return NULL;
+  }
+
+  // the data is returned in place if it is within one chunk, and copied
+  // otherwise.
+  uint64_t off = pos + sizeof(uint32_t);
+  uint64_t k = off / reader->chunk_size;
+  uint64_t in = off % reader->chunk_size;
+  char *data = NULL;
+  if (in + size <= reader->chunk_size) {
+    refill(reader, pos / reader->chunk_size);
+    struct bl_chunk *chunk = NULL;
+    if (k < reader->next_read) {
+      chunk = wait_chunk(reader, k);
+    }
+    data = chunk && chunk->len >= in + size ? chunk->buf + in : NULL;
+  } else {
+    if (reader->spill_size < size) {
+      reader->spill = realloc(reader->spill, size);
+      reader->spill_size = size;
+    }
+    data = copy_out(reader, off, size, reader->spill, 1) ? NULL : reader->spill;
+  }
+
+  uint32_t footer = 0;
+  if (!data ||
+      copy_out(reader, off + size, sizeof(uint32_t), (char *)&footer, 0) ||
+      footer != size) {
+    DEBUG_PRINT("invalid block at offset %lu\n", pos);
+    reader->error = 1;
+    return NULL;
+  }
+
+  reader->last = off;
+  reader->pos = off + size + sizeof(uint32_t);
+  *block_size = size;
+  return data;
+}
+
+uint64_t bl_reader_offset(bl_reader_t *reader) { return reader->last; }
+
+void bl_reader_close(bl_reader_t *reader) {
+  if (reader->backend == BL_READ_POOL) {
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->lock);
+    for (int t = 0; t < BL_READ_THREADS; t++) {
+      pthread_join(reader->threads[t], NULL);
+    }
+    free(reader->threads);
+    pthread_cond_destroy(&reader->cond);
+    pthread_mutex_destroy(&reader->lock);
+  } else {
+    // reads still in flight write to the buffers; wait for them.
+    for (int i = 0; i < reader->depth && !reader->error; i++) {
+      while (reader->chunks[i].len == IN_FLIGHT && !reader->error) {
+        uring_wait(reader);
+      }
+    }
+    uring_close(&reader->ring);
+  }
+  free(reader->chunks[0].buf);
+  free(reader->chunks);
+  free(reader->spill);
+  close(reader->fd);
+}
@@ -0,0 +1,126 @@
+#ifndef __BLOCK_LIST_READER_H__
+#define __BLOCK_LIST_READER_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+typedef struct bl_reader_t bl_reader_t;
+
+// ------------------------------------
+// asynchronous block list reading
+// ------------------------------------
+//
+// Reading a cold list through its mapping stalls on a page fault each time a
+// block is on a page that is not in memory yet. A reader instead reads the
+// list's file front to back in chunks, with several chunk reads in flight
+// ahead of the block being returned, so that I/O overlaps with processing the
+// blocks.
+//
+// Typical usage:
+//
+//    bl_reader_t reader;
+//    bl_reader_open(filename, 0, 0, BL_READ_AUTO, &reader);
+//    uint32_t cur_size = 0;
+//    char *cur_block = bl_reader_next(&cur_size, &reader);
+//    while (cur_block) {
+//      // process block
+//      cur_block = bl_reader_next(&cur_size, &reader);
+//    }
+//    bl_reader_close(&reader);
+//
+// Reads are issued through io_uring (with raw system calls), or, if io_uring
+// is not available, by a small pool of threads calling pread. Either way,
+// depth chunks of chunk_size bytes are being read or have been read ahead of
+// the current block; when a chunk has been consumed, its buffer is reused for
+// the read depth chunks further on.
+//
+// A returned block is a pointer into a chunk buffer (or, for blocks that span
+// chunks, a copy) and is valid until the next call to bl_reader_next. Its
+// position in the list is given by bl_reader_offset, so that the same block
+// can be found in a mapping of the list (whose pages the reads have brought
+// into the page cache).
+//
+// Readers stop at the list's tail, when its end is read, or on a read error or
+// invalid block (see error).
+
+// Default chunk size and number of chunks read ahead.
+#define BL_READ_CHUNK ((size_t)1 << 20)
+#define BL_READ_DEPTH 8
+// Number of threads of the pread fallback.
+#define BL_READ_THREADS 4
+
+// how reads are issued.
+enum bl_read_backend {
+  BL_READ_AUTO,  // io_uring if available, else a pread thread pool
+  BL_READ_URING, // io_uring only
+  BL_READ_POOL,  // pread thread pool only
+};
+
+// io_uring submission and completion rings.
+struct bl_uring {
+  int fd;                // io_uring file descriptor
+  void *sq_ring;         // mapped submission ring
+  size_t sq_ring_size;   // its size
+  void *cq_ring;         // mapped completion ring (may be sq_ring)
+  size_t cq_ring_size;   // its size
+  void *sqes;            // mapped submission entries
+  size_t sqes_size;      // their size
+  unsigned *sq_tail;     // submission ring tail
+  unsigned *sq_mask;     // submission ring index mask
+  unsigned *sq_array;    // submission ring entries (sqe indices)
+  unsigned *cq_head;     // completion ring head
+  unsigned *cq_tail;     // completion ring tail
+  unsigned *cq_mask;     // completion ring index mask
+  void *cqes;            // completion entries
+};
+
+// one chunk buffer
+struct bl_chunk {
+  char *buf;         // chunk data
+  uint64_t off;      // file offset of the chunk
+  int64_t len;       // bytes read (INT64_MIN while in flight, -errno on error)
+  struct iovec iov;  // io_uring read target
+};
+
+// reader struct
+struct bl_reader_t {
+  int fd;                   // list file
+  uint64_t size;            // size of the list file
+  size_t chunk_size;        // size of each chunk
+  int depth;                // number of chunks
+  struct bl_chunk *chunks;  // chunk i of the file is in chunks[i % depth]
+  uint64_t next_read;       // index of the next chunk to read
+  uint64_t pos;             // file offset of the next block's header
+  uint64_t last;            // file offset of the last returned block
+  char *spill;              // copy of a block that spans chunks
+  size_t spill_size;        // allocated size of spill
+  int backend;              // BL_READ_URING or BL_READ_POOL
+  int error;                // nonzero after a read error or invalid block
+  struct bl_uring ring;     // io_uring state
+  pthread_t *threads;       // pread threads
+  pthread_mutex_t lock;     // protects the chunk lengths and queue
+  pthread_cond_t cond;      // signals queued reads and completions
+  uint64_t queued;          // index of the next chunk for the pool to read
+  int stop;                 // tells the pool threads to exit
+};
+
+// Open the list fname for asynchronous reading. chunk_size and depth default
+// to BL_READ_CHUNK and BL_READ_DEPTH if 0. Returns 0, or -1 if the list could
+// not be opened or the requested backend is not available.
+int bl_reader_open(const char *fname, size_t chunk_size, int depth,
+                   enum bl_read_backend backend, bl_reader_t *reader);
+
+// Return the next block (setting block_size to its size), or NULL at the end
+// of the list.
+char *bl_reader_next(uint32_t *block_size, bl_reader_t *reader);
+
+// Return the offset, from the start of the list, of the last returned block
+// (of its data, as bl_next returns).
+uint64_t bl_reader_offset(bl_reader_t *reader);
+
+// Close a reader.
+void bl_reader_close(bl_reader_t *reader);
+
+#endif
@@ -0,0 +1,320 @@
+#include "block_list_repl.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "block_list_export.h"
+#include "util.h"
+
+// Helper function to return the current time in nanoseconds.
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Helper function that fills in the address of the socket at path. Returns 0,
+// or -1 if path is too long.
+static int sock_addr(const char *path, struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    return -1;
+  }
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+// Helper function that writes all len bytes of buf to fd. Returns 0 on success.
+static int write_all(int fd, const void *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = send(fd, buf + done, len - done, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    done += n;
+  }
+  return 0;
+}
+
+// Helper function that reads len bytes from fd into buf. Returns 1 on success,
+// 0 if fd was closed before any byte was read, or -1 on error.
+static int read_all(int fd, void *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = read(fd, buf + done, len - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return n == 0 && done == 0 ? 0 : -1;
+    }
+    done += n;
+  }
+  return 1;
+}
+
+int bl_repl_listen(const char *path) {
+  struct sockaddr_un addr;
+  if (sock_addr(path, &addr)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 1)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Helper function that finds the block of lst ending at offset off (within the
+// published tail), for the leader to resume after. Returns 0 and sets *last to
+// the block (NULL if off is the head), or -1 if there is no such block or it is
+// not size bytes.
+static int find_block(block_list_t *lst, bl_follow_t *follow, uint64_t off,
+                      uint32_t size, char **last) {
+  uint64_t tail = __atomic_load_n(&follow->page->tail, __ATOMIC_ACQUIRE);
+  *last = NULL;
+  if (off == 2 * sizeof(uint32_t)) {
+    return size == 0 ? 0 : -1;
+  }
+  uint32_t cur_size = 0;
+  char *cur = NULL;
+  while (1) {
+    // the next header follows the current block's footer.
+    uint64_t hdr = cur ? (cur - (char *)lst->start) + cur_size +
+                             sizeof(uint32_t)
+                       : 2 * sizeof(uint32_t);
+    if (hdr >= tail || hdr > off) {
+      return -1;
+    }
+    cur = bl_next(cur, &cur_size, lst);
+    if (!cur) {
+      return -1;
+    }
+    uint64_t end = (cur - (char *)lst->start) + cur_size + sizeof(uint32_t);
+    if (end == off) {
+      *last = cur;
+      return cur_size == size ? 0 : -1;
+    }
+  }
+}
+
+int bl_leader_accept(int listen_fd, block_list_t *lst, bl_follow_t *follow,
+                     bl_leader_t *leader) {
+  assert(leader);
+  memset(leader, 0, sizeof(*leader));
+  leader->lst = lst;
+  leader->fd = accept(listen_fd, NULL, NULL);
+  if (leader->fd < 0) {
+    return -1;
+  }
+
+  // the follower starts by telling us where its replica ends.
+  struct bl_repl_msg hello;
+  char *last;
+  if (read_all(leader->fd, &hello, sizeof(hello)) != 1 ||
+      strncmp(hello.hdr, "BLRH", 4) ||
+      find_block(lst, follow, hello.off, hello.size, &last)) {
+    DEBUG_PRINT("follower's replica does not match\n");
+    close(leader->fd);
+    leader->fd = -1;
+    return -1;
+  }
+  DEBUG_PRINT("follower resumes at offset %lu\n", hello.off);
+  bl_cursor_init(&leader->cursor, lst, follow, last);
+  leader->sent = hello.off;
+  leader->acked = hello.off;
+  return 0;
+}
+
+// Helper function that handles a complete acknowledgement.
+static void acked(bl_leader_t *leader) {
+  leader->ack_got = 0;
+  if (strncmp(leader->ack.hdr, "BLRA", 4) || leader->ack.off > leader->sent) {
+    DEBUG_PRINT("ignoring invalid acknowledgement\n");
+    return;
+  }
+  leader->acked = leader->ack.off;
+
+  // measure the lag of every message this acknowledges.
+  uint64_t now = now_ns();
+  while (leader->inflight_len &&
+         leader->inflight_end[leader->inflight_head] <= leader->acked) {
+    uint64_t lag = now - leader->inflight_ns[leader->inflight_head];
+    leader->lag_total_ns += lag;
+    leader->lag_count++;
+    if (lag > leader->lag_max_ns) {
+      leader->lag_max_ns = lag;
+    }
+    leader->inflight_head = (leader->inflight_head + 1) % BL_REPL_INFLIGHT;
+    leader->inflight_len--;
+  }
+}
+
+// Helper function that receives acknowledgements; if wait is set, until the
+// follower closes the connection, otherwise only those already received.
+// Returns 0, or -1 if the connection is closed.
+static int read_acks(bl_leader_t *leader, int wait) {
+  while (1) {
+    ssize_t n = recv(leader->fd, (char *)&leader->ack + leader->ack_got,
+                     sizeof(leader->ack) - leader->ack_got,
+                     wait ? 0 : MSG_DONTWAIT);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return 0;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    leader->ack_got += n;
+    if (leader->ack_got == sizeof(leader->ack)) {
+      acked(leader);
+    }
+  }
+}
+
+int64_t bl_leader_ship(bl_leader_t *leader, int timeout_ms) {
+  // everything published since the last message goes in this one. While
+  // messages are unacknowledged, wait in 1 ms steps so that acknowledgements
+  // are collected (and their lag measured) promptly.
+  int n = 0;
+  while (!n) {
+    int wait = timeout_ms;
+    if (leader->inflight_len && (wait < 0 || wait > 1)) {
+      wait = 1;
+    }
+    n = bl_follow(&leader->cursor, leader->blocks, leader->sizes,
+                  BL_REPL_BATCH, wait);
+    if (!n && read_acks(leader, 0)) {
+      return -1;
+    }
+    if (!n && wait == timeout_ms) {
+      return 0;
+    }
+    if (timeout_ms > 0) {
+      timeout_ms -= wait;
+    }
+  }
+
+  struct bl_repl_msg msg;
+  memcpy(msg.hdr, "BLRD", 4);
+  msg.size = 0;
+  bl_range(leader->blocks[0], leader->blocks[n - 1], leader->lst, &msg.off,
+           &msg.len);
+  assert(msg.off == leader->sent);
+  if (write_all(leader->fd, &msg, sizeof(msg)) ||
+      bl_export(msg.off, msg.len, leader->fd, leader->lst) < 0) {
+    DEBUG_PRINT("follower is gone\n");
+    return -1;
+  }
+  leader->sent = msg.off + msg.len;
+  leader->messages++;
+
+  if (leader->inflight_len < BL_REPL_INFLIGHT) {
+    uint32_t i =
+        (leader->inflight_head + leader->inflight_len) % BL_REPL_INFLIGHT;
+    leader->inflight_end[i] = leader->sent;
+    leader->inflight_ns[i] = now_ns();
+    leader->inflight_len++;
+  }
+
+  if (read_acks(leader, 0)) {
+    return -1;
+  }
+  return msg.len;
+}
+
+void bl_leader_close(bl_leader_t *leader) {
+  if (leader->fd < 0) {
+    return;
+  }
+  // the follower acknowledges what it still has to apply, then sees the end of
+  // the stream and closes its side.
+  shutdown(leader->fd, SHUT_WR);
+  read_acks(leader, 1);
+  close(leader->fd);
+  leader->fd = -1;
+}
+
+int bl_replica_connect(const char *path, block_list_t *lst,
+                       bl_replica_t *replica) {
+  assert(replica);
+  replica->lst = lst;
+  struct sockaddr_un addr;
+  if (sock_addr(path, &addr)) {
+    return -1;
+  }
+  replica->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (replica->fd < 0) {
+    return -1;
+  }
+  if (connect(replica->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    close(replica->fd);
+    replica->fd = -1;
+    return -1;
+  }
+
+  // tell the leader where the replica ends.
+  struct bl_repl_msg hello;
+  memcpy(hello.hdr, "BLRH", 4);
+  init_tail(lst);
+  bl_prev(NULL, &hello.size, lst);
+  hello.off = lst->tail - lst->start;
+  hello.len = 0;
+  replica->applied = hello.off;
+  if (write_all(replica->fd, &hello, sizeof(hello))) {
+    close(replica->fd);
+    replica->fd = -1;
+    return -1;
+  }
+  return 0;
+}
+
+int64_t bl_replica_apply(bl_replica_t *replica) {
+  struct bl_repl_msg msg;
+  int got = read_all(replica->fd, &msg, sizeof(msg));
+  if (got <= 0) {
+    return got;
+  }
+  if (strncmp(msg.hdr, "BLRD", 4) || msg.off != replica->applied) {
+    DEBUG_PRINT("unexpected range at offset %lu\n", msg.off);
+    return -1;
+  }
+  if (!bl_import(replica->fd, msg.len, replica->lst)) {
+    DEBUG_PRINT("invalid range at offset %lu\n", msg.off);
+    return -1;
+  }
+  replica->applied = msg.off + msg.len;
+
+  struct bl_repl_msg ack;
+  memcpy(ack.hdr, "BLRA", 4);
+  ack.size = 0;
+  ack.off = replica->applied;
+  ack.len = 0;
+  if (write_all(replica->fd, &ack, sizeof(ack))) {
+    return -1;
+  }
+  return replica->applied;
+}
+
+void bl_replica_close(bl_replica_t *replica) {
+  if (replica->fd >= 0) {
+    close(replica->fd);
+    replica->fd = -1;
+  }
+}
@@ -0,0 +1,140 @@
+#ifndef __BLOCK_LIST_REPL_H__
+#define __BLOCK_LIST_REPL_H__
+
+#include <stdint.h>
+
+#include "block_list.h"
+#include "block_list_follow.h"
+
+typedef struct bl_leader_t bl_leader_t;
+typedef struct bl_replica_t bl_replica_t;
+
+// ------------------------------------
+// block list replication over a socket
+// ------------------------------------
+//
+// A leader ships the blocks appended to a list over a Unix domain socket to a
+// follower, which appends them to its own copy of the list (a replica) and
+// reports back how far it has applied. The leader follows the list's appends
+// through its follow page (see block_list_follow.h), so it may run in the
+// writer's process or in any other.
+//
+// Typical usage:
+//
+//    // leader
+//    bl_open(filename, 0, &list);
+//    bl_follow_open(filename, &follow);
+//    int sock = bl_repl_listen("/tmp/log.sock");
+//    bl_leader_accept(sock, &list, &follow, &leader);
+//    while (bl_leader_ship(&leader, timeout_ms) >= 0) {
+//      // leader.sent - leader.acked bytes are in flight
+//    }
+//    bl_leader_close(&leader);
+//
+//    // follower
+//    bl_open(replica_filename, size, &replica_list);
+//    bl_replica_connect("/tmp/log.sock", &replica_list, &replica);
+//    while (bl_replica_apply(&replica) > 0) {
+//      // replica.applied bytes of the list are applied
+//    }
+//    bl_replica_close(&replica);
+//
+// Since blocks are stored contiguously, a replica's blocks sit at the same
+// offsets as the leader's, and every message names a range by its offsets:
+//
+// | hdr | size | off | len |
+//
+//   BLRH  follower -> leader, on connect: the replica's tail is at off, and its
+//         last block is size bytes (0 if it is empty). The leader resumes from
+//         there, or closes the connection if its own list has no block of that
+//         size ending at off.
+//   BLRD  leader -> follower: the next len bytes on the socket are the blocks
+//         at off (written with bl_export).
+//   BLRA  follower -> leader: the replica's tail is now at off.
+//
+// Each BLRD carries every block published since the last one (up to
+// BL_REPL_BATCH blocks), and the leader does not wait for acknowledgements
+// before shipping the next, so under load many appends share one message and
+// the socket stays full. Ranges are applied with bl_import, which validates
+// them before they become visible; a replica that receives an invalid or
+// out-of-order range stops, and can reconnect to resume from its tail.
+//
+// The leader measures, for every range, the time from shipping it until it is
+// acknowledged (see lag_max_ns).
+//
+// Writes to a closed socket raise SIGPIPE, which callers should ignore.
+
+// Maximum number of blocks shipped in one message.
+#define BL_REPL_BATCH 1024
+// Number of unacknowledged messages whose lag is measured.
+#define BL_REPL_INFLIGHT 256
+
+// message header
+struct bl_repl_msg {
+  char hdr[4];   // header chars
+  uint32_t size; // size of the last block (BLRH only)
+  uint64_t off;  // offset of the range or tail
+  uint64_t len;  // length of the range (BLRD only)
+};
+
+// leader struct
+struct bl_leader_t {
+  int fd;                 // socket connected to the follower
+  block_list_t *lst;      // list being shipped
+  bl_cursor_t cursor;     // last block shipped
+  uint64_t sent;          // offset up to which blocks were shipped
+  uint64_t acked;         // offset up to which the follower applied them
+  struct bl_repl_msg ack; // partially received acknowledgement
+  uint32_t ack_got;       // bytes of ack received
+  char *blocks[BL_REPL_BATCH];
+  uint32_t sizes[BL_REPL_BATCH];
+  uint64_t inflight_end[BL_REPL_INFLIGHT]; // end offsets of unacked messages
+  uint64_t inflight_ns[BL_REPL_INFLIGHT];  // and when they were shipped
+  uint32_t inflight_head;                  // oldest unacked message
+  uint32_t inflight_len;                   // number of unacked messages
+  uint64_t messages;                       // number of messages shipped
+  uint64_t lag_max_ns;   // longest time from shipping to acknowledgement
+  uint64_t lag_total_ns; // total of those times
+  uint64_t lag_count;    // number of times measured
+};
+
+// replica struct
+struct bl_replica_t {
+  int fd;            // socket connected to the leader
+  block_list_t *lst; // replica list
+  uint64_t applied;  // offset of the replica's tail
+};
+
+// Listen for followers on the Unix domain socket at path (replacing any stale
+// socket file). Returns the listening socket, or -1 on error.
+int bl_repl_listen(const char *path);
+
+// Accept a follower on a socket returned by bl_repl_listen, and prepare to ship
+// it the blocks of lst, which are published through follow. Returns 0, or -1
+// if the connection failed or the follower's replica does not match lst.
+int bl_leader_accept(int listen_fd, block_list_t *lst, bl_follow_t *follow,
+                     bl_leader_t *leader);
+
+// Wait up to timeout_ms milliseconds (forever if negative) for new blocks, ship
+// them in one message, and collect any acknowledgements. Returns the number of
+// bytes shipped (0 on timeout), or -1 if the follower is gone.
+int64_t bl_leader_ship(bl_leader_t *leader, int timeout_ms);
+
+// Tell the follower that nothing more will be shipped, wait for the remaining
+// acknowledgements, and close the connection.
+void bl_leader_close(bl_leader_t *leader);
+
+// Connect to a leader listening at path, to replicate into lst. Returns 0, or
+// -1 if the leader could not be reached.
+int bl_replica_connect(const char *path, block_list_t *lst,
+                       bl_replica_t *replica);
+
+// Receive and apply one range of blocks, and acknowledge it. Returns the new
+// applied offset, 0 if the leader closed the connection, or -1 if the range was
+// invalid or the connection failed (the replica is unchanged).
+int64_t bl_replica_apply(bl_replica_t *replica);
+
+// Close the connection to the leader.
+void bl_replica_close(bl_replica_t *replica);
+
+#endif
@@ -2,16 +2,56 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "dyn.h"
 
+#include "arena.h"
 #include "block_list.h"
+#include "block_list_reader.h"
+#include "boot_image.h"
 #include "disk_array.h"
+#include "log_sink.h"
 #include "strtable.h"
+#include "validate.h"
 
 struct boot_params paths;
 
+// the boot image, if booting from one.
+static boot_image_t image;
+static int use_image = 0;
+
+// scratch memory for the phases (see arena.h).
+static arena_t scratch;
+
+// Helper functions that open the databases, from the boot image if there is
+// one (in which case nothing is opened and closing does nothing).
+static void open_params(disk_array_t *params) {
+  if (use_image) {
+    boot_image_params(&image, params);
+  } else {
+    array_open(paths.params_path, 0, sizeof(uint64_t), params);
+  }
+}
+
+static void open_nav(strtable_t *nav_db) {
+  if (use_image) {
+    boot_image_nav(&image, nav_db);
+  } else {
+    strtable_open(paths.db_path, 0, nav_db);
+  }
+}
+
+static void open_log(block_list_t *flight_log) {
+  if (use_image) {
+    // the image has the tail offset, so it need not be searched for.
+    boot_image_log(&image, flight_log);
+  } else {
+    bl_open(paths.log_path, 0, flight_log);
+  }
+}
+
 // PHASE ONE
 // Load neural network parameters from database that is stored as a
 // disk-backed array (disk_array_t in darray.h).
@@ -22,10 +62,10 @@ void load_params() {
   disk_array_t params; // neuron weights/biases, a disk array
 
   // Open disk array.
-  array_open(paths.params_path, 0, sizeof(uint64_t), &params);
+  open_params(&params);
 
   // Print memory mapped region base address.
-  printf(load_msg, params.mm_region.start);
+  LOG(LOG_INFO, load_msg, params.mm_region.start);
 
   // Cast as array type.
   uint64_t *arr = (uint64_t *)params.array;
@@ -36,8 +76,9 @@ void load_params() {
     item = arr[i];
     if (i % 100 == 0) {
       // print every 100 params
-      printf(load_item, item);
+      LOG(LOG_ITEM, load_item, item);
     }
+    LOG_PROGRESS("params", i + 1, *params.n);
   }
 
   // Close params database.
@@ -52,14 +93,14 @@ void load_db() {
 
   strtable_t nav_db; // the navigation database, a strtable
 
-  char *buff = NULL; // tmp buffer for string data
+  char *buff = NULL; // tmp buffer for string data (in scratch)
   char *tmp = NULL;  // pointer to current element
 
   // Open the string table.
-  strtable_open(paths.db_path, 0, &nav_db);
+  open_nav(&nav_db);
 
   // Print memory mapped region base address.
-  printf(load_msg, nav_db.mm_region.start);
+  LOG(LOG_INFO, load_msg, nav_db.mm_region.start);
 
   int el_len = 0;
   // Read 10% of table.
@@ -73,7 +114,14 @@ void load_db() {
     assert(el_len == strlen(tmp) + 1);
 
     // copy element so that we can mutate it safely.
-    buff = malloc(el_len);
+    size_t mark = arena_mark(&scratch);
+    buff = el_len > 0 ? arena_alloc(&scratch, el_len) : NULL;
+    if (!buff) {
+      // too large for the scratch arena (or a bad length); skip it.
+      LOG(LOG_WARN, "[    0.059550]     NAV[%d] cannot copy %d bytes\n", i,
+          el_len);
+      continue;
+    }
     strcpy(buff, tmp);
 
     // Format output -- find last occurrance of ';' in string and only print
@@ -84,9 +132,9 @@ void load_db() {
     assert(offset);
     //   Offset + 1 is the string "jkl"
     offset++;
-    printf(load_item, i, offset);
+    LOG(LOG_ITEM, load_item, i, offset);
 
-    free(buff);
+    arena_release(&scratch, mark);
   }
 
   // Close string table.
@@ -105,10 +153,34 @@ void validate_db() {
   char *cur = NULL;
 
   // Open the string table.
-  strtable_open(paths.db_path, 0, &nav_db);
+  open_nav(&nav_db);
 
   // Print memory mapped region base address.
-  printf(load_msg, nav_db.mm_region.start);
+  LOG(LOG_INFO, load_msg, nav_db.mm_region.start);
+
+  // Elements of a boot image were validated when it was made, and the image is
+  // only used if it is current (see boot); they are checked again only if a
+  // full validation finds that the nav section no longer matches its checksum.
+  int verified = use_image &&
+                 (!paths.full_validate || boot_image_verify(&image, "nav"));
+  if (use_image && !verified) {
+    LOG_STR(LOG_WARN, "\n[    0.620017] NAV: image checksum mismatch");
+  }
+
+  // Otherwise, if watermarks are kept, elements below the watermark were
+  // validated on an earlier boot (see validate.h), and only those added since
+  // are checked.
+  int watermark = !use_image && paths.incremental_validate;
+  struct val_mark mark;
+  uint32_t from = 0;
+  if (watermark) {
+    int mismatch = 0;
+    val_load(paths.db_path, &mark);
+    from = val_table_start(&mark, &nav_db, paths.full_validate, &mismatch);
+    if (mismatch) {
+      LOG_STR(LOG_WARN, "\n[    0.620017] NAV: validated elements changed");
+    }
+  }
 
   // Read each element.
   int print_every = 32;
@@ -116,16 +188,27 @@ void validate_db() {
   for (int i = 0; i < len; i++) {
     if (i % print_every == 0) {
       // put a new line periodically
-      printf(load_item, i);
+      LOG(LOG_ITEM, load_item, i);
     }
-    // Read element.
-    el_len = get_element_len(&nav_db, i);
-    cur = get_element(&nav_db, i);
-    // "Validate" element; grab first char.
-    assert(el_len == strlen(cur) + 1);
-    printf(".");
+    if (!verified && i >= from) {
+      // Read element.
+      el_len = get_element_len(&nav_db, i);
+      cur = get_element(&nav_db, i);
+      // "Validate" element; grab first char.
+      assert(el_len == strlen(cur) + 1);
+      // the watermark stops at the first invalid element.
+      if (watermark && mark.count == i && el_len == strlen(cur) + 1) {
+        val_table_extend(&mark, &nav_db, i);
+      }
+    }
+    LOG_STR(LOG_ITEM, ".");
+    LOG_PROGRESS("nav", i + 1, len);
+  }
+  LOG_STR(LOG_INFO, "\n");
+
+  if (watermark) {
+    val_save(paths.db_path, &mark);
   }
-  printf("\n");
 
   // Close string table.
   strtable_close(&nav_db);
@@ -141,8 +224,30 @@ void load_log() {
   block_list_t flight_log; // the flight log, a block list
 
   // Open log and print memory mapped region base address.
-  bl_open(paths.log_path, 0, &flight_log);
-  printf(load_msg, flight_log.mm_region.start);
+  open_log(&flight_log);
+  LOG(LOG_INFO, load_msg, flight_log.mm_region.start);
+
+  // If watermarks are kept, check the blocks appended since the last boot (see
+  // validate.h); a boot image's log was checked when it was made, and is only
+  // checked against its checksum by a full validation.
+  if (use_image && paths.full_validate &&
+      !boot_image_verify(&image, "log")) {
+    LOG_STR(LOG_WARN, "[    0.990733] HISTORY: image checksum mismatch\n");
+  }
+  if (!use_image && paths.incremental_validate) {
+    struct val_mark mark;
+    int mismatch = 0;
+    val_load(paths.log_path, &mark);
+    int err = val_list(&mark, &flight_log, paths.full_validate, &mismatch);
+    if (mismatch) {
+      LOG_STR(LOG_WARN, "[    0.990733] HISTORY: validated blocks changed\n");
+    }
+    if (err) {
+      LOG(LOG_WARN, "[    0.990733] HISTORY: invalid block at offset %lu\n",
+          mark.end);
+    }
+    val_save(paths.log_path, &mark);
+  }
 
   // Seek to last entry by using bl_prev to get the last element.
   // NOTE:
@@ -150,7 +255,7 @@ void load_log() {
   //  entire list from the head in order to find the tail.
   uint32_t cur_size = 0;
   char *last = bl_prev(NULL, &cur_size, &flight_log);
-  printf(load_last, last);
+  LOG(LOG_INFO, load_last, last);
 
   // Close list
   bl_close(&flight_log);
@@ -165,30 +270,48 @@ void renav_log() {
   block_list_t flight_log; // the flight log, a block list
 
   // Open log and print memory mapped region base address.
-  bl_open(paths.log_path, 0, &flight_log);
-  printf(load_msg, flight_log.mm_region.start);
+  open_log(&flight_log);
+  LOG(LOG_INFO, load_msg, flight_log.mm_region.start);
 
   // Seek to last entry by reading each element of the log in order.
   // NOTE:
   //   This does *not* initialize the tail pointer, since we are reading in
   //   order to find the last element.
   uint32_t cur_size = 0;
-  char *cur = bl_next(NULL, &cur_size, &flight_log);
-  char *next = bl_next(cur, &cur_size, &flight_log);
-  printf(load_item, cur);
-  while (next) {
-    cur = next;
-    printf(load_item, cur);
-    next = bl_next(cur, &cur_size, &flight_log);
+  char *cur = NULL;
+  bl_reader_t reader;
+  if (paths.async_log && !use_image &&
+      !bl_reader_open(paths.log_path, 0, 0, BL_READ_AUTO, &reader)) {
+    // read the log ahead of the replay rather than faulting it in page by
+    // page; the last block is then found in the mapping for the reverse pass.
+    char *block = bl_reader_next(&cur_size, &reader);
+    LOG(LOG_ITEM, load_item, block);
+    while (block) {
+      cur = flight_log.start + bl_reader_offset(&reader);
+      block = bl_reader_next(&cur_size, &reader);
+      if (block) {
+        LOG(LOG_ITEM, load_item, block);
+      }
+    }
+    bl_reader_close(&reader);
+  } else {
+    cur = bl_next(NULL, &cur_size, &flight_log);
+    char *next = bl_next(cur, &cur_size, &flight_log);
+    LOG(LOG_ITEM, load_item, cur);
+    while (next) {
+      cur = next;
+      LOG(LOG_ITEM, load_item, cur);
+      next = bl_next(cur, &cur_size, &flight_log);
+    }
   }
 
-  printf("[    1.003915] HISTORY: reverse replay\n");
+  LOG_STR(LOG_INFO, "[    1.003915] HISTORY: reverse replay\n");
 
   // Now navigate the list in reverse, starting from where we are now.
   char *prev = bl_prev(cur, &cur_size, &flight_log);
   while (prev) {
     cur = prev;
-    printf(load_item, cur);
+    LOG(LOG_ITEM, load_item, cur);
     prev = bl_prev(cur, &cur_size, &flight_log);
   }
 
@@ -199,17 +322,49 @@ void renav_log() {
 void io(int do_io, int skip) {
   static int c = -1;
   c++;
+  // a phase just ended; write out its output (the phase library writes
+  // through stdio, so this also keeps its output in order with ours).
+  log_flush();
   if (do_io && (!skip || c > 0)) {
     call(c, paths.dynlib_path);
+    fflush(stdout);
   }
 }
 
+// Helper function that pins the mapping of the file path + ext (see mm_pin).
+static int pin(const char *path, const char *ext, mm_region_t *region) {
+  char *tpath = malloc(strlen(path) + strlen(ext) + 1);
+  strcpy(tpath, path);
+  strcat(tpath, ext);
+  int err = mm_pin(tpath, region);
+  free(tpath);
+  return err;
+}
+
 // Execute boot sequence.
 void boot(struct boot_params boot_params, int quiet) {
   int do_io = !(quiet & QUIET_SKIP_IO);
   int skip = (quiet & QUIET_SKIP_INTRO);
   paths = boot_params;
 
+  // map the boot image (all three databases) once, if there is one.
+  if (paths.image_path) {
+    use_image = !boot_image_open(paths.image_path, &image);
+    if (!use_image) {
+      LOG(LOG_WARN, "[    0.000000] invalid boot image %s; using db files\n",
+          paths.image_path);
+    } else if (!boot_image_current(&image, paths.params_path, paths.db_path,
+                                   paths.log_path)) {
+      LOG(LOG_WARN, "[    0.000000] boot image %s is out of date; using db "
+                    "files\n",
+          paths.image_path);
+      boot_image_close(&image);
+      use_image = 0;
+    }
+  }
+
+  arena_volatile(0, &scratch);
+
   io(do_io, skip);
   io(do_io, skip);
 
@@ -217,6 +372,12 @@ void boot(struct boot_params boot_params, int quiet) {
   load_params();
   io(do_io, skip);
 
+  // Keep the nav db mapped while the phases that use it run, so that each
+  // phase's strtable_open reuses the same mapping (see mm_util.h). (A boot
+  // image stays mapped anyway.)
+  mm_region_t nav_pin;
+  int nav_pinned = !use_image && !pin(paths.db_path, ".stb", &nav_pin);
+
   // Load nav db
   load_db();
   io(do_io, skip);
@@ -225,6 +386,14 @@ void boot(struct boot_params boot_params, int quiet) {
   validate_db();
   io(do_io, skip);
 
+  if (nav_pinned) {
+    mm_close(&nav_pin);
+  }
+
+  // Likewise for the flight log.
+  mm_region_t log_pin;
+  int log_pinned = !use_image && !pin(paths.log_path, ".ll", &log_pin);
+
   // Load flight log last entry
   load_log();
   io(do_io, skip);
@@ -232,4 +401,14 @@ void boot(struct boot_params boot_params, int quiet) {
   // Play and rewind log
   renav_log();
   io(do_io, skip);
+
+  if (log_pinned) {
+    mm_close(&log_pin);
+  }
+
+  if (use_image) {
+    boot_image_close(&image);
+    use_image = 0;
+  }
+  arena_close(&scratch);
 }
@@ -9,6 +9,10 @@ struct boot_params {
   char *params_path;
   char *db_path;
   char *log_path;
+  char *image_path;  // boot image (see boot_image.h) used instead, or NULL
+  int async_log;     // replay the log with a reader (see block_list_reader.h)
+  int full_validate; // recheck validated data too (see validate.h)
+  int incremental_validate; // keep validation watermarks (see validate.h)
 };
 
 void boot(struct boot_params params, int quiet);
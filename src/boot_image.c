@@ -0,0 +1,292 @@
+#include "boot_image.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "util.h"
+
+// Helper macro that takes an address/pointer argument and dereferences it as a
+// pointer to an unsigned 32-bit integer.
+#define AS_INT(expr) *((uint32_t *)(expr))
+
+// section names, in image order, and the extensions of their database files.
+static const char *section_names[BOOT_IMAGE_SECTIONS] = {"params", "nav",
+                                                         "log"};
+static const char *section_exts[BOOT_IMAGE_SECTIONS] = {".arr", ".stb", ".ll"};
+
+// Helper function that returns fname with the ".img" extension (malloc'd).
+static char *img_path(const char *fname) {
+  char *tpath = malloc(strlen(fname) + 5);
+  strcpy(tpath, fname);
+  strcat(tpath, ".img");
+  return tpath;
+}
+
+// Helper function that returns the hash identifying the first len bytes of a
+// database file (at start): the FNV-1a hash of their first and last page.
+static uint64_t source_hash(const char *start, uint64_t len) {
+  uint64_t page = sysconf(_SC_PAGESIZE);
+  uint64_t part = len < page ? len : page;
+  uint64_t h = fnv1a(FNV_INIT, start, part);
+  return fnv1a(h, start + len - part, part);
+}
+
+// Helper function that reads the first and last page of the first len bytes
+// of the file path + ext, and returns their hash (as source_hash), or 0 (and
+// sets size to 0) if the file cannot be read.
+static uint64_t file_hash(const char *path, const char *ext, uint64_t len,
+                          uint64_t *size) {
+  char *tpath = malloc(strlen(path) + strlen(ext) + 1);
+  strcpy(tpath, path);
+  strcat(tpath, ext);
+  int fd = open(tpath, O_RDONLY);
+  free(tpath);
+
+  uint64_t h = 0;
+  *size = 0;
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) || st.st_size < len) {
+    goto out;
+  }
+  uint64_t page = sysconf(_SC_PAGESIZE);
+  uint64_t part = len < page ? len : page;
+  char *buf = malloc(2 * part);
+  if (pread(fd, buf, part, 0) == part &&
+      pread(fd, buf + part, part, len - part) == part) {
+    h = fnv1a(fnv1a(FNV_INIT, buf, part), buf + part, part);
+    *size = st.st_size;
+  }
+  free(buf);
+
+out:
+  if (fd != -1) {
+    close(fd);
+  }
+  return h;
+}
+
+// Helper function that checks that a params array's elements lie within its
+// file. Returns 0 if they do.
+static int check_params(disk_array_t *params) {
+  uint64_t room = params->mm_region.size - 2 * sizeof(uint64_t);
+  if (!*params->element_size || *params->n > room / *params->element_size) {
+    DEBUG_PRINT("%lu params of %lu bytes do not fit in %lu bytes\n",
+                *params->n, *params->element_size, room);
+    return -1;
+  }
+  return 0;
+}
+
+// Helper function that checks every element of a nav table. Returns 0 if they
+// are all valid strings within the table.
+static int check_nav(strtable_t *nav) {
+  char *start = nav->mm_region.start;
+  char *end = start + nav->mm_region.size;
+  uint32_t len = strtable_len(nav);
+  for (uint32_t i = 0; i < len; i++) {
+    char *el = get_element(nav, i);
+    int el_len = get_element_len(nav, i);
+    if (el_len <= 0 || el < start || el + el_len > end ||
+        strnlen(el, el_len) != el_len - 1) {
+      DEBUG_PRINT("invalid nav element %u\n", i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Helper function that checks every block of a log and finds its tail. Returns
+// the offset of the tail, or 0 if a block is invalid.
+static uint64_t check_log(block_list_t *log) {
+  char *start = log->start;
+  uint64_t size = log->mm_region.size;
+  // the first block follows the 8 byte head.
+  uint64_t pos = 2 * sizeof(uint32_t);
+  while (pos + 2 * sizeof(uint32_t) <= size && AS_INT(start + pos)) {
+    uint32_t block = AS_INT(start + pos);
+    if (pos + block + 2 * sizeof(uint32_t) > size ||
+        AS_INT(start + pos + sizeof(uint32_t) + block) != block) {
+      DEBUG_PRINT("invalid log block at offset %lu\n", pos);
+      return 0;
+    }
+    pos += block + 2 * sizeof(uint32_t);
+  }
+  if (pos + 2 * sizeof(uint32_t) > size) {
+    // no room for the tail block.
+    return 0;
+  }
+  return pos;
+}
+
+int boot_image_write(const char *params_path, const char *db_path,
+                     const char *log_path, const char *fname) {
+  disk_array_t params;
+  strtable_t nav;
+  block_list_t log;
+  array_open(params_path, 0, 0, &params);
+  strtable_open((char *)db_path, 0, &nav);
+  bl_open(log_path, 0, &log);
+
+  int err = check_params(&params) || check_nav(&nav);
+  uint64_t tail = err ? 0 : check_log(&log);
+  if (!tail) {
+    err = -1;
+  }
+
+  if (!err) {
+    // sections are copied whole, except the log, which ends after its tail.
+    void *contents[BOOT_IMAGE_SECTIONS] = {params.mm_region.start,
+                                           nav.mm_region.start, log.start};
+    uint64_t sizes[BOOT_IMAGE_SECTIONS] = {
+        params.mm_region.size, nav.mm_region.size,
+        tail + 2 * sizeof(uint32_t)};
+    uint64_t values[BOOT_IMAGE_SECTIONS] = {*params.n, strtable_len(&nav),
+                                            tail};
+    uint64_t src_sizes[BOOT_IMAGE_SECTIONS] = {
+        params.mm_region.size, nav.mm_region.size, log.mm_region.size};
+
+    // lay out the sections on page boundaries after the manifest.
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t offs[BOOT_IMAGE_SECTIONS];
+    uint64_t size = sizeof(struct boot_image_header) +
+                    BOOT_IMAGE_SECTIONS * sizeof(struct boot_image_section);
+    for (int i = 0; i < BOOT_IMAGE_SECTIONS; i++) {
+      offs[i] = (size + page - 1) / page * page;
+      size = offs[i] + sizes[i];
+    }
+
+    char *tpath = img_path(fname);
+    DEBUG_PRINT("writing %s (%lu bytes)\n", tpath, size);
+    // start from an empty file, so that the padding is zero.
+    unlink(tpath);
+    mm_region_t out;
+    mm_open(tpath, size, &out);
+    free(tpath);
+
+    struct boot_image_header *header = out.start;
+    struct boot_image_section *sections = out.start + sizeof(*header);
+    for (int i = 0; i < BOOT_IMAGE_SECTIONS; i++) {
+      memcpy(out.start + offs[i], contents[i], sizes[i]);
+      strncpy(sections[i].name, section_names[i], sizeof(sections[i].name));
+      sections[i].off = offs[i];
+      sections[i].size = sizes[i];
+      sections[i].checksum = fnv1a(FNV_INIT, contents[i], sizes[i]);
+      sections[i].value = values[i];
+      sections[i].src_size = src_sizes[i];
+      sections[i].src_hash = source_hash(contents[i], sizes[i]);
+    }
+    memcpy(header->hdr, "BIMG", 4);
+    header->version = BOOT_IMAGE_VERSION;
+    header->nsections = BOOT_IMAGE_SECTIONS;
+    header->size = size;
+    header->checksum =
+        fnv1a(FNV_INIT, sections,
+              BOOT_IMAGE_SECTIONS * sizeof(struct boot_image_section));
+    mm_close(&out);
+  }
+
+  array_close(&params);
+  strtable_close(&nav);
+  bl_close(&log);
+  return err;
+}
+
+int boot_image_open(const char *fname, boot_image_t *img) {
+  assert(img);
+  char *tpath = img_path(fname);
+  DEBUG_PRINT("opening %s\n", tpath);
+  if (access(tpath, R_OK)) {
+    free(tpath);
+    return -1;
+  }
+  mm_open_private(tpath, &img->mm_region);
+  free(tpath);
+
+  img->header = img->mm_region.start;
+  img->sections = img->mm_region.start + sizeof(struct boot_image_header);
+  uint64_t size = img->mm_region.size;
+
+  // validate the header and manifest; after this, sections can be trusted to
+  // lie within the image.
+  int valid = size >= sizeof(struct boot_image_header) +
+                          BOOT_IMAGE_SECTIONS *
+                              sizeof(struct boot_image_section) &&
+              !strncmp(img->header->hdr, "BIMG", 4) &&
+              img->header->version == BOOT_IMAGE_VERSION &&
+              img->header->nsections == BOOT_IMAGE_SECTIONS &&
+              img->header->size == size &&
+              img->header->checksum ==
+                  fnv1a(FNV_INIT, img->sections,
+                        BOOT_IMAGE_SECTIONS *
+                            sizeof(struct boot_image_section));
+  for (int i = 0; valid && i < BOOT_IMAGE_SECTIONS; i++) {
+    struct boot_image_section *s = &img->sections[i];
+    valid = s->off <= size && s->size <= size - s->off;
+  }
+  if (!valid) {
+    DEBUG_PRINT("not a valid boot image\n");
+    mm_close(&img->mm_region);
+    return -1;
+  }
+  return 0;
+}
+
+struct boot_image_section *boot_image_section(boot_image_t *img,
+                                              const char *name) {
+  for (int i = 0; i < img->header->nsections; i++) {
+    if (!strncmp(img->sections[i].name, name, sizeof(img->sections[i].name))) {
+      return &img->sections[i];
+    }
+  }
+  return NULL;
+}
+
+int boot_image_verify(boot_image_t *img, const char *name) {
+  struct boot_image_section *s = boot_image_section(img, name);
+  return s && fnv1a(FNV_INIT, img->mm_region.start + s->off, s->size) ==
+                   s->checksum;
+}
+
+int boot_image_current(boot_image_t *img, const char *params_path,
+                       const char *db_path, const char *log_path) {
+  const char *paths[BOOT_IMAGE_SECTIONS] = {params_path, db_path, log_path};
+  for (int i = 0; i < BOOT_IMAGE_SECTIONS; i++) {
+    struct boot_image_section *s = boot_image_section(img, section_names[i]);
+    uint64_t size;
+    if (!s || file_hash(paths[i], section_exts[i], s->size, &size) !=
+                  s->src_hash ||
+        size != s->src_size) {
+      DEBUG_PRINT("%s%s changed since the image was made\n", paths[i],
+                  section_exts[i]);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void boot_image_params(boot_image_t *img, disk_array_t *arr) {
+  struct boot_image_section *s = boot_image_section(img, "params");
+  assert(s);
+  array_view(img->mm_region.start + s->off, s->size, arr);
+  arr->mm_region.flags = img->mm_region.flags;
+}
+
+void boot_image_nav(boot_image_t *img, strtable_t *tbl) {
+  struct boot_image_section *s = boot_image_section(img, "nav");
+  assert(s);
+  strtable_view(img->mm_region.start + s->off, s->size, tbl);
+  tbl->mm_region.flags = img->mm_region.flags;
+}
+
+void boot_image_log(boot_image_t *img, block_list_t *lst) {
+  struct boot_image_section *s = boot_image_section(img, "log");
+  assert(s);
+  bl_view(img->mm_region.start + s->off, s->size, s->value, lst);
+  lst->mm_region.flags = img->mm_region.flags;
+}
+
+void boot_image_close(boot_image_t *img) { mm_close(&img->mm_region); }
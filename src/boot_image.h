@@ -0,0 +1,134 @@
+#ifndef __BOOT_IMAGE_H__
+#define __BOOT_IMAGE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block_list.h"
+#include "disk_array.h"
+#include "mm_util.h"
+#include "strtable.h"
+
+typedef struct boot_image_t boot_image_t;
+
+// -------------------------------
+// boot image file format and use
+// -------------------------------
+//
+// A boot image packs the params array, nav table and flight log that the boot
+// sequence reads into one file, so that booting maps one file instead of three
+// and reuses state computed when the image was made instead of rebuilding it.
+//
+// Typical usage:
+//
+//    // once (make image)
+//    boot_image_write("db/params", "db/nav", "db/log", "db/boot");
+//
+//    // at boot
+//    boot_image_t img;
+//    boot_image_open("db/boot", &img);
+//    if (!boot_image_current(&img, "db/params", "db/nav", "db/log")) {
+//      // the databases changed since the image was made; don't use it.
+//    }
+//    strtable_t nav;
+//    boot_image_nav(&img, &nav); // no file is opened
+//    ...
+//    boot_image_close(&img);
+//
+// The image file (with the ".img" extension) starts with a header and a
+// manifest of its sections, followed by the sections, each starting on a page
+// boundary:
+//
+// | BIMG | version | nsections | pad | size | checksum | sections[nsections] |
+// | pad | params.arr contents | pad | nav.stb contents | pad | log.ll ... |
+//
+// Each manifest entry names a section, locates it, and carries the FNV-1a
+// checksum of its contents and one precomputed value: the number of elements
+// for the params and nav sections, and the offset of the tail for the log (so
+// the tail is not searched for). The log section holds the list only up to its
+// (empty) tail block. The header's checksum covers the manifest.
+//
+// Each entry also identifies the database file the section was copied from:
+// its size, and the FNV-1a hash of the first and last page of the copied part
+// (which hold the params and nav headers, the newest nav elements, and the
+// log's tail block). boot_image_current compares them with the files, reading
+// two pages of each, so an image made before the databases were appended to,
+// recreated or had their headers changed is not used. Changes elsewhere in a
+// file (an element edited in place) are not seen; remake the image after them.
+//
+// Images are only made from valid databases: the params must fit in their
+// array, every nav element is checked, and every log block's header must match
+// its footer. Once made, the contents can be checked against their checksums
+// (boot_image_verify, which reads the whole section) instead of element by
+// element.
+//
+// The image is mapped privately (copy-on-write) in one mapping, and the
+// structs set up by boot_image_params/nav/log borrow their regions from it
+// (see mm_util.h): closing them does nothing, and they must not be used after
+// boot_image_close.
+
+// Version of the image format.
+#define BOOT_IMAGE_VERSION 2
+// Number of sections.
+#define BOOT_IMAGE_SECTIONS 3
+
+// image header
+struct boot_image_header {
+  char hdr[4];        // header chars
+  uint32_t version;   // format version
+  uint32_t nsections; // number of manifest entries
+  uint32_t pad;       // unused
+  uint64_t size;      // total size of the image
+  uint64_t checksum;  // checksum of the manifest
+};
+
+// manifest entry
+struct boot_image_section {
+  char name[8];      // section name ("params", "nav" or "log")
+  uint64_t off;      // offset of the section from the start of the image
+  uint64_t size;     // size of the section
+  uint64_t checksum; // checksum of the section
+  uint64_t value;    // precomputed value (see above)
+  uint64_t src_size; // size of the database file the section was copied from
+  uint64_t src_hash; // hash of the first and last page of the copied part
+};
+
+// boot image struct
+struct boot_image_t {
+  struct boot_image_header *header;    // pointer to the image header
+  struct boot_image_section *sections; // pointer to the manifest
+  mm_region_t mm_region;               // memory map info
+};
+
+// Make the image fname from the params array, nav table and flight log at the
+// given paths. Returns 0, or -1 if the params array, nav table or log is
+// invalid (in which case no image is written).
+int boot_image_write(const char *params_path, const char *db_path,
+                     const char *log_path, const char *fname);
+
+// Open the image fname. Returns 0, or -1 if it does not exist or is not a valid
+// image (in which case nothing is left open).
+int boot_image_open(const char *fname, boot_image_t *img);
+
+// Return the manifest entry of the section name, or NULL.
+struct boot_image_section *boot_image_section(boot_image_t *img,
+                                              const char *name);
+
+// Returns nonzero if the contents of section name match its checksum.
+int boot_image_verify(boot_image_t *img, const char *name);
+
+// Returns nonzero if the params array, nav table and flight log at the given
+// paths are (as far as their sizes and first and last pages show) the ones the
+// image was made from.
+int boot_image_current(boot_image_t *img, const char *params_path,
+                       const char *db_path, const char *log_path);
+
+// Set up arr, tbl or lst to use the image's params, nav or log section.
+void boot_image_params(boot_image_t *img, disk_array_t *arr);
+void boot_image_nav(boot_image_t *img, strtable_t *tbl);
+void boot_image_log(boot_image_t *img, block_list_t *lst);
+
+// Close an image.
+void boot_image_close(boot_image_t *img);
+
+#endif
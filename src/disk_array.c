@@ -1,8 +1,15 @@
+#define _GNU_SOURCE
 #include "disk_array.h"
 
+#include <fcntl.h>
+#include <linux/fs.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include "stats.h"
 #include "util.h"
 
 // Macro that evaluates to the size of the header for disk-backed arrays.
@@ -20,12 +27,27 @@ static inline uint64_t *el_size(void *base_address) {
   return (uint64_t *)(base_address + sizeof(uint64_t));
 }
 
-void array_open(const char *fname, uint64_t desired_elements,
-                uint64_t element_size, disk_array_t *arr) {
-  assert(arr);
+// Helper function that returns fname with the ".arr" extension (malloc'd).
+static char *arr_path(const char *fname) {
   char *tpath = malloc(strlen(fname) + 5);
   strcpy(tpath, fname);
   strcat(tpath, ".arr");
+  return tpath;
+}
+
+// Helper function that sets the fields of arr from its mapped region.
+static void init_fields(disk_array_t *arr) {
+  void *base = arr->mm_region.start;
+  arr->array = base + HDR_SIZE;
+  arr->n = n_el(base);
+  arr->element_size = el_size(base);
+}
+
+void array_open(const char *fname, uint64_t desired_elements,
+                uint64_t element_size, disk_array_t *arr) {
+  STATS_BEGIN(STATS_ARRAY_OPEN);
+  assert(arr);
+  char *tpath = arr_path(fname);
   DEBUG_PRINT("opening %s\n", tpath);
 
   size_t desired_size = 0;
@@ -44,10 +66,6 @@ void array_open(const char *fname, uint64_t desired_elements,
   size_t size =
       arr->mm_region.size; // the authoritative size comes from the region.
 
-  // initialize arr fields.
-  // start of array is after header fields
-  arr->array = base + HDR_SIZE;
-
   if (desired_size) {
     // if the array is new, zero upon opening.
     memset((char *)base, 0, size);
@@ -61,11 +79,199 @@ void array_open(const char *fname, uint64_t desired_elements,
   }
 
   // Read the number of elements and the element size from the header.
-  arr->n = n_el(base);
-  arr->element_size = el_size(base);
+  init_fields(arr);
+  STATS_END(STATS_ARRAY_OPEN);
+}
+
+void array_view(void *start, size_t size, disk_array_t *arr) {
+  assert(arr);
+  assert(size >= HDR_SIZE);
+  arr->mm_region.start = start;
+  arr->mm_region.size = size;
+  arr->mm_region.fd = -1;
+  arr->mm_region.flags = 0;
+  init_fields(arr);
+  assert(*arr->n * *arr->element_size + HDR_SIZE <= size);
 }
 
 void array_close(disk_array_t *arr) {
   // Nothing to do but close the memory region.
   mm_close(&arr->mm_region);
 }
+
+// Copy the file open as in to dst (replacing dst), by reflink if possible. If
+// reflink_only is set, only a reflink is attempted. Returns 1 if the copy is a
+// reflink, 0 if the data was copied, or -1 on error.
+static int clone_fd(int in, const char *dst, int reflink_only) {
+  int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (out == -1) {
+    return -1;
+  }
+
+  int ret = 1;
+  if (ioctl(out, FICLONE, in)) {
+    // no reflink support; copy the data (the kernel may still share it).
+    ret = reflink_only ? -1 : 0;
+    loff_t off_in = 0;
+    ssize_t n = 1;
+    while (!ret && n > 0) {
+      n = copy_file_range(in, &off_in, out, NULL, 1 << 30, 0);
+    }
+    if (!ret && n < 0) {
+      ret = -1;
+    }
+  }
+
+  close(out);
+  if (ret == -1) {
+    unlink(dst);
+  }
+  return ret;
+}
+
+// Copy the file at src to dst, as clone_fd does.
+static int clone_file(const char *src, const char *dst, int reflink_only) {
+  int in = open(src, O_RDONLY);
+  if (in == -1) {
+    return -1;
+  }
+  int ret = clone_fd(in, dst, reflink_only);
+  close(in);
+  return ret;
+}
+
+int array_snapshot(const char *fname, const char *snap_fname,
+                   disk_array_t *arr) {
+  assert(arr);
+  char *tpath = arr_path(fname);
+  int reflinked = 0;
+
+  if (snap_fname) {
+    char *snap_path = arr_path(snap_fname);
+    if (clone_file(tpath, snap_path, 1) == 1) {
+      DEBUG_PRINT("reflinked %s to %s\n", tpath, snap_path);
+      mm_open(snap_path, 0, &arr->mm_region);
+      reflinked = 1;
+    }
+    free(snap_path);
+  }
+  if (!reflinked) {
+    DEBUG_PRINT("mapping %s privately\n", tpath);
+    mm_open_private(tpath, &arr->mm_region);
+  }
+  free(tpath);
+
+  init_fields(arr);
+  return reflinked;
+}
+
+// Helper function that returns 1 if the page at addr of a private mapping has
+// been written (and so copied), 0 if not, or -1 if this can't be determined.
+// Copied pages are anonymous pages, in memory or swapped out; pages still
+// shared with the file are file pages (see
+// Documentation/admin-guide/mm/pagemap.rst).
+static int page_copied(int pagemap, void *addr, size_t page_size) {
+  uint64_t entry;
+  off_t off = ((uintptr_t)addr / page_size) * sizeof(uint64_t);
+  if (pagemap == -1 || pread(pagemap, &entry, sizeof(entry), off) !=
+                           sizeof(entry)) {
+    return -1;
+  }
+  int present = (entry >> 63) & 1;
+  int swapped = (entry >> 62) & 1;
+  int file_page = (entry >> 61) & 1;
+  return (present && !file_page) || swapped;
+}
+
+int64_t array_commit(disk_array_t *arr, const char *fname,
+                     const char *new_fname) {
+  char *new_path = arr_path(new_fname);
+  if (arr->mm_region.flags & MAP_SHARED) {
+    // a reflinked snapshot (see mm_open_private): its writes are in its own
+    // file, which is simply cloned.
+    int err = msync(arr->mm_region.start, arr->mm_region.size, MS_SYNC) ||
+              clone_fd(arr->mm_region.fd, new_path, 0) == -1;
+    DEBUG_PRINT("cloned snapshot to %s\n", new_path);
+    free(new_path);
+    return err ? -1 : 0;
+  }
+
+  char *tpath = arr_path(fname);
+  int64_t written = 0;
+
+  if (clone_file(tpath, new_path, 0) == -1) {
+    written = -1;
+  }
+  int out = written ? -1 : open(new_path, O_WRONLY);
+  int in = open(tpath, O_RDONLY);
+  int pagemap = open("/proc/self/pagemap", O_RDONLY);
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  char *page = malloc(page_size);
+
+  void *base = arr->mm_region.start;
+  for (size_t off = 0; out != -1 && off < arr->mm_region.size;
+       off += page_size) {
+    size_t len = arr->mm_region.size - off < page_size
+                     ? arr->mm_region.size - off
+                     : page_size;
+    int copied = page_copied(pagemap, base + off, page_size);
+    if (copied == -1) {
+      // no pagemap; compare with the original instead.
+      copied = pread(in, page, len, off) != len || memcmp(page, base + off, len);
+    }
+    if (!copied) {
+      continue;
+    }
+    if (pwrite(out, base + off, len, off) != len) {
+      written = -1;
+      break;
+    }
+    written++;
+  }
+  DEBUG_PRINT("committed %ld pages to %s\n", written, new_path);
+
+  free(page);
+  if (pagemap != -1) {
+    close(pagemap);
+  }
+  if (in != -1) {
+    close(in);
+  }
+  if (out != -1) {
+    close(out);
+  }
+  free(new_path);
+  free(tpath);
+  return written;
+}
+
+void array_window_open(const char *fname, size_t window_size, int nwindows,
+                       disk_array_window_t *arr) {
+  assert(arr);
+  char *tpath = arr_path(fname);
+  mm_window_open(tpath, window_size, nwindows, &arr->win);
+  free(tpath);
+
+  // copy the header; it is not kept mapped.
+  void *base = mm_window_get(&arr->win, 0, HDR_SIZE);
+  assert(base);
+  arr->n = *n_el(base);
+  arr->element_size = *el_size(base);
+  assert(arr->element_size);
+}
+
+void *array_window_get(disk_array_window_t *arr, uint64_t idx) {
+  if (idx >= arr->n) {
+    return NULL;
+  }
+  return mm_window_get(&arr->win, HDR_SIZE + idx * arr->element_size,
+                       arr->element_size);
+}
+
+void array_window_release(disk_array_window_t *arr, uint64_t idx) {
+  mm_window_release(&arr->win, HDR_SIZE + idx * arr->element_size);
+}
+
+void array_window_close(disk_array_window_t *arr) {
+  mm_window_close(&arr->win);
+}
@@ -5,6 +5,10 @@
 
 #include "mm_util.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct disk_array_t disk_array_t;
 
 // ----------------------------------------------
@@ -63,4 +67,101 @@ void array_open(const char *fname, uint64_t desired_elements,
 // Close a disk-backed array.
 void array_close(disk_array_t *arr);
 
+// Set up arr to use the array file contents at start (size bytes) in memory
+// that is already mapped, as a borrowed region (see mm_util.h).
+void array_view(void *start, size_t size, disk_array_t *arr);
+
+// --------------------------
+// copy-on-write snapshots
+// --------------------------
+//
+// A snapshot is a writable copy of an existing array that does not change the
+// original, and that shares the original's memory and disk space until it is
+// written.
+//
+// Typical usage:
+//
+//    disk_array_t snap;
+//    array_snapshot("params", NULL, &snap);
+//    // experiment with snap.array; params.arr is not changed
+//    ...
+//    // keep the result as params-v2.arr
+//    array_commit(&snap, "params", "params-v2");
+//    array_close(&snap);
+//
+// If snap_fname is given and the file system supports reflinks (FICLONE, as
+// on btrfs and xfs), the snapshot is a new file, snap_fname.arr, sharing the
+// original's extents on disk; writes to it are written through as usual.
+// Otherwise, the original is mapped privately: pages are read from the
+// original file until they are written, and writes stay in memory.
+//
+// array_commit writes a snapshot as a new array file. A reflinked snapshot is
+// synced and its file cloned. For a private mapping, the original is cloned
+// (reflinked if possible), and only the pages the snapshot modified are then
+// written to the new file.
+
+// Open a copy-on-write snapshot of the existing array fname. Returns 1 if the
+// snapshot is a reflinked file (snap_fname.arr), or 0 if it is a private
+// mapping of fname.arr.
+int array_snapshot(const char *fname, const char *snap_fname,
+                   disk_array_t *arr);
+
+// Write the snapshot arr of the array fname as a new array, new_fname. Returns
+// the number of modified pages written (0 for a reflinked snapshot, whose file
+// is cloned whole), or -1 on error.
+int64_t array_commit(disk_array_t *arr, const char *fname,
+                     const char *new_fname);
+
+// ----------------------
+// windowed array access
+// ----------------------
+//
+// Arrays too large to map whole (for the address space or memory available)
+// can be read and written through a windowed mapping instead (see
+// mm_window_open). Elements are then accessed with array_window_get rather
+// than through a pointer to the whole array:
+//
+//    disk_array_window_t arr;
+//    array_window_open(filename, 0, 0, &arr);
+//    for (uint64_t i = 0; i < arr.n; i++) {
+//      my_array_type *el = array_window_get(&arr, i);
+//      ...
+//      // done with elements before i
+//      array_window_release(&arr, i);
+//    }
+//    array_window_close(&arr);
+//
+// A pointer returned by array_window_get is valid as long as the window holding
+// it is (at least until the next array_window_get).
+//
+// Windowed arrays are a separate type, rather than a mode of disk_array_t,
+// because a disk_array_t is used through its array pointer: callers index
+// arr.array directly, and there is no element access function that windows
+// could be put behind.
+
+typedef struct disk_array_window_t disk_array_window_t;
+struct disk_array_window_t {
+  mm_window_t win;       // windowed file
+  uint64_t n;            // length of array
+  uint64_t element_size; // size in bytes of each element
+};
+
+// Open an existing array for windowed access (see mm_window_open for
+// window_size and nwindows).
+void array_window_open(const char *fname, size_t window_size, int nwindows,
+                       disk_array_window_t *arr);
+
+// Return a pointer to element idx, or NULL if idx is out of range.
+void *array_window_get(disk_array_window_t *arr, uint64_t idx);
+
+// Release the windows holding only elements before idx.
+void array_window_release(disk_array_window_t *arr, uint64_t idx);
+
+// Close a windowed array.
+void array_window_close(disk_array_window_t *arr);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
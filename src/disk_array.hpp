@@ -0,0 +1,181 @@
+#ifndef __DARRAY_HPP__
+#define __DARRAY_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "disk_array.h"
+
+// -------------------------------
+// typed C++ disk array usage
+// -------------------------------
+//
+// disk_array<T> is a header-only wrapper over the disk_array_t functions for
+// C++ callers. It owns an open array (closing it when destroyed), checks that
+// the element size stored in the file is sizeof(T), and exposes the data as a
+// contiguous range of T, so no casts are needed to use it.
+//
+// Typical usage:
+//
+//    // open an existing array of uint64_t (throws if its elements are not 8
+//    // bytes).
+//    disk_array<uint64_t> params("params");
+//
+//    for (uint64_t &p : params) {
+//      ...
+//    }
+//
+//    // create a new array of 1000 zeroed elements.
+//    auto counts = disk_array<uint32_t>::create("counts", 1000);
+//    std::for_each(std::execution::par_unseq, counts.begin(), counts.end(),
+//                  [](uint32_t &c) { c = 1; });
+//
+//    // or as a span.
+//    std::span<uint32_t> s = counts.span();
+//
+// Iterators are plain pointers into the mapped file, so they are contiguous,
+// random-access iterators; the element count is read once, when the array is
+// opened. T must be trivially copyable, since its bytes are stored in the
+// file directly. (With libstdc++, the parallel execution policies need
+// -ltbb.)
+//
+// Errors opening an array (a wrong element size, or more elements than the
+// file holds) throw std::invalid_argument; at() throws std::out_of_range. Other accesses are not bounds checked.
+
+template <typename T> class disk_array {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "disk_array elements must be trivially copyable");
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T &;
+  using const_reference = const T &;
+  using pointer = T *;
+  using const_pointer = const T *;
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  // Open the existing array fname (".arr" is appended).
+  explicit disk_array(const std::string &fname) {
+    array_open(fname.c_str(), 0, 0, &arr_);
+    init(fname);
+  }
+
+  // Create (or replace) the array fname with n zeroed elements.
+  static disk_array create(const std::string &fname, size_type n) {
+    return disk_array(fname, n);
+  }
+
+  // Open a copy-on-write snapshot of the existing array fname (see
+  // array_snapshot).
+  static disk_array snapshot(const std::string &fname,
+                             const char *snap_fname = nullptr) {
+    disk_array snap;
+    array_snapshot(fname.c_str(), snap_fname, &snap.arr_);
+    snap.init(fname);
+    return snap;
+  }
+
+  disk_array(const disk_array &) = delete;
+  disk_array &operator=(const disk_array &) = delete;
+
+  disk_array(disk_array &&other) noexcept
+      : arr_(other.arr_), data_(other.data_), size_(other.size_) {
+    other.data_ = nullptr;
+  }
+
+  disk_array &operator=(disk_array &&other) noexcept {
+    if (this != &other) {
+      close();
+      arr_ = other.arr_;
+      data_ = other.data_;
+      size_ = other.size_;
+      other.data_ = nullptr;
+    }
+    return *this;
+  }
+
+  ~disk_array() { close(); }
+
+  iterator begin() noexcept { return data_; }
+  iterator end() noexcept { return data_ + size_; }
+  const_iterator begin() const noexcept { return data_; }
+  const_iterator end() const noexcept { return data_ + size_; }
+  const_iterator cbegin() const noexcept { return data_; }
+  const_iterator cend() const noexcept { return data_ + size_; }
+
+  reference operator[](size_type i) noexcept { return data_[i]; }
+  const_reference operator[](size_type i) const noexcept { return data_[i]; }
+
+  reference at(size_type i) {
+    if (i >= size_) {
+      throw std::out_of_range("disk_array index out of range");
+    }
+    return data_[i];
+  }
+  const_reference at(size_type i) const {
+    return const_cast<disk_array *>(this)->at(i);
+  }
+
+  pointer data() noexcept { return data_; }
+  const_pointer data() const noexcept { return data_; }
+  size_type size() const noexcept { return size_; }
+  bool empty() const noexcept { return size_ == 0; }
+
+  std::span<T> span() noexcept { return {data_, size_}; }
+  std::span<const T> span() const noexcept { return {data_, size_}; }
+
+  // The underlying C array, for use with the disk_array_t functions.
+  disk_array_t *raw() noexcept { return &arr_; }
+
+private:
+  disk_array() = default;
+
+  disk_array(const std::string &fname, size_type n) {
+    array_open(fname.c_str(), n, sizeof(T), &arr_);
+    init(fname);
+  }
+
+  // Check the element size and count in the header and cache the data pointer
+  // and size.
+  void init(const std::string &fname) {
+    if (*arr_.element_size != sizeof(T)) {
+      uint64_t found = *arr_.element_size;
+      array_close(&arr_);
+      throw std::invalid_argument(fname + ": element size " +
+                                  std::to_string(found) + ", expected " +
+                                  std::to_string(sizeof(T)));
+    }
+    // the elements follow the header (the element count and size).
+    size_type room = (arr_.mm_region.size - 2 * sizeof(uint64_t)) / sizeof(T);
+    if (*arr_.n > room) {
+      uint64_t found = *arr_.n;
+      array_close(&arr_);
+      throw std::invalid_argument(fname + ": " + std::to_string(found) +
+                                  " elements, but room for " +
+                                  std::to_string(room));
+    }
+    data_ = static_cast<T *>(arr_.array);
+    size_ = *arr_.n;
+  }
+
+  void close() noexcept {
+    if (data_) {
+      array_close(&arr_);
+      data_ = nullptr;
+    }
+  }
+
+  disk_array_t arr_{};
+  T *data_ = nullptr;
+  size_type size_ = 0;
+};
+
+#endif
@@ -1,3 +1,4 @@
+#include "array_ops.h"
 #include "disk_array.h"
 
 #include <errno.h>
@@ -11,6 +12,12 @@ void usage() {
   printf("m name size    make new array\n"
          "s idx element  set element\n"
          "g idx          get element\n"
+         "n name [snap]  open copy-on-write snapshot\n"
+         "w name new     commit snapshot as new array\n"
+         "r sum|min|max  reduce elements\n"
+         "h lo hi n dst  histogram of elements into n bins\n"
+         "t k dst        k largest elements\n"
+         "o dst          sort elements\n"
          "c              close table\n"
          "p              print elements\n"
          "q              quit\n");
@@ -56,6 +63,42 @@ int main(int argc, char **argv) {
       tmp_int = atoi(str);
       printf("get element %d: %lu\n", tmp_int, data[tmp_int]);
       break;
+    case 'n':
+      tmp_str = strtok(NULL, " ");
+      tmp_int = array_snapshot(str, tmp_str, &arr);
+      data = arr.array;
+      printf("snapshot of %s (%s)\n", str, tmp_int ? "reflinked" : "private");
+      printf("array size: %lu\n", *arr.n);
+      break;
+    case 'w':
+      tmp_str = strtok(NULL, " ");
+      printf("committed %ld pages to %s\n", array_commit(&arr, str, tmp_str),
+             tmp_str);
+      break;
+    case 'r':
+      tmp_int = strcmp(str, "min") == 0   ? ARRAY_MIN
+                : strcmp(str, "max") == 0 ? ARRAY_MAX
+                                          : ARRAY_SUM;
+      printf("%s: %lu\n", str, array_reduce(&arr, tmp_int, 0));
+      break;
+    case 'h': {
+      uint64_t lo = parse(str);
+      uint64_t hi = parse(strtok(NULL, " "));
+      uint64_t nbins = parse(strtok(NULL, " "));
+      tmp_str = strtok(NULL, " ");
+      array_histogram(&arr, lo, hi, nbins, tmp_str, 0);
+      printf("wrote histogram to %s\n", tmp_str);
+      break;
+    }
+    case 't':
+      tmp_str = strtok(NULL, " ");
+      array_top_k(&arr, parse(str), tmp_str, 0);
+      printf("wrote top %s to %s\n", str, tmp_str);
+      break;
+    case 'o':
+      array_sort(&arr, str, 0, 0);
+      printf("wrote sorted array to %s\n", str);
+      break;
     case 'c':
       printf("closing...\n");
       array_close(&arr);
@@ -0,0 +1,212 @@
+#include "ef_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+// Helper function that returns the offset of element idx of table.
+static uint64_t table_offset(strtable_t *table, unsigned int idx) {
+  // offsets are measured from the end of the table.
+  return strtable_size(table) -
+         ((void *)get_element(table, idx) - table->mm_region.start);
+}
+
+// Write the low width bits of val at bit position pos of words.
+static void put_bits(uint64_t *words, uint64_t pos, uint32_t width,
+                     uint64_t val) {
+  if (!width) {
+    return;
+  }
+  if (width < 64) {
+    val &= (1ULL << width) - 1;
+  }
+  uint64_t word = pos / 64;
+  uint32_t shift = pos % 64;
+  words[word] |= val << shift;
+  if (shift + width > 64) {
+    // value spans two words.
+    words[word + 1] |= val >> (64 - shift);
+  }
+}
+
+// Read width bits at bit position pos of words.
+static uint64_t get_bits(const uint64_t *words, uint64_t pos, uint32_t width) {
+  if (!width) {
+    return 0;
+  }
+  uint64_t word = pos / 64;
+  uint32_t shift = pos % 64;
+  uint64_t val = words[word] >> shift;
+  if (shift + width > 64) {
+    val |= words[word + 1] << (64 - shift);
+  }
+  return width == 64 ? val : val & ((1ULL << width) - 1);
+}
+
+void ef_build(strtable_t *table, const char *path) {
+  assert(table);
+  uint32_t n = strtable_len(table);
+  uint64_t universe = n ? table_offset(table, n - 1) + 1 : 1;
+
+  // choose l so that the high bits array has about 2n bits.
+  uint32_t l = 0;
+  while (n && (universe / n) >> (l + 1)) {
+    l++;
+  }
+
+  // an extra low word lets get_bits read two words at the end of the array.
+  uint64_t low = ((uint64_t)n * l + 63) / 64 + 1;
+  uint64_t high = (n + (universe >> l) + 1 + 63) / 64;
+  uint64_t samples = (n + EF_SAMPLE - 1) / EF_SAMPLE;
+  size_t size = sizeof(struct ef_metadata) +
+                (low + high + samples) * sizeof(uint64_t);
+
+  char *tpath = malloc(strlen(path) + 5);
+  strcpy(tpath, path);
+  strcat(tpath, ".sef");
+  DEBUG_PRINT("building %s: %u offsets, %u low bits, %lu bytes\n", tpath, n, l,
+              size);
+
+  ef_index_t ef;
+  mm_open(tpath, size, &ef.mm_region);
+  free(tpath);
+  memset(ef.mm_region.start, 0, size);
+
+  ef.metadata = ef.mm_region.start;
+  memcpy(ef.metadata->hdr, "STEF", 4);
+  ef.metadata->n = n;
+  ef.metadata->l = l;
+  ef.metadata->universe = universe;
+  ef.metadata->table_size = strtable_size(table);
+  ef.metadata->low = low;
+  ef.metadata->high = high;
+  ef.metadata->samples = samples;
+  ef.low = ef.mm_region.start + sizeof(struct ef_metadata);
+  ef.high = ef.low + low;
+  ef.samples = ef.high + high;
+
+  for (uint32_t i = 0; i < n; i++) {
+    uint64_t v = table_offset(table, i);
+    put_bits(ef.low, (uint64_t)i * l, l, v);
+    uint64_t bit = (v >> l) + i;
+    ef.high[bit / 64] |= 1ULL << (bit % 64);
+    if (i % EF_SAMPLE == 0) {
+      ef.samples[i / EF_SAMPLE] = bit;
+    }
+  }
+
+  mm_close(&ef.mm_region);
+}
+
+void ef_open(const char *path, strtable_t *table, ef_index_t *ef) {
+  assert(ef);
+  char *tpath = malloc(strlen(path) + 5);
+  strcpy(tpath, path);
+  strcat(tpath, ".sef");
+  DEBUG_PRINT("opening %s\n", tpath);
+
+  mm_open(tpath, 0, &ef->mm_region);
+  free(tpath);
+
+  ef->metadata = ef->mm_region.start;
+  ef->low = ef->mm_region.start + sizeof(struct ef_metadata);
+  ef->high = ef->low + ef->metadata->low;
+  ef->samples = ef->high + ef->metadata->high;
+
+  // validate that this is an index of table.
+  assert(strncmp((char *)ef->metadata, "STEF", 4) == 0);
+  assert(ef->metadata->n == strtable_len(table));
+  assert(ef->metadata->table_size == strtable_size(table));
+}
+
+void ef_close(ef_index_t *ef) { mm_close(&ef->mm_region); }
+
+// Return the position of the k-th set bit of x, which must have more than k set
+// bits. The byte holding the bit is found without branches (by comparing k
+// with the running popcount of each byte, all bytes at once).
+static inline uint32_t select_word(uint64_t x, uint32_t k) {
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t highs = 0x8080808080808080ULL;
+
+  // popcount of each byte.
+  uint64_t s = x - ((x >> 1) & 0x5555555555555555ULL);
+  s = (s & 0x3333333333333333ULL) + ((s >> 2) & 0x3333333333333333ULL);
+  s = (s + (s >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  // running popcount (through each byte), in each byte.
+  uint64_t sums = s * ones;
+  // count the bytes whose running popcount is at most k; the bit is in the
+  // next byte.
+  uint32_t place =
+      __builtin_popcountll(((k * ones | highs) - sums) & highs) * 8;
+  uint32_t before = place ? (sums >> (place - 8)) & 0xff : 0;
+
+  // drop the set bits before it in that byte.
+  uint64_t bits = (x >> place) & 0xff;
+  for (uint32_t i = before; i < k; i++) {
+    bits &= bits - 1;
+  }
+  return place + __builtin_ctzll(bits);
+}
+
+// Return the position of the idx-th set bit of the high bits array.
+static uint64_t select_high(ef_index_t *ef, unsigned int idx) {
+  // start at the sampled set bit before idx.
+  uint64_t pos = ef->samples[idx / EF_SAMPLE];
+  uint32_t left = idx % EF_SAMPLE;
+  uint64_t word = pos / 64;
+  uint64_t bits = ef->high[word] & (~0ULL << (pos % 64));
+
+  // skip whole words.
+  uint32_t count = __builtin_popcountll(bits);
+  while (left >= count) {
+    left -= count;
+    bits = ef->high[++word];
+    count = __builtin_popcountll(bits);
+  }
+  return word * 64 + select_word(bits, left);
+}
+
+// Return the position of the first set bit of the high bits array after pos.
+static uint64_t next_high(ef_index_t *ef, uint64_t pos) {
+  pos++;
+  uint64_t word = pos / 64;
+  uint64_t bits = ef->high[word] & (~0ULL << (pos % 64));
+  while (!bits) {
+    bits = ef->high[++word];
+  }
+  return word * 64 + __builtin_ctzll(bits);
+}
+
+uint64_t ef_get(ef_index_t *ef, unsigned int idx) {
+  uint32_t l = ef->metadata->l;
+  uint64_t high = select_high(ef, idx) - idx;
+  return (high << l) | get_bits(ef->low, (uint64_t)idx * l, l);
+}
+
+char *ef_get_element(ef_index_t *ef, strtable_t *table, unsigned int idx) {
+  if (idx >= ef->metadata->n) {
+    // Invalid index.
+    return NULL;
+  }
+  return table->mm_region.start + strtable_size(table) - ef_get(ef, idx);
+}
+
+int ef_get_element_len(ef_index_t *ef, strtable_t *table, unsigned int idx) {
+  if (idx >= ef->metadata->n) {
+    // Invalid index.
+    return -1;
+  }
+  if (idx == 0) {
+    // first element size is offset.
+    return ef_get(ef, 0);
+  }
+  // element idx's high bit is the next set bit after element idx - 1's.
+  uint32_t l = ef->metadata->l;
+  uint64_t prev_pos = select_high(ef, idx - 1);
+  uint64_t pos = next_high(ef, prev_pos);
+  uint64_t prev = ((prev_pos - (idx - 1)) << l) |
+                  get_bits(ef->low, (uint64_t)(idx - 1) * l, l);
+  uint64_t cur = ((pos - idx) << l) | get_bits(ef->low, (uint64_t)idx * l, l);
+  return cur - prev;
+}
@@ -0,0 +1,99 @@
+#ifndef __EF_INDEX_H__
+#define __EF_INDEX_H__
+
+#include <stdint.h>
+
+#include "mm_util.h"
+#include "strtable.h"
+
+typedef struct ef_index_t ef_index_t;
+
+// ----------------------------------------------
+// Elias-Fano compressed strtable offset index
+// ----------------------------------------------
+//
+// A strtable's index stores one 4-byte (or 8-byte) offset per element, and
+// those offsets are strictly increasing. An Elias-Fano index stores the same
+// offsets in about 2 + log2(size / n) bits each, and is kept in a separate file
+// with the ".sef" extension. Elements can then be found without touching the
+// table's own index.
+//
+// Typical usage:
+//
+//    strtable_t table;
+//    strtable_open(filename, 0, &table);
+//    ef_build(&table, filename);
+//
+//    ef_index_t ef;
+//    ef_open(filename, &table, &ef);
+//    char *str = ef_get_element(&ef, &table, index);
+//    int len = ef_get_element_len(&ef, &table, index);
+//    ...
+//    ef_close(&ef);
+//
+// Each offset v is split into its low l bits and its high bits (v >> l), where
+// l = floor(log2(universe / n)) and universe is one more than the largest
+// offset. The low bits of all offsets are packed, l bits each, into the low
+// bits array. The high bits are stored in unary in the high bits array: for
+// element i, bit (v >> l) + i is set. Element i's high bits are then the
+// position of the i-th set bit, minus i.
+//
+// To find the i-th set bit quickly, the position of every EF_SAMPLE-th set bit
+// is stored in the samples array; a lookup starts at the nearest sample and
+// counts set bits (a few words) from there.
+//
+// The file format is:
+//
+// | STEF | n | l | pad | universe | table_size | low | high | samples | ...
+//
+// where low, high and samples are the number of 64-bit words in each array,
+// and the arrays follow the header in that order. table_size is the size of
+// the table the index was built for; an index must only be used with that
+// table (and must be rebuilt after elements are added).
+
+// Number of set bits between samples.
+#define EF_SAMPLE 64
+
+// index metadata struct
+struct ef_metadata {
+  char hdr[4];         // header chars
+  uint32_t n;          // number of offsets
+  uint32_t l;          // number of low bits per offset
+  uint32_t pad;        // unused
+  uint64_t universe;   // largest offset plus one
+  uint64_t table_size; // size of indexed table
+  uint64_t low;        // words in low bits array
+  uint64_t high;       // words in high bits array
+  uint64_t samples;    // words in samples array
+};
+
+// index struct
+struct ef_index_t {
+  struct ef_metadata *metadata; // pointer to metadata/index start
+  uint64_t *low;                // low bits array
+  uint64_t *high;               // high bits array
+  uint64_t *samples;            // positions of every EF_SAMPLE-th set bit
+  mm_region_t mm_region;        // memory map info
+};
+
+// Build the Elias-Fano index of table, writing it to path (".sef" is
+// appended).
+void ef_build(strtable_t *table, const char *path);
+
+// Open the index at path, which must have been built for table.
+void ef_open(const char *path, strtable_t *table, ef_index_t *ef);
+
+// Close an index.
+void ef_close(ef_index_t *ef);
+
+// Get the offset of element idx (as stored in the table's index). idx must be
+// in range.
+uint64_t ef_get(ef_index_t *ef, unsigned int idx);
+
+// Return the element at index idx, or null if index is not in table range.
+char *ef_get_element(ef_index_t *ef, strtable_t *table, unsigned int idx);
+
+// Return length of element at index idx, or -1 if index is not in table range.
+int ef_get_element_len(ef_index_t *ef, strtable_t *table, unsigned int idx);
+
+#endif
@@ -0,0 +1,216 @@
+#include "fc_strtable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+// Write v as a LEB128 varint at out (if out is non-null). Returns the number of
+// bytes needed to store v.
+static uint32_t put_varint(unsigned char *out, uint32_t v) {
+  uint32_t n = 0;
+  do {
+    unsigned char byte = v & 0x7f;
+    v >>= 7;
+    if (v) {
+      byte |= 0x80;
+    }
+    if (out) {
+      out[n] = byte;
+    }
+    n++;
+  } while (v);
+  return n;
+}
+
+// Read a LEB128 varint at *in and advance *in past it.
+static uint32_t get_varint(unsigned char **in) {
+  uint32_t v = 0;
+  int shift = 0;
+  unsigned char byte;
+  do {
+    byte = **in;
+    (*in)++;
+    v |= (uint32_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return v;
+}
+
+// Encode the data region of src into out (if out is non-null), storing block
+// offsets (relative to data start) in blocks (if non-null). Returns the size of
+// the data region and sets *max_len to the longest element.
+static uint32_t encode(strtable_t *src, uint32_t restart, unsigned char *out,
+                       uint32_t *blocks, uint32_t *max_len) {
+  uint32_t pos = 0;
+  const char *prev = NULL;
+  uint32_t prev_len = 0;
+  *max_len = 1;
+
+  uint32_t n = strtable_len(src);
+  for (uint32_t i = 0; i < n; i++) {
+    const char *cur = get_element(src, i);
+    uint32_t cur_len = strlen(cur);
+    if (cur_len + 1 > *max_len) {
+      *max_len = cur_len + 1;
+    }
+
+    if (i % restart == 0) {
+      // restart point; store whole element.
+      if (blocks) {
+        blocks[i / restart] = pos;
+      }
+      pos += put_varint(out ? out + pos : NULL, cur_len);
+      if (out) {
+        memcpy(out + pos, cur, cur_len);
+      }
+      pos += cur_len;
+    } else {
+      // store shared prefix length and the suffix.
+      uint32_t shared = 0;
+      while (shared < prev_len && shared < cur_len &&
+             prev[shared] == cur[shared]) {
+        shared++;
+      }
+      pos += put_varint(out ? out + pos : NULL, shared);
+      pos += put_varint(out ? out + pos : NULL, cur_len - shared);
+      if (out) {
+        memcpy(out + pos, cur + shared, cur_len - shared);
+      }
+      pos += cur_len - shared;
+    }
+
+    prev = cur;
+    prev_len = cur_len;
+  }
+  return pos;
+}
+
+uint32_t fc_compress(strtable_t *src, const char *path, uint32_t restart) {
+  assert(src);
+  assert(restart);
+
+  uint32_t n = strtable_len(src);
+  uint32_t nblocks = (n + restart - 1) / restart;
+  uint32_t hdr_size = sizeof(struct fc_metadata) + nblocks * sizeof(uint32_t);
+
+  // first pass: find the size of the encoded data.
+  uint32_t max_len = 0;
+  uint32_t data_size = encode(src, restart, NULL, NULL, &max_len);
+  // front-coded tables use 32-bit sizes and offsets.
+  assert((uint64_t)hdr_size + data_size <= UINT32_MAX);
+  uint32_t size = hdr_size + data_size;
+
+  char *tpath = malloc(strlen(path) + 5);
+  strcpy(tpath, path);
+  strcat(tpath, ".fcs");
+  DEBUG_PRINT("compressing %d elements into %s (%u bytes)\n", n, tpath, size);
+
+  mm_region_t region;
+  mm_open(tpath, size, &region);
+  free(tpath);
+
+  // second pass: encode directly into the mapped file.
+  struct fc_metadata *metadata = region.start;
+  uint32_t *blocks = region.start + sizeof(struct fc_metadata);
+  encode(src, restart, region.start + hdr_size, blocks, &max_len);
+
+  // block offsets are stored relative to the start of the file.
+  for (uint32_t i = 0; i < nblocks; i++) {
+    blocks[i] += hdr_size;
+  }
+
+  memcpy(metadata->hdr, "FCST", 4);
+  metadata->size = size;
+  metadata->len = n;
+  metadata->restart = restart;
+  metadata->max_len = max_len;
+
+  mm_close(&region);
+  return size;
+}
+
+void fc_open(const char *path, fc_strtable_t *tbl) {
+  assert(tbl);
+
+  char *tpath = malloc(strlen(path) + 5);
+  strcpy(tpath, path);
+  strcat(tpath, ".fcs");
+  DEBUG_PRINT("opening %s\n", tpath);
+
+  mm_open(tpath, 0, &tbl->mm_region);
+  free(tpath);
+
+  tbl->metadata = tbl->mm_region.start;
+  tbl->blocks = tbl->mm_region.start + sizeof(struct fc_metadata);
+
+  // validate that this is a front-coded strtable.
+  assert(strncmp((char *)tbl->metadata, "FCST", 4) == 0);
+  assert(tbl->metadata->size == tbl->mm_region.size);
+  assert(tbl->metadata->restart);
+
+  tbl->buf = malloc(tbl->metadata->max_len);
+  tbl->cur_idx = -1;
+  tbl->cur_len = 0;
+  tbl->pos = NULL;
+}
+
+void fc_close(fc_strtable_t *tbl) {
+  free(tbl->buf);
+  mm_close(&tbl->mm_region);
+}
+
+uint32_t fc_len(fc_strtable_t *tbl) { return tbl->metadata->len; }
+
+// Helper function that decodes element idx into the decode buffer.
+static void decode(fc_strtable_t *tbl, unsigned int idx) {
+  if (tbl->cur_idx == idx) {
+    // already decoded.
+    return;
+  }
+
+  uint32_t restart = tbl->metadata->restart;
+  unsigned int first = idx - idx % restart;
+
+  // continue from the current element if it is in the same block and before
+  // idx; otherwise start at the restart point of idx's block.
+  unsigned char *pos = tbl->pos;
+  unsigned int i = tbl->cur_idx + 1;
+  if (tbl->cur_idx < (int)first || tbl->cur_idx > (int)idx) {
+    pos = ((unsigned char *)tbl->metadata) + tbl->blocks[idx / restart];
+    i = first;
+  }
+
+  uint32_t len = 0;
+  for (; i <= idx; i++) {
+    // the buffer holds the previous element, so only the suffix is copied.
+    uint32_t shared = i == first ? 0 : get_varint(&pos);
+    uint32_t suffix = get_varint(&pos);
+    memcpy(tbl->buf + shared, pos, suffix);
+    pos += suffix;
+    len = shared + suffix;
+  }
+  tbl->buf[len] = '\0';
+
+  tbl->cur_idx = idx;
+  tbl->cur_len = len + 1;
+  tbl->pos = pos;
+}
+
+const char *fc_get_element(fc_strtable_t *tbl, unsigned int idx) {
+  if (idx >= tbl->metadata->len) {
+    // Invalid index.
+    return NULL;
+  }
+  decode(tbl, idx);
+  return tbl->buf;
+}
+
+int fc_get_element_len(fc_strtable_t *tbl, unsigned int idx) {
+  if (idx >= tbl->metadata->len) {
+    // Invalid index.
+    return -1;
+  }
+  decode(tbl, idx);
+  return tbl->cur_len;
+}
@@ -0,0 +1,111 @@
+#ifndef __FC_STRTABLE_H__
+#define __FC_STRTABLE_H__
+
+#include <stdint.h>
+
+#include "mm_util.h"
+#include "strtable.h"
+
+typedef struct fc_strtable_t fc_strtable_t;
+
+// -------------------------------------------------------
+// front-coded strtable file format and memory layout
+// -------------------------------------------------------
+//
+// Front-coded strtables are read-only, compressed copies of a strtable. They
+// are produced from an existing strtable with fc_compress and store the same
+// elements at the same indicies, but each element only stores the bytes that
+// differ from the element before it.
+//
+// Typical usage:
+//
+//    strtable_t table;
+//    strtable_open(filename, 0, &table);
+//    fc_compress(&table, compressed_filename, FC_DEFAULT_RESTART);
+//    strtable_close(&table);
+//
+//    fc_strtable_t fc;
+//    fc_open(compressed_filename, &fc);
+//    const char *str = fc_get_element(&fc, index);
+//    int len = fc_get_element_len(&fc, index);
+//    ...
+//    fc_close(&fc);
+//
+// Elements are grouped into blocks of `restart` elements. The first element
+// of each block (the restart point) is stored in full. Every other element is
+// stored as the length of the prefix it shares with the previous element,
+// followed by the remaining suffix. Lengths are stored as LEB128 varints (7 bits
+// per byte, high bit set on all but the last byte).
+//
+// The front-coded format looks like the following:
+//         byte | contents      | description
+//         -----|---------------|-------------
+//            0 | FCST          | identifying marker
+//            4 | size          | uint32 size of file
+//            8 | n             | uint32 number of elements
+//           12 | restart       | uint32 number of elements per block
+//           16 | max_len       | uint32 length of longest element (incl. \0)
+//           20 | block[0]      | uint32 offset of block 0 from file start
+//              | ...           |
+//  20 + 4(b-1) | block[b-1]    | offset of last block
+//  24 + 4(b-1) |               | start of data region
+//              | block 0       | len, bytes | shared, suffix len, bytes | ...
+//              | ...           |
+//         size | end           | end of data
+//
+// where b is ceil(n / restart).
+//
+// Getting an element seeks to the start of its block and decodes at most
+// restart elements into a decode buffer owned by the fc_strtable_t. The
+// returned string is only valid until the next get, and must not be modified.
+// Reading elements in order decodes each element only once.
+
+// Default number of elements per block.
+#define FC_DEFAULT_RESTART 16
+
+// front-coded table metadata struct
+struct fc_metadata {
+  char hdr[4];      // header chars
+  uint32_t size;    // total size of table
+  uint32_t len;     // number of elements
+  uint32_t restart; // number of elements per block
+  uint32_t max_len; // longest element (including null terminator)
+};
+
+// front-coded table struct
+struct fc_strtable_t {
+  struct fc_metadata *metadata; // pointer to metadata/table start
+  uint32_t *blocks;             // pointer to block offsets
+  mm_region_t mm_region;        // memory map info
+
+  char *buf;          // decode buffer (max_len bytes)
+  int cur_idx;        // index of element in buf, or -1
+  int cur_len;        // length of element in buf (including \0)
+  unsigned char *pos; // encoded position of element following cur_idx
+};
+
+// Compress a strtable into a new front-coded table at path (".fcs" is
+// appended). restart is the number of elements per block; smaller blocks are
+// faster to read and larger blocks compress better.
+//
+// Returns the size of the compressed table in bytes.
+uint32_t fc_compress(strtable_t *src, const char *path, uint32_t restart);
+
+// Open an existing front-coded table.
+void fc_open(const char *path, fc_strtable_t *tbl);
+
+// Close a front-coded table.
+void fc_close(fc_strtable_t *tbl);
+
+// Get the length of the table (in terms of number of elements).
+uint32_t fc_len(fc_strtable_t *tbl);
+
+// Return the element at index idx. Returns null if index is not in table range.
+// The returned string is valid until the next call on tbl.
+const char *fc_get_element(fc_strtable_t *tbl, unsigned int idx);
+
+// Return length of element at index idx (including the null terminator).
+// Returns -1 if index is not in table range.
+int fc_get_element_len(fc_strtable_t *tbl, unsigned int idx);
+
+#endif
@@ -0,0 +1,67 @@
+#include "block_list.h"
+#include "flight_record.h"
+#include "strtable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void usage(const char *name) {
+  printf("usage: %s log nav out [-p]\n"
+         "  converts text flight log log (with locations from nav table nav)\n"
+         "  into a new flight record log out. -p prints the new records.\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  block_list_t log;
+  strtable_t nav;
+  block_list_t out;
+
+  bl_open(argv[1], 0, &log);
+  strtable_open(argv[2], 0, &nav);
+  // a record is at most a header larger than the text entry it replaces.
+  uint64_t blocks = 0;
+  uint32_t size = 0;
+  for (char *block = bl_next(NULL, &size, &log); block;
+       block = bl_next(block, &size, &log)) {
+    blocks++;
+  }
+  bl_open(argv[3], log.mm_region.size + blocks * sizeof(struct flight_record),
+          &out);
+
+  int n = fr_convert(&log, &nav, &out);
+  if (n < 0) {
+    printf("%s is full!\n", argv[3]);
+    return 1;
+  }
+  printf("converted %d entries\n", n);
+
+  if (argc > 4 && !strcmp(argv[4], "-p")) {
+    struct flight_record rec;
+    const char *payload;
+    char *block = bl_next(NULL, &size, &out);
+    while (block) {
+      if (fr_decode(block, size, &rec, &payload)) {
+        printf("invalid record!\n");
+      } else if (rec.type == FR_ENTRY) {
+        printf("%.2f %s (%u bytes)\n", rec.stardate,
+               get_element(&nav, rec.location), rec.payload_len);
+      } else {
+        printf("%.2f %s (unknown location, %lu bytes)\n", rec.stardate,
+               payload, rec.payload_len - strlen(payload) - 1);
+      }
+      block = bl_next(block, &size, &out);
+    }
+  }
+
+  bl_close(&out);
+  strtable_close(&nav);
+  bl_close(&log);
+  return 0;
+}
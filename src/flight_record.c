@@ -0,0 +1,217 @@
+#include "flight_record.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "util.h"
+
+// Prefix of the stardate field of text flight log entries.
+#define STARDATE_PREFIX "STARDATE "
+
+uint32_t fr_encode(uint8_t type, double stardate, uint32_t location,
+                   const char *payload, uint32_t payload_len, char *buf) {
+  struct flight_record rec = {{'F', 'R'}, FR_VERSION, type, location,
+                              stardate, payload_len, 0};
+  // copy the header rather than casting buf, which may not be 8-byte aligned.
+  memcpy(buf, &rec, sizeof(struct flight_record));
+  memcpy(buf + sizeof(struct flight_record), payload, payload_len);
+  return sizeof(struct flight_record) + payload_len;
+}
+
+char *fr_append(uint8_t type, double stardate, uint32_t location,
+                const char *payload, uint32_t payload_len, block_list_t *lst) {
+  char *buf = malloc(sizeof(struct flight_record) + payload_len);
+  uint32_t size =
+      fr_encode(type, stardate, location, payload, payload_len, buf);
+  char *block = bl_append(buf, size, lst);
+  free(buf);
+  return block;
+}
+
+int fr_decode(const char *block, uint32_t size, struct flight_record *rec,
+              const char **payload) {
+  if (size < sizeof(struct flight_record)) {
+    return -1;
+  }
+  memcpy(rec, block, sizeof(struct flight_record));
+  if (rec->magic[0] != 'F' || rec->magic[1] != 'R' ||
+      rec->version != FR_VERSION ||
+      rec->payload_len != size - sizeof(struct flight_record)) {
+    return -1;
+  }
+  *payload = block + sizeof(struct flight_record);
+  return 0;
+}
+
+// A location name in the nav table, for looking up location indicies.
+struct nav_name {
+  const char *name; // name part of nav element
+  uint32_t idx;     // index of nav element
+};
+
+// Compare nav names by name, then by index.
+static int cmp_name(const void *a, const void *b) {
+  const struct nav_name *x = a;
+  const struct nav_name *y = b;
+  int c = strcmp(x->name, y->name);
+  if (c) {
+    return c;
+  }
+  return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+// Helper function that builds a sorted array of nav table names (in scratch),
+// or returns NULL if it does not fit. Nav elements are "lon;lat;dist;name"
+// strings; the name is the part after the last ';'.
+static struct nav_name *nav_names(strtable_t *nav, uint32_t *n,
+                                  arena_t *scratch) {
+  *n = strtable_len(nav);
+  struct nav_name *names =
+      arena_alloc(scratch, *n * sizeof(struct nav_name) + 1);
+  if (!names) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < *n; i++) {
+    const char *el = get_element(nav, i);
+    const char *name = strrchr(el, ';');
+    names[i].name = name ? name + 1 : el;
+    names[i].idx = i;
+  }
+  qsort(names, *n, sizeof(struct nav_name), cmp_name);
+  return names;
+}
+
+// Return the index of the first nav element named name, or FR_NO_LOCATION.
+static uint32_t find_name(struct nav_name *names, uint32_t n,
+                          const char *name) {
+  uint32_t lo = 0;
+  uint32_t hi = n;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (strcmp(names[mid].name, name) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < n && !strcmp(names[lo].name, name)) {
+    return names[lo].idx;
+  }
+  return FR_NO_LOCATION;
+}
+
+// Helper function that returns a null-terminated copy of len bytes of str in
+// scratch, or NULL if it does not fit.
+static char *scratch_copy(arena_t *scratch, const char *str, uint32_t len) {
+  char *copy = arena_alloc(scratch, (size_t)len + 1);
+  if (!copy) {
+    return NULL;
+  }
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+// Helper function that appends one converted entry to dst, encoding it in
+// scratch. Returns 0 on success or -1 if dst (or scratch) is full.
+static int emit(struct nav_name *names, uint32_t n, const char *location,
+                double stardate, const char *payload, uint32_t payload_len,
+                block_list_t *dst, arena_t *scratch) {
+  uint8_t type = FR_ENTRY;
+  uint32_t idx = find_name(names, n, location);
+  if (idx == FR_NO_LOCATION) {
+    // unknown location; keep its name at the start of the payload.
+    uint32_t name_len = strlen(location) + 1;
+    char *named = arena_alloc(scratch, (size_t)name_len + payload_len);
+    if (!named) {
+      return -1;
+    }
+    memcpy(named, location, name_len);
+    memcpy(named + name_len, payload, payload_len);
+    type = FR_NAMED_ENTRY;
+    payload = named;
+    payload_len += name_len;
+  }
+
+  char *buf = arena_alloc(scratch, sizeof(struct flight_record) + payload_len);
+  if (!buf) {
+    return -1;
+  }
+  uint32_t size = fr_encode(type, stardate, idx, payload, payload_len, buf);
+  return bl_append(buf, size, dst) ? 0 : -1;
+}
+
+// Helper function that splits a text log entry, a block of size bytes holding
+// "location\0STARDATE <n>\0payload", into its fields. location is set to point
+// at the (null-terminated) location name, and stardate to the parsed stardate
+// (the stardate field's terminator may be missing if there is no payload).
+// Returns 0, or -1 if the block is not an entry (or scratch is full).
+static int parse_entry(char *block, uint32_t size, arena_t *scratch,
+                       const char **location, double *stardate,
+                       const char **payload, uint32_t *payload_len) {
+  char *end = block + size;
+  char *field = memchr(block, '\0', size);
+  if (!field) {
+    return -1;
+  }
+  field++;
+  size_t prefix_len = strlen(STARDATE_PREFIX);
+  if (end - field < prefix_len ||
+      strncmp(field, STARDATE_PREFIX, prefix_len)) {
+    return -1;
+  }
+  field += prefix_len;
+  char *field_end = memchr(field, '\0', end - field);
+  if (!field_end) {
+    field_end = end;
+  }
+  char *tmp = scratch_copy(scratch, field, field_end - field);
+  if (!tmp) {
+    return -1;
+  }
+  *location = block;
+  *stardate = strtod(tmp, NULL);
+  *payload = field_end < end ? field_end + 1 : end;
+  *payload_len = end - *payload;
+  return 0;
+}
+
+int fr_convert(block_list_t *src, strtable_t *nav, block_list_t *dst) {
+  // the names, and each entry's temporary copies, live in scratch; an entry's
+  // copies are freed together when the next entry starts.
+  arena_t scratch;
+  arena_volatile(0, &scratch);
+  uint32_t n = 0;
+  struct nav_name *names = nav_names(nav, &n, &scratch);
+  if (!names) {
+    arena_close(&scratch);
+    return -1;
+  }
+  size_t entry_mark = arena_mark(&scratch);
+
+  int count = 0;
+  int err = 0;
+  uint32_t size = 0;
+  char *block = bl_next(NULL, &size, src);
+  while (block && !err) {
+    const char *location;
+    double stardate;
+    const char *payload;
+    uint32_t payload_len;
+    if (!parse_entry(block, size, &scratch, &location, &stardate, &payload,
+                     &payload_len)) {
+      err = emit(names, n, location, stardate, payload, payload_len, dst,
+                 &scratch);
+      count++;
+    } else {
+      DEBUG_PRINT("skipping block that is not a log entry\n");
+    }
+    arena_release(&scratch, entry_mark);
+    block = bl_next(block, &size, src);
+  }
+
+  arena_close(&scratch);
+  DEBUG_PRINT("converted %d entries\n", count);
+  return err ? -1 : count;
+}
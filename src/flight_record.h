@@ -0,0 +1,100 @@
+#ifndef __FLIGHT_RECORD_H__
+#define __FLIGHT_RECORD_H__
+
+#include <stdint.h>
+
+#include "block_list.h"
+#include "strtable.h"
+
+// ------------------------------------
+// flight log record format and framing
+// ------------------------------------
+//
+// The original flight log stores each entry as a single text block of three
+// null-separated fields: a location name, a "STARDATE <n>" line, and a
+// payload (which runs to the end of the block). Flight records store an entry
+// as a single block, starting with a fixed-size binary header:
+//
+//         byte | contents    | description
+//         -----|-------------|-------------
+//            0 | FR          | identifying marker
+//            2 | version     | uint8 record schema version (FR_VERSION)
+//            3 | type        | uint8 record type (enum fr_type)
+//            4 | location    | uint32 index of location in nav strtable
+//            8 | stardate    | double stardate
+//           16 | payload_len | uint32 length of payload
+//           20 | pad         | unused (zero)
+//           24 | payload     | payload_len bytes
+//
+// The block size is always 24 + payload_len.
+//
+// location is an index into the nav strtable (whose elements are
+// "lon;lat;dist;name" strings), or FR_NO_LOCATION. Entries whose location name
+// is not in the nav table are stored as FR_NAMED_ENTRY records, whose payload
+// starts with the null-terminated location name.
+//
+// Typical usage:
+//
+//    fr_append(FR_ENTRY, stardate, location, payload, payload_len, &log);
+//    ...
+//    struct flight_record rec;
+//    const char *payload;
+//    uint32_t size;
+//    char *block = bl_next(NULL, &size, &log);
+//    while (block) {
+//      if (!fr_decode(block, size, &rec, &payload)) {
+//        // use rec.type, rec.stardate, ...
+//      }
+//      block = bl_next(block, &size, &log);
+//    }
+
+// Current record schema version.
+#define FR_VERSION 1
+
+// Location of records with no nav table entry.
+#define FR_NO_LOCATION UINT32_MAX
+
+// record types
+enum fr_type {
+  FR_ENTRY = 1,       // log entry at a nav table location
+  FR_NAMED_ENTRY = 2, // log entry at a location not in the nav table
+};
+
+// record header
+struct flight_record {
+  char magic[2];        // header chars
+  uint8_t version;      // schema version
+  uint8_t type;         // record type
+  uint32_t location;    // nav table index, or FR_NO_LOCATION
+  double stardate;      // stardate of entry
+  uint32_t payload_len; // length of payload following header
+  uint32_t pad;         // unused
+};
+
+// Encode a record into buf, which must have room for
+// sizeof(struct flight_record) + payload_len bytes. Returns the size of the
+// encoded record.
+uint32_t fr_encode(uint8_t type, double stardate, uint32_t location,
+                   const char *payload, uint32_t payload_len, char *buf);
+
+// Encode a record and append it to lst as one block. Returns pointer to the
+// block, or NULL if the list was full.
+char *fr_append(uint8_t type, double stardate, uint32_t location,
+                const char *payload, uint32_t payload_len, block_list_t *lst);
+
+// Decode the record in a block of size bytes. The header is copied to rec and
+// payload is set to point at the payload within the block.
+//
+// Returns 0 if the block is a valid record, or -1 if it is not (wrong marker or
+// version, or a payload length that does not match the block size).
+int fr_decode(const char *block, uint32_t size, struct flight_record *rec,
+              const char **payload);
+
+// Convert a text flight log into records appended to dst, looking location
+// names up in the nav table. Blocks that are not log entries are skipped.
+// Returns the number of records appended, or -1 if dst filled up (or an entry
+// was too large to convert). A record is at most sizeof(struct flight_record)
+// bytes larger than the entry it replaces.
+int fr_convert(block_list_t *src, strtable_t *nav, block_list_t *dst);
+
+#endif
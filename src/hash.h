@@ -0,0 +1,23 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Initial state for the FNV-1a hash.
+#define FNV_INIT 0xcbf29ce484222325ULL
+
+// 64-bit FNV-1a hash of len bytes at buf.
+//
+// h is the hash state to continue from; pass FNV_INIT to start a new hash.
+// Hashing a buffer in pieces gives the same result as hashing it all at once.
+static inline uint64_t fnv1a(uint64_t h, const void *buf, size_t len) {
+  const unsigned char *p = buf;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+#endif
@@ -0,0 +1,536 @@
+#include "log_index.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "flight_record.h"
+#include "hash.h"
+#include "util.h"
+
+#define AS_INT(expr) *((uint32_t *)(expr))
+#define STARDATE_PREFIX "STARDATE "
+
+// Helper function that returns path with the ".lix" extension, and suffix
+// (malloc'd).
+static char *lix_path(const char *path, const char *suffix) {
+  char *tpath = malloc(strlen(path) + strlen(suffix) + 5);
+  strcpy(tpath, path);
+  strcat(tpath, ".lix");
+  strcat(tpath, suffix);
+  return tpath;
+}
+
+// -------------------------
+// nav names
+// -------------------------
+
+// Helper function that returns the name part of a "lon;lat;dist;name" element.
+static const char *name_of(const char *el) {
+  const char *name = strrchr(el, ';');
+  return name ? name + 1 : el;
+}
+
+// Helper function that finds the hash table slot of name (len bytes), which
+// holds its first element, or is empty if it is not in the table.
+static uint32_t name_slot(log_index_t *idx, const char *name, uint32_t len) {
+  uint32_t slot = fnv1a(FNV_INIT, name, len) & idx->names_mask;
+  while (idx->names[slot]) {
+    const char *other = name_of(get_element(idx->nav, idx->names[slot] - 1));
+    if (!strncmp(other, name, len) && !other[len]) {
+      break;
+    }
+    slot = (slot + 1) & idx->names_mask;
+  }
+  return slot;
+}
+
+// Helper function that adds the names of nav elements added since the last
+// call to the hash table (rebuilding it when it gets half full).
+static void names_add(log_index_t *idx) {
+  uint32_t len = strtable_len(idx->nav);
+  if (idx->named == len && idx->names) {
+    return;
+  }
+  if (!idx->names || (uint64_t)len * 2 > (uint64_t)idx->names_mask + 1) {
+    uint64_t size = 64;
+    while (size < (uint64_t)len * 2) {
+      size *= 2;
+    }
+    free(idx->names);
+    idx->names = calloc(size, sizeof(uint32_t));
+    idx->names_mask = size - 1;
+    idx->named = 0;
+  }
+  for (uint32_t i = idx->named; i < len; i++) {
+    const char *name = name_of(get_element(idx->nav, i));
+    uint32_t slot = name_slot(idx, name, strlen(name));
+    if (!idx->names[slot]) {
+      // a name used again keeps its first element.
+      idx->names[slot] = i + 1;
+    }
+  }
+  idx->named = len;
+}
+
+// Helper function that returns the nav element named by len bytes at name, or
+// LI_NONE.
+static uint32_t names_find(log_index_t *idx, const char *name, uint32_t len) {
+  uint32_t slot = name_slot(idx, name, len);
+  return idx->names[slot] ? idx->names[slot] - 1 : LI_NONE;
+}
+
+// -------------------------
+// locating blocks
+// -------------------------
+
+// Helper function that returns the nav element a block is the entry of, or
+// LI_NONE if it is not an entry (or names no nav element).
+static uint32_t locate(log_index_t *idx, const char *block, uint32_t size) {
+  struct flight_record rec;
+  const char *payload;
+  if (!fr_decode(block, size, &rec, &payload)) {
+    return rec.type == FR_ENTRY && rec.location < strtable_len(idx->nav)
+               ? rec.location
+               : LI_NONE;
+  }
+  // a text entry's location is its first field, followed by its stardate
+  // field.
+  const char *field = memchr(block, '\0', size);
+  size_t prefix_len = strlen(STARDATE_PREFIX);
+  if (!field || block + size - (field + 1) < prefix_len ||
+      strncmp(field + 1, STARDATE_PREFIX, prefix_len)) {
+    return LI_NONE;
+  }
+  return names_find(idx, block, field - block);
+}
+
+// -------------------------
+// delta
+// -------------------------
+
+// Helper function that adds a delta posting of off to nav element loc.
+static void delta_add(log_index_t *idx, uint32_t loc, uint64_t off) {
+  if (loc >= idx->delta_n) {
+    uint32_t n = strtable_len(idx->nav);
+    n = n > loc ? n : loc + 1;
+    idx->delta_first = realloc(idx->delta_first, n * sizeof(uint32_t));
+    idx->delta_last = realloc(idx->delta_last, n * sizeof(uint32_t));
+    idx->delta_count = realloc(idx->delta_count, n * sizeof(uint32_t));
+    for (uint32_t i = idx->delta_n; i < n; i++) {
+      idx->delta_first[i] = idx->delta_last[i] = idx->delta_count[i] = 0;
+    }
+    idx->delta_n = n;
+  }
+  if (!idx->delta_cap) {
+    // entry 0 marks the end of an element's postings.
+    idx->delta_cap = 1024;
+    idx->delta = malloc(idx->delta_cap * sizeof(struct li_delta));
+    idx->ndelta = 1;
+  }
+  if (idx->ndelta == idx->delta_cap) {
+    idx->delta_cap *= 2;
+    idx->delta = realloc(idx->delta, idx->delta_cap * sizeof(struct li_delta));
+  }
+  uint32_t d = idx->ndelta++;
+  idx->delta[d].off = off;
+  idx->delta[d].next = 0;
+  if (idx->delta_last[loc]) {
+    idx->delta[idx->delta_last[loc]].next = d;
+  } else {
+    idx->delta_first[loc] = d;
+  }
+  idx->delta_last[loc] = d;
+  idx->delta_count[loc]++;
+}
+
+static void delta_free(log_index_t *idx) {
+  free(idx->delta);
+  free(idx->delta_first);
+  free(idx->delta_last);
+  free(idx->delta_count);
+  idx->delta = NULL;
+  idx->delta_first = idx->delta_last = idx->delta_count = NULL;
+  idx->ndelta = idx->delta_cap = idx->delta_n = 0;
+}
+
+// -------------------------
+// index file
+// -------------------------
+
+// Helper function that writes v as a varint at buf, and returns the number of
+// bytes written (at most 10).
+static uint32_t put_varint(unsigned char *buf, uint64_t v) {
+  uint32_t n = 0;
+  while (v >= 0x80) {
+    buf[n++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  buf[n++] = v;
+  return n;
+}
+
+// Helper function that reads a varint at *p, advancing *p past it.
+static uint64_t get_varint(const unsigned char **p) {
+  uint64_t v = 0;
+  int shift = 0;
+  while (**p & 0x80) {
+    v |= (uint64_t)(*(*p)++ & 0x7f) << shift;
+    shift += 7;
+  }
+  return v | (uint64_t)*(*p)++ << shift;
+}
+
+// Helper function that returns the file postings of nav element loc, setting
+// count to their number (0 if loc is not in the file).
+static const unsigned char *file_postings(log_index_t *idx, uint32_t loc,
+                                          uint32_t *count) {
+  *count = 0;
+  if (!idx->metadata || loc >= idx->metadata->n) {
+    return NULL;
+  }
+  const unsigned char *p = idx->data + idx->samples[loc / LI_SAMPLE];
+  for (uint32_t i = loc - loc % LI_SAMPLE; i < loc; i++) {
+    if (get_varint(&p)) {
+      uint64_t bytes = get_varint(&p);
+      p += bytes;
+    }
+  }
+  *count = get_varint(&p);
+  if (*count) {
+    get_varint(&p);
+  }
+  return p;
+}
+
+// Helper function that makes room for more bytes at the end of a buffer.
+static void reserve(unsigned char **buf, uint64_t *cap, uint64_t size,
+                    uint64_t more) {
+  while (size + more > *cap) {
+    *cap *= 2;
+    *buf = realloc(*buf, *cap);
+  }
+}
+
+// Helper function that writes the postings of idx (file and delta) to the
+// file tpath.
+static void write_file(log_index_t *idx, const char *tpath) {
+  uint32_t n = strtable_len(idx->nav);
+  uint64_t nsamples = (n + LI_SAMPLE - 1) / LI_SAMPLE;
+  uint64_t *samples = malloc((nsamples ? nsamples : 1) * sizeof(uint64_t));
+  uint64_t cap = 4096, data_size = 0;
+  unsigned char *data = malloc(cap);
+  // one element's postings, before its count and size are known.
+  uint64_t el_cap = 4096;
+  unsigned char *el = malloc(el_cap);
+  uint64_t postings = 0;
+
+  for (uint32_t i = 0; i < n; i++) {
+    if (i % LI_SAMPLE == 0) {
+      samples[i / LI_SAMPLE] = data_size;
+    }
+    li_cursor_t c;
+    li_cursor_init(idx, i, &c);
+    uint64_t off, prev = 0, el_size = 0, count = 0;
+    while (li_cursor_next(&c, &off)) {
+      reserve(&el, &el_cap, el_size, 10);
+      el_size += put_varint(el + el_size, off - prev);
+      prev = off;
+      count++;
+    }
+    reserve(&data, &cap, data_size, 20 + el_size);
+    data_size += put_varint(data + data_size, count);
+    if (count) {
+      data_size += put_varint(data + data_size, el_size);
+      memcpy(data + data_size, el, el_size);
+      data_size += el_size;
+    }
+    postings += count;
+  }
+
+  size_t size =
+      sizeof(struct li_metadata) + nsamples * sizeof(uint64_t) + data_size;
+  DEBUG_PRINT("writing %s: %lu postings in %lu bytes\n", tpath, postings,
+              data_size);
+  mm_region_t region;
+  mm_open(tpath, size, &region);
+  struct li_metadata *metadata = region.start;
+  memcpy(metadata->hdr, "LIDX", 4);
+  metadata->n = n;
+  metadata->covered = idx->covered;
+  metadata->postings = postings;
+  metadata->data_size = data_size;
+  memcpy(metadata + 1, samples, nsamples * sizeof(uint64_t));
+  memcpy((char *)(metadata + 1) + nsamples * sizeof(uint64_t), data,
+         data_size);
+  mm_close(&region);
+  free(samples);
+  free(data);
+  free(el);
+}
+
+// Helper function that maps the index file tpath into idx. Returns 0, or -1 if
+// it is not a valid index for idx's list and table.
+static int open_file(log_index_t *idx, const char *tpath) {
+  if (access(tpath, F_OK)) {
+    return -1;
+  }
+  DEBUG_PRINT("opening %s\n", tpath);
+  mm_open(tpath, 0, &idx->mm_region);
+  struct li_metadata *metadata = idx->mm_region.start;
+  init_tail(idx->lst);
+  uint64_t tail = idx->lst->tail - idx->lst->start;
+  uint64_t nsamples = (metadata->n + LI_SAMPLE - 1) / LI_SAMPLE;
+  if (idx->mm_region.size < sizeof(*metadata) ||
+      memcmp(metadata->hdr, "LIDX", 4) ||
+      idx->mm_region.size != sizeof(*metadata) + nsamples * sizeof(uint64_t) +
+                                 metadata->data_size ||
+      metadata->n > strtable_len(idx->nav) || metadata->covered > tail ||
+      metadata->covered < 2 * sizeof(uint32_t)) {
+    DEBUG_PRINT("index %s does not match\n", tpath);
+    mm_close(&idx->mm_region);
+    return -1;
+  }
+  idx->metadata = metadata;
+  idx->samples = (uint64_t *)(metadata + 1);
+  idx->data = (unsigned char *)(idx->samples + nsamples);
+  idx->covered = metadata->covered;
+  return 0;
+}
+
+// -------------------------
+// building
+// -------------------------
+
+// a posting found while building
+struct li_pair {
+  uint32_t loc; // nav element
+  uint64_t off; // offset of the entry block
+};
+
+// the postings of one stride
+struct li_stride {
+  char *first;           // first block
+  uint32_t n;            // number of blocks
+  struct li_pair *pairs; // postings found
+  uint32_t npairs;       // number of postings
+};
+
+// build state shared by the threads
+struct li_build {
+  log_index_t *idx;
+  struct li_stride *strides; // strides
+  uint32_t nstrides;         // number of strides
+  uint32_t next;             // next stride to take
+};
+
+static void *build_run(void *arg) {
+  struct li_build *b = arg;
+  log_index_t *idx = b->idx;
+  uint32_t s;
+  while ((s = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) <
+         b->nstrides) {
+    struct li_stride *stride = &b->strides[s];
+    uint32_t cap = 0;
+    char *block = stride->first;
+    for (uint32_t i = 0; i < stride->n; i++) {
+      uint32_t size = AS_INT(block - sizeof(uint32_t));
+      uint32_t loc = locate(idx, block, size);
+      if (loc != LI_NONE) {
+        if (stride->npairs == cap) {
+          cap = cap ? cap * 2 : 256;
+          stride->pairs = realloc(stride->pairs, cap * sizeof(struct li_pair));
+        }
+        stride->pairs[stride->npairs].loc = loc;
+        stride->pairs[stride->npairs++].off = block - (char *)idx->lst->start;
+      }
+      block = bl_next(block, &size, idx->lst);
+    }
+  }
+  return NULL;
+}
+
+uint64_t li_build(strtable_t *nav, block_list_t *lst, int nthreads,
+                  const char *path) {
+  log_index_t idx;
+  memset(&idx, 0, sizeof(idx));
+  idx.nav = nav;
+  idx.lst = lst;
+  names_add(&idx);
+
+  // mark the strides (a walk over the block headers only).
+  struct li_build b = {&idx, NULL, 0, 0};
+  uint32_t cap = 0;
+  uint64_t nblocks = 0;
+  uint32_t size = 0, last_size = 0;
+  char *last = NULL;
+  char *block = bl_next(NULL, &size, lst);
+  while (block) {
+    if (nblocks % LI_STRIDE == 0) {
+      if (b.nstrides == cap) {
+        cap = cap ? cap * 2 : 64;
+        b.strides = realloc(b.strides, cap * sizeof(struct li_stride));
+      }
+      b.strides[b.nstrides++] = (struct li_stride){block, 0, NULL, 0};
+    }
+    b.strides[b.nstrides - 1].n++;
+    nblocks++;
+    last = block;
+    last_size = size;
+    block = bl_next(block, &size, lst);
+  }
+
+  // the index covers the list up to its tail.
+  idx.covered = 2 * sizeof(uint32_t);
+  if (last) {
+    idx.covered = last - (char *)lst->start + last_size + sizeof(uint32_t);
+  }
+
+  nthreads = nthreads ? nthreads : sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > (int)b.nstrides) {
+    nthreads = b.nstrides ? b.nstrides : 1;
+  }
+  DEBUG_PRINT("indexing %lu blocks in %u strides with %d threads\n", nblocks,
+              b.nstrides, nthreads);
+  pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+  for (int t = 1; t < nthreads; t++) {
+    pthread_create(&threads[t], NULL, build_run, &b);
+  }
+  build_run(&b);
+  for (int t = 1; t < nthreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  free(threads);
+
+  // strides are in list order, so each element's postings come out in order.
+  uint64_t postings = 0;
+  for (uint32_t s = 0; s < b.nstrides; s++) {
+    for (uint32_t i = 0; i < b.strides[s].npairs; i++) {
+      delta_add(&idx, b.strides[s].pairs[i].loc, b.strides[s].pairs[i].off);
+    }
+    postings += b.strides[s].npairs;
+    free(b.strides[s].pairs);
+  }
+  free(b.strides);
+
+  char *tpath = lix_path(path, "");
+  unlink(tpath);
+  write_file(&idx, tpath);
+  free(tpath);
+  delta_free(&idx);
+  free(idx.names);
+  return postings;
+}
+
+// -------------------------
+// using an index
+// -------------------------
+
+int li_open(const char *path, strtable_t *nav, block_list_t *lst,
+            log_index_t *idx) {
+  assert(idx);
+  memset(idx, 0, sizeof(*idx));
+  idx->nav = nav;
+  idx->lst = lst;
+  char *tpath = lix_path(path, "");
+  int err = open_file(idx, tpath);
+  free(tpath);
+  return err;
+}
+
+void li_update(log_index_t *idx) {
+  names_add(idx);
+  char *start = idx->lst->start;
+  if (!AS_INT(start + idx->covered)) {
+    // nothing new.
+    return;
+  }
+  char *block = start + idx->covered + sizeof(uint32_t);
+  while (block) {
+    uint32_t size = AS_INT(block - sizeof(uint32_t));
+    uint32_t loc = locate(idx, block, size);
+    if (loc != LI_NONE) {
+      delta_add(idx, loc, block - start);
+    }
+    idx->covered = block - start + size + sizeof(uint32_t);
+    block = bl_next(block, &size, idx->lst);
+  }
+}
+
+// Helper function called after each append to an attached list.
+static void li_notify(block_list_t *lst) { li_update(lst->notify_arg); }
+
+void li_attach(log_index_t *idx) {
+  assert(!idx->lst->notify);
+  idx->lst->notify = li_notify;
+  idx->lst->notify_arg = idx;
+  li_update(idx);
+}
+
+int li_write(log_index_t *idx, const char *path) {
+  char *tpath = lix_path(path, "");
+  char *tmp = lix_path(path, ".tmp");
+  unlink(tmp);
+  write_file(idx, tmp);
+  if (idx->metadata) {
+    mm_close(&idx->mm_region);
+    idx->metadata = NULL;
+  }
+  int err = rename(tmp, tpath) ? -1 : 0;
+  delta_free(idx);
+  if (!err) {
+    err = open_file(idx, tpath);
+  }
+  free(tmp);
+  free(tpath);
+  return err;
+}
+
+void li_close(log_index_t *idx) {
+  if (idx->lst->notify == li_notify && idx->lst->notify_arg == idx) {
+    idx->lst->notify = NULL;
+    idx->lst->notify_arg = NULL;
+  }
+  if (idx->metadata) {
+    mm_close(&idx->mm_region);
+  }
+  delta_free(idx);
+  free(idx->names);
+}
+
+uint32_t li_find(log_index_t *idx, const char *name) {
+  names_add(idx);
+  return names_find(idx, name, strlen(name));
+}
+
+uint32_t li_count(log_index_t *idx, uint32_t loc) {
+  uint32_t count = 0;
+  file_postings(idx, loc, &count);
+  if (loc < idx->delta_n) {
+    count += idx->delta_count[loc];
+  }
+  return count;
+}
+
+void li_cursor_init(log_index_t *idx, uint32_t loc, li_cursor_t *c) {
+  c->idx = idx;
+  c->data = file_postings(idx, loc, &c->left);
+  c->last = 0;
+  c->delta = loc < idx->delta_n ? idx->delta_first[loc] : 0;
+}
+
+int li_cursor_next(li_cursor_t *c, uint64_t *off) {
+  if (c->left) {
+    c->last += get_varint(&c->data);
+    c->left--;
+    *off = c->last;
+    return 1;
+  }
+  if (c->delta) {
+    *off = c->idx->delta[c->delta].off;
+    c->delta = c->idx->delta[c->delta].next;
+    return 1;
+  }
+  return 0;
+}
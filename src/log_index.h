@@ -0,0 +1,164 @@
+#ifndef __LOG_INDEX_H__
+#define __LOG_INDEX_H__
+
+#include <stdint.h>
+
+#include "block_list.h"
+#include "mm_util.h"
+#include "strtable.h"
+
+typedef struct log_index_t log_index_t;
+typedef struct li_cursor_t li_cursor_t;
+
+// -------------------------------------
+// flight log to nav table join index
+// -------------------------------------
+//
+// Flight log entries name their location, which is (usually) an element of the
+// nav table. A log index maps each nav element to the positions of the log
+// entries at that location (its postings), so that the entries at a location,
+// or the locations of the entries, are found without scanning the log or the
+// table.
+//
+// Typical usage:
+//
+//    li_build(&nav, &log, 0, filename);
+//
+//    log_index_t idx;
+//    li_open(filename, &nav, &log, &idx);
+//    li_attach(&idx); // keep the index up to date as entries are appended
+//    ...
+//    uint32_t loc = li_find(&idx, "HD 125159");
+//    li_cursor_t c;
+//    uint64_t off;
+//    li_cursor_init(&idx, loc, &c);
+//    while (li_cursor_next(&c, &off)) {
+//      char *entry = log.start + off;
+//      ...
+//    }
+//    ...
+//    li_write(&idx, filename); // fold new postings into the file
+//    li_close(&idx);
+//
+// A posting is the offset, from the start of the list, of an entry's block
+// (its data, as returned by bl_next). Entries are found in both log formats:
+// a text entry is a block of null-separated fields, "location", "STARDATE
+// <n>" and a payload, named by its first field; a flight record (see
+// flight_record.h) of type FR_ENTRY names its location by nav index. A
+// location whose name is not in the nav table has no postings.
+//
+// Building is one pass over the log, split across threads: a first walk over
+// the block headers marks the start of every LI_STRIDE-th block, and threads
+// then take strides in turn, looking up each entry block's name in a hash
+// table of the nav names.
+//
+// The file (with the ".lix" extension) holds the postings of the log up to
+// covered, compressed:
+//
+// | LIDX | n | covered | postings | data_size | samples | data |
+//
+// data holds, for each of the n nav elements in order, the number of its
+// postings, and, if there are any, their size in bytes and the postings
+// themselves. Postings are in increasing order, and are stored as the
+// differences between consecutive offsets (the first, from 0). All of these
+// numbers are varints: 7 bits per byte, low bits first, with the high bit set
+// on all but the last byte. An element without postings thus takes one byte.
+// samples holds the position in data of every LI_SAMPLE-th element; a lookup
+// starts there and skips over at most LI_SAMPLE - 1 elements.
+//
+// Blocks appended to the list after covered are indexed (by li_update, or on
+// each append after li_attach) into postings kept in memory (the delta), which
+// lookups read after the file's postings; li_write writes a new file with both.
+
+// Number of blocks in each unit of work when building.
+#define LI_STRIDE 4096
+// Number of elements between samples.
+#define LI_SAMPLE 64
+// Returned by li_find for names that are not in the nav table.
+#define LI_NONE UINT32_MAX
+
+// index metadata struct
+struct li_metadata {
+  char hdr[4];        // header chars
+  uint32_t n;         // number of nav elements
+  uint64_t covered;   // list offset of the first block not indexed
+  uint64_t postings;  // number of postings
+  uint64_t data_size; // bytes of compressed postings
+};
+
+// a posting in the delta
+struct li_delta {
+  uint64_t off;  // offset of the entry block
+  uint32_t next; // index of the element's next delta posting, or 0 if last
+  uint32_t pad;  // unused
+};
+
+// index struct
+struct log_index_t {
+  struct li_metadata *metadata; // file metadata
+  uint64_t *samples;            // position of every LI_SAMPLE-th element
+  unsigned char *data;          // file postings
+  mm_region_t mm_region;        // memory map info
+  strtable_t *nav;              // nav table
+  block_list_t *lst;            // flight log
+  uint64_t covered;             // list offset of the first block not indexed
+  uint32_t *names;              // nav name hash table (index + 1, 0 if empty)
+  uint32_t names_mask;          // hash table size - 1
+  uint32_t named;               // nav elements in the hash table
+  struct li_delta *delta;       // delta postings (entry 0 is unused)
+  uint32_t ndelta;              // delta postings used (including entry 0)
+  uint32_t delta_cap;           // delta postings allocated
+  uint32_t *delta_first;        // first delta posting of each nav element
+  uint32_t *delta_last;         // last delta posting of each nav element
+  uint32_t *delta_count;        // delta postings of each nav element
+  uint32_t delta_n;             // nav elements with room in the arrays above
+};
+
+// posting cursor struct
+struct li_cursor_t {
+  log_index_t *idx;          // index
+  const unsigned char *data; // next file posting
+  uint32_t left;             // file postings left
+  uint64_t last;             // last file posting returned
+  uint32_t delta;            // next delta posting, or 0
+};
+
+// Build the index of lst (whose locations are elements of nav) with nthreads
+// threads (one per processor if 0), writing it to path (".lix" is appended).
+// Returns the number of postings.
+uint64_t li_build(strtable_t *nav, block_list_t *lst, int nthreads,
+                  const char *path);
+
+// Open the index path of lst and nav. Returns 0, or -1 if there is no valid
+// index for them (it covers more of the list than there is, or more nav
+// elements than there are).
+int li_open(const char *path, strtable_t *nav, block_list_t *lst,
+            log_index_t *idx);
+
+// Index the blocks appended to the list since it was last indexed.
+void li_update(log_index_t *idx);
+
+// Update idx after each append to its list (through the list's notify hook,
+// which must be unused).
+void li_attach(log_index_t *idx);
+
+// Write the index, with its delta, to path, and reopen it from there. Returns
+// 0, or -1 if the new file could not be put in place.
+int li_write(log_index_t *idx, const char *path);
+
+// Close an index (and detach it from its list).
+void li_close(log_index_t *idx);
+
+// Return the index of the first nav element named name, or LI_NONE.
+uint32_t li_find(log_index_t *idx, const char *name);
+
+// Return the number of postings of nav element loc.
+uint32_t li_count(log_index_t *idx, uint32_t loc);
+
+// Start a cursor over the postings of nav element loc.
+void li_cursor_init(log_index_t *idx, uint32_t loc, li_cursor_t *c);
+
+// Set off to the next posting and return 1, or return 0 after the last.
+int li_cursor_next(li_cursor_t *c, uint64_t *off);
+
+#endif
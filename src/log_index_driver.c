@@ -0,0 +1,118 @@
+#include "block_list.h"
+#include "flight_record.h"
+#include "log_index.h"
+#include "strtable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void usage(const char *name) {
+  printf("usage: %s nav log build [threads]\n"
+         "       %s nav log visits name\n"
+         "       %s nav log stops\n"
+         "       %s nav log append name stardate payload\n"
+         "  build indexes the flight log log by the nav table nav (in\n"
+         "  log.lix). visits prints the log entries at the location name,\n"
+         "  stops prints each nav element that has entries, and how many.\n"
+         "  append adds a text log entry, updating and rewriting the index.\n",
+         name, name, name, name);
+}
+
+double seconds(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    usage(argv[0]);
+    return 1;
+  }
+  strtable_t nav;
+  block_list_t log;
+  strtable_open(argv[1], 0, &nav);
+  bl_open(argv[2], 0, &log);
+
+  int err = 0;
+  if (!strcmp(argv[3], "build")) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t postings =
+        li_build(&nav, &log, argc > 4 ? atoi(argv[4]) : 0, argv[2]);
+    printf("indexed %lu entries in %.3f ms\n", postings,
+           seconds(&start) * 1e3);
+  } else {
+    log_index_t idx;
+    if (li_open(argv[2], &nav, &log, &idx)) {
+      printf("no index for %s; build it first\n", argv[2]);
+      return 1;
+    }
+    if (!strcmp(argv[3], "visits") && argc > 4) {
+      uint32_t loc = li_find(&idx, argv[4]);
+      if (loc == LI_NONE) {
+        printf("%s is not in the nav table\n", argv[4]);
+        err = 1;
+      } else {
+        li_update(&idx);
+        printf("%s (%s): %u entries\n", argv[4], get_element(&nav, loc),
+               li_count(&idx, loc));
+        li_cursor_t c;
+        uint64_t off;
+        li_cursor_init(&idx, loc, &c);
+        while (li_cursor_next(&c, &off)) {
+          char *block = log.start + off;
+          struct flight_record rec;
+          const char *payload;
+          uint32_t size = *(uint32_t *)(block - sizeof(uint32_t));
+          if (!fr_decode(block, size, &rec, &payload)) {
+            printf("  %lu: STARDATE %.2f\n", off, rec.stardate);
+            continue;
+          }
+          // in a text log, the stardate field follows the location field.
+          char *stardate = memchr(block, '\0', size);
+          uint32_t len = 0;
+          if (stardate++) {
+            char *end = memchr(stardate, '\0', block + size - stardate);
+            len = (end ? end : block + size) - stardate;
+          }
+          printf("  %lu: %.*s\n", off, (int)len, stardate ? stardate : "");
+        }
+      }
+    } else if (!strcmp(argv[3], "stops")) {
+      li_update(&idx);
+      for (uint32_t i = 0; i < strtable_len(&nav); i++) {
+        uint32_t count = li_count(&idx, i);
+        if (count) {
+          printf("%s: %u entries\n", get_element(&nav, i), count);
+        }
+      }
+    } else if (!strcmp(argv[3], "append") && argc > 6) {
+      li_attach(&idx);
+      // one block: "name\0STARDATE <stardate>\0payload".
+      size_t len = strlen(argv[4]) + strlen(argv[5]) + strlen(argv[6]) + 12;
+      char *entry = malloc(len);
+      int n = sprintf(entry, "%s%cSTARDATE %s%c%s", argv[4], '\0', argv[5],
+                      '\0', argv[6]);
+      if (!bl_append(entry, n, &log)) {
+        printf("log is full\n");
+        err = 1;
+      }
+      free(entry);
+      uint32_t loc = li_find(&idx, argv[4]);
+      printf("%s: %u entries\n", argv[4],
+             loc == LI_NONE ? 0 : li_count(&idx, loc));
+      err = err || li_write(&idx, argv[2]);
+    } else {
+      usage(argv[0]);
+      err = 1;
+    }
+    li_close(&idx);
+  }
+
+  bl_close(&log);
+  strtable_close(&nav);
+  return err;
+}
@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include "log_sink.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+
+enum log_level log_level = LOG_ITEM;
+enum log_mode log_mode = LOG_TEXT;
+uint64_t log_progress_every = 1000;
+
+// A thread's buffer: LOG_CHUNKS chunks, filled in order and written together.
+struct log_buffer {
+  char chunks[LOG_CHUNKS][LOG_CHUNK]; // message data
+  struct iovec iov[LOG_CHUNKS];       // filled part of each chunk
+  int cur;                            // chunk being filled
+  struct log_buffer *next;            // next thread's buffer
+};
+
+static int log_fd = STDOUT_FILENO;
+static int log_line_buffered = 0;
+static struct timespec log_start;
+static const char *level_names[] = {"item", "info", "warn", "error", "none"};
+
+// every thread's buffer (for flushing at exit), and a lock for the list and
+// for writes.
+static struct log_buffer *buffers = NULL;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct log_buffer *buffer = NULL;
+
+// Write out the chunks of buf (without locking).
+static void write_buffer(struct log_buffer *buf) {
+  int n = buf->cur + (buf->iov[buf->cur].iov_len > 0);
+  if (!n) {
+    return;
+  }
+  struct iovec *iov = buf->iov;
+  while (n > 0) {
+    ssize_t written = writev(log_fd, iov, n);
+    if (written <= 0) {
+      break;
+    }
+    // skip what was written (writes to pipes may be partial).
+    while (n > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base += written;
+      iov->iov_len -= written;
+    }
+  }
+
+  for (int i = 0; i < LOG_CHUNKS; i++) {
+    buf->iov[i].iov_base = buf->chunks[i];
+    buf->iov[i].iov_len = 0;
+  }
+  buf->cur = 0;
+}
+
+// Write out the chunks of buf.
+static void flush_buffer(struct log_buffer *buf) {
+  pthread_mutex_lock(&log_lock);
+  write_buffer(buf);
+  pthread_mutex_unlock(&log_lock);
+}
+
+// Flush every thread's buffer; other threads must not be logging.
+static void flush_all(void) {
+  for (struct log_buffer *buf = buffers; buf; buf = buf->next) {
+    flush_buffer(buf);
+  }
+}
+
+// Signal handler for crashes: write out every thread's buffer, so that output
+// up to the crash is not lost, and die of the signal. Locks are not taken (the
+// crashed thread may hold one); writev is async-signal-safe.
+static void crash_handler(int signo) {
+  for (struct log_buffer *buf = buffers; buf; buf = buf->next) {
+    write_buffer(buf);
+  }
+  // the handler was reset to the default on entry (SA_RESETHAND).
+  raise(signo);
+}
+
+// Return the calling thread's buffer, allocating it on first use.
+static struct log_buffer *get_buffer(void) {
+  if (!buffer) {
+    buffer = calloc(1, sizeof(struct log_buffer));
+    for (int i = 0; i < LOG_CHUNKS; i++) {
+      buffer->iov[i].iov_base = buffer->chunks[i];
+    }
+    pthread_mutex_lock(&log_lock);
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&log_lock);
+  }
+  return buffer;
+}
+
+// Return space for len bytes in the calling thread's buffer (flushing it if
+// needed), or NULL if len is larger than a chunk. The space is used by
+// advancing the chunk's iov_len.
+static struct iovec *reserve(size_t len) {
+  if (len > LOG_CHUNK) {
+    return NULL;
+  }
+  struct log_buffer *buf = get_buffer();
+  if (buf->iov[buf->cur].iov_len + len > LOG_CHUNK) {
+    // move to the next chunk; write the batch if this was the last.
+    if (++buf->cur == LOG_CHUNKS) {
+      buf->cur = LOG_CHUNKS - 1;
+      flush_buffer(buf);
+    }
+  }
+  return &buf->iov[buf->cur];
+}
+
+// Helper function that writes out text output to a terminal once a line is
+// complete (len bytes at str were just added), as stdio does; other output
+// waits for the batch to fill or for log_flush.
+static void line_done(const char *str, size_t len) {
+  if (log_line_buffered && log_mode == LOG_TEXT && memchr(str, '\n', len)) {
+    log_flush();
+  }
+}
+
+// Append len bytes of str to the calling thread's buffer.
+static void append(const char *str, size_t len) {
+  struct iovec *iov = reserve(len);
+  if (!iov) {
+    // too large to buffer; write it directly, after what is buffered.
+    log_flush();
+    pthread_mutex_lock(&log_lock);
+    ssize_t written = 0;
+    while (written < len) {
+      ssize_t n = write(log_fd, str + written, len - written);
+      if (n <= 0) {
+        break;
+      }
+      written += n;
+    }
+    pthread_mutex_unlock(&log_lock);
+    return;
+  }
+  memcpy(iov->iov_base + iov->iov_len, str, len);
+  iov->iov_len += len;
+  line_done(str, len);
+}
+
+// Append msg as a JSON record.
+static void append_json(enum log_level level, const char *msg) {
+  if (!msg[strspn(msg, "\n")]) {
+    // only line breaks; they only format text output.
+    return;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double t = (now.tv_sec - log_start.tv_sec) +
+             (now.tv_nsec - log_start.tv_nsec) / 1e9;
+
+  // escaping at most doubles the message (control characters are dropped).
+  size_t len = strlen(msg);
+  char *record = malloc(2 * len + 64);
+  char *out = record + sprintf(record, "{\"t\":%.6f,\"level\":\"%s\",\"msg\":\"",
+                               t, level_names[level]);
+  for (const char *c = msg; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      *out++ = '\\';
+      *out++ = *c;
+    } else if (*c == '\n') {
+      *out++ = '\\';
+      *out++ = 'n';
+    } else if ((unsigned char)*c >= 0x20) {
+      *out++ = *c;
+    }
+  }
+  out += sprintf(out, "\"}\n");
+  append(record, out - record);
+  free(record);
+}
+
+void log_init(int fd, enum log_level level, enum log_mode mode,
+              uint64_t progress_every) {
+  static int registered = 0;
+  log_fd = fd;
+  log_line_buffered = isatty(fd);
+  log_level = level;
+  log_mode = mode;
+  log_progress_every = progress_every ? progress_every : 1000;
+  if (mode == LOG_PROGRESS && log_level < LOG_WARN) {
+    // only progress (and problems) are reported.
+    log_level = LOG_WARN;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &log_start);
+  if (!registered) {
+    atexit(flush_all);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = crash_handler;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    int signals[] = {SIGSEGV, SIGBUS, SIGABRT};
+    for (int i = 0; i < 3; i++) {
+      assert(!sigaction(signals[i], &sa, NULL));
+    }
+    registered = 1;
+  }
+}
+
+void log_puts(enum log_level level, const char *str) {
+  if (log_mode == LOG_JSON) {
+    append_json(level, str);
+  } else {
+    append(str, strlen(str));
+  }
+}
+
+void log_write(enum log_level level, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+
+  if (log_mode != LOG_JSON) {
+    // format straight into the buffer if it fits in the current chunk.
+    struct log_buffer *buf = get_buffer();
+    struct iovec *iov = &buf->iov[buf->cur];
+    size_t space = LOG_CHUNK - iov->iov_len;
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(iov->iov_base + iov->iov_len, space, fmt, copy);
+    va_end(copy);
+    if (len >= 0 && len < space) {
+      iov->iov_len += len;
+      line_done(iov->iov_base + iov->iov_len - len, len);
+      va_end(args);
+      return;
+    }
+  }
+
+  // otherwise, format into a temporary buffer.
+  char *msg = NULL;
+  int len = vasprintf(&msg, fmt, args);
+  va_end(args);
+  assert(len >= 0);
+  if (log_mode == LOG_JSON) {
+    append_json(level, msg);
+  } else {
+    append(msg, len);
+  }
+  free(msg);
+}
+
+void log_progress(const char *phase, uint64_t done, uint64_t total) {
+  char line[256];
+  int len = snprintf(line, sizeof(line), "%s: %lu/%lu\n", phase, done, total);
+  append(line, len < sizeof(line) ? len : sizeof(line) - 1);
+}
+
+void log_flush(void) {
+  if (buffer) {
+    flush_buffer(buffer);
+  }
+}
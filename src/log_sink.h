@@ -0,0 +1,111 @@
+#ifndef __LOG_SINK_H__
+#define __LOG_SINK_H__
+
+#include <stdint.h>
+
+// ----------------------
+// buffered console output
+// ----------------------
+//
+// The log sink collects output in pre-allocated per-thread buffers and writes
+// it with writev rather than through stdio, in batches (one writev per
+// LOG_CHUNKS chunks of LOG_CHUNK bytes). Like stdout, text output to a
+// terminal is written a line at a time instead.
+//
+// Typical usage:
+//
+//    log_init(STDOUT_FILENO, LOG_ITEM, LOG_TEXT, 0);
+//
+//    LOG(LOG_INFO, "[    0.059309] LOADING [%p]\n", start);
+//    for (int i = 0; i < len; i++) {
+//      LOG_STR(LOG_ITEM, ".");
+//      LOG_PROGRESS("validating", i + 1, len);
+//    }
+//
+//    // at the end of a phase, and before anything else writes to the same file
+//    log_flush();
+//
+// Messages below the current level are skipped before any formatting, by a
+// single comparison in the LOG macros.
+//
+// Output modes:
+//   LOG_TEXT     messages are written as they are formatted (each line as soon
+//                as it is complete, if writing to a terminal).
+//   LOG_JSON     each message is written as one JSON object per line:
+//                  {"t":0.001234,"level":"info","msg":"..."}
+//                where t is seconds since log_init.
+//   LOG_PROGRESS only progress reports (and warnings and errors) are written,
+//                once every progress_every elements and at the end of each
+//                phase:
+//                  validating: 3200/10000
+//
+// Each thread has its own buffer, so threads may log without locking; batches
+// are written whole. Buffers are flushed by log_flush (the calling thread's),
+// when full (or at the end of a text line to a terminal), and at exit (every
+// thread's).
+// log_init also installs handlers for SIGSEGV, SIGBUS and SIGABRT (a failed
+// assert) that flush every buffer before the process dies of the signal.
+
+// Size of each buffer chunk, and chunks per thread.
+#define LOG_CHUNK 4096
+#define LOG_CHUNKS 16
+
+enum log_level {
+  LOG_ITEM,  // per-element detail
+  LOG_INFO,  // phase messages
+  LOG_WARN,  // problems that don't stop a phase
+  LOG_ERROR, // problems that do
+  LOG_NONE,  // level that skips all messages
+};
+
+enum log_mode {
+  LOG_TEXT,     // plain text
+  LOG_JSON,     // one JSON object per message
+  LOG_PROGRESS, // progress reports only
+};
+
+// current level and mode (read by the LOG macros; set with log_init).
+extern enum log_level log_level;
+extern enum log_mode log_mode;
+extern uint64_t log_progress_every;
+
+// Log a printf-style message at level.
+#define LOG(level, ...)                                                        \
+  do {                                                                         \
+    if ((level) >= log_level) {                                                \
+      log_write((level), __VA_ARGS__);                                         \
+    }                                                                          \
+  } while (0)
+
+// Log a fixed string at level (without formatting it).
+#define LOG_STR(level, str)                                                    \
+  do {                                                                         \
+    if ((level) >= log_level) {                                                \
+      log_puts((level), (str));                                                \
+    }                                                                          \
+  } while (0)
+
+// Report that done of total elements of a phase are done (progress mode only).
+#define LOG_PROGRESS(phase, done, total)                                       \
+  do {                                                                         \
+    if (log_mode == LOG_PROGRESS &&                                            \
+        ((done) % log_progress_every == 0 || (done) == (total))) {             \
+      log_progress((phase), (done), (total));                                  \
+    }                                                                          \
+  } while (0)
+
+// Set up the sink to write to fd, skipping messages below level. In progress
+// mode, progress is reported every progress_every elements (1000 if 0).
+void log_init(int fd, enum log_level level, enum log_mode mode,
+              uint64_t progress_every);
+
+// Log a message (use the LOG macros, which check the level first).
+void log_write(enum log_level level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void log_puts(enum log_level level, const char *str);
+void log_progress(const char *phase, uint64_t done, uint64_t total);
+
+// Write out the calling thread's buffered messages.
+void log_flush(void);
+
+#endif
@@ -0,0 +1,43 @@
+#include "boot_image.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void usage(const char *name) {
+  printf("usage: %s params nav log out [-v]\n"
+         "  packs params array params, nav table nav and flight log log into\n"
+         "  the boot image out.img. -v verifies and prints its manifest.\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 5) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (boot_image_write(argv[1], argv[2], argv[3], argv[4])) {
+    printf("invalid params, nav table or log; no image written\n");
+    return 1;
+  }
+  printf("wrote %s.img\n", argv[4]);
+
+  if (argc > 5 && !strcmp(argv[5], "-v")) {
+    boot_image_t img;
+    if (boot_image_open(argv[4], &img)) {
+      printf("invalid image!\n");
+      return 1;
+    }
+    for (int i = 0; i < img.header->nsections; i++) {
+      struct boot_image_section *s = &img.sections[i];
+      printf("%-8.8s offset %8lu size %8lu value %8lu checksum %016lx %s\n",
+             s->name, s->off, s->size, s->value, s->checksum,
+             boot_image_verify(&img, s->name) ? "OK" : "BAD");
+    }
+    printf("sources %s\n",
+           boot_image_current(&img, argv[1], argv[2], argv[3]) ? "current"
+                                                               : "CHANGED");
+    boot_image_close(&img);
+  }
+  return 0;
+}
@@ -1,20 +1,49 @@
 #include "mm_util.h"
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "stats.h"
 #include "util.h"
 
-void mm_open(const char *fname, size_t size, mm_region_t *region) {
+// A live mapping that can be shared by repeat opens of the same file.
+struct mm_cache_entry {
+  char *path;                  // path the file was first opened with
+  dev_t dev;                   // device of mapped file
+  ino_t ino;                   // inode of mapped file
+  mm_region_t region;          // the mapping
+  int refs;                    // number of opens not yet closed
+  struct mm_cache_entry *next; // next live mapping
+};
+
+// List of live mappings, protected by cache_lock.
+static struct mm_cache_entry *cache = NULL;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Helper function that returns the live mapping of the given file, or NULL.
+static struct mm_cache_entry *cache_find(dev_t dev, ino_t ino) {
+  for (struct mm_cache_entry *e = cache; e; e = e->next) {
+    if (e->dev == dev && e->ino == ino) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+// Helper function that maps a file (the original, uncached mm_open).
+static void map_file(const char *fname, size_t size, mm_region_t *region) {
   region->fd = open(fname, O_RDWR | O_CREAT, 0600);
   assert(region->fd != -1);
 
-  uint32_t tsize = size;
+  size_t tsize = size;
   if (size) {
     // size > 0 -> initial open
     int err = posix_fallocate(region->fd, 0, size);
@@ -24,7 +53,7 @@ void mm_open(const char *fname, size_t size, mm_region_t *region) {
     struct stat stat;
     assert(!fstat(region->fd, &stat));
     tsize = stat.st_size;
-    DEBUG_PRINT("%s exists with size %lu, opening...\n", fname, size);
+    DEBUG_PRINT("%s exists with size %lu, opening...\n", fname, tsize);
   }
 
   void *base =
@@ -33,11 +62,230 @@ void mm_open(const char *fname, size_t size, mm_region_t *region) {
 
   region->start = base;
   region->size = tsize;
+  region->flags = MAP_SHARED;
 
   DEBUG_PRINT("table opened at address %p\n", region->start);
 }
 
+void mm_open(const char *fname, size_t size, mm_region_t *region) {
+  STATS_BEGIN(STATS_MM_OPEN);
+  pthread_mutex_lock(&cache_lock);
+
+  struct stat st;
+  struct mm_cache_entry *e = NULL;
+  if (!stat(fname, &st)) {
+    e = cache_find(st.st_dev, st.st_ino);
+  }
+  if (e && !size) {
+    // file is already mapped; share the mapping.
+    DEBUG_PRINT("%s already mapped at %p (as %s)\n", fname, e->region.start,
+                e->path);
+    e->refs++;
+    *region = e->region;
+    goto out;
+  }
+
+  // creating a mapped file would reinitialize it under its other users.
+  assert(!e);
+
+  map_file(fname, size, region);
+
+  // only one mapping of a file is shared; any other is private to the caller.
+  assert(!fstat(region->fd, &st));
+  if (!cache_find(st.st_dev, st.st_ino)) {
+    e = malloc(sizeof(struct mm_cache_entry));
+    e->path = strdup(fname);
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->region = *region;
+    e->refs = 1;
+    e->next = cache;
+    cache = e;
+  }
+
+out:
+  pthread_mutex_unlock(&cache_lock);
+  STATS_END(STATS_MM_OPEN);
+}
+
+int mm_pin(const char *fname, mm_region_t *region) {
+  pthread_mutex_lock(&cache_lock);
+
+  struct stat st;
+  int fd = -1;
+  struct mm_cache_entry *e = NULL;
+  if (!stat(fname, &st)) {
+    e = cache_find(st.st_dev, st.st_ino);
+  }
+  if (!e) {
+    fd = open(fname, O_RDWR);
+    if (fd == -1 || fstat(fd, &st) || !st.st_size) {
+      goto fail;
+    }
+    void *base =
+        mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+      goto fail;
+    }
+    e = malloc(sizeof(struct mm_cache_entry));
+    e->path = strdup(fname);
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->region = (mm_region_t){base, st.st_size, fd, MAP_SHARED};
+    e->refs = 0;
+    e->next = cache;
+    cache = e;
+  }
+  e->refs++;
+  *region = e->region;
+  pthread_mutex_unlock(&cache_lock);
+  return 0;
+
+fail:
+  if (fd != -1) {
+    close(fd);
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return -1;
+}
+
+void mm_open_private(const char *fname, mm_region_t *region) {
+  region->fd = open(fname, O_RDONLY);
+  assert(region->fd != -1);
+
+  struct stat stat;
+  assert(!fstat(region->fd, &stat));
+  void *base = mmap(NULL, stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    region->fd, 0);
+  assert(base != MAP_FAILED);
+
+  region->start = base;
+  region->size = stat.st_size;
+  region->flags = MAP_PRIVATE;
+  DEBUG_PRINT("%s mapped privately at address %p\n", fname, region->start);
+}
+
+void mm_release(mm_region_t *region, void *addr, size_t len) {
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)addr & ~(page - 1);
+  uintptr_t end = ((uintptr_t)addr + len) & ~(page - 1);
+  if (end <= start) {
+    return;
+  }
+  // written pages of private (or unknown borrowed) mappings exist only in
+  // memory, so they are paged out rather than dropped.
+  int shared = region->flags & MAP_SHARED;
+  madvise((void *)start, end - start, shared ? MADV_DONTNEED : MADV_PAGEOUT);
+}
+
 void mm_close(mm_region_t *region) {
+  if (region->fd == -1) {
+    // borrowed; the lender unmaps it.
+    return;
+  }
+  pthread_mutex_lock(&cache_lock);
+
+  struct mm_cache_entry **prev = &cache;
+  struct mm_cache_entry *e = cache;
+  while (e && e->region.start != region->start) {
+    prev = &e->next;
+    e = e->next;
+  }
+  if (e && --e->refs) {
+    // mapping is still in use.
+    pthread_mutex_unlock(&cache_lock);
+    return;
+  }
+  if (e) {
+    // last close; forget the mapping.
+    *prev = e->next;
+    free(e->path);
+    free(e);
+  }
+
   munmap(region->start, region->size);
   close(region->fd);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void mm_window_open(const char *fname, size_t window_size, int nwindows,
+                    mm_window_t *win) {
+  assert(win);
+  size_t page = sysconf(_SC_PAGESIZE);
+  window_size = window_size ? window_size : MM_WINDOW_SIZE;
+  win->window_size = (window_size + page - 1) / page * page;
+  win->nwindows = nwindows ? nwindows : MM_WINDOWS;
+  // the window used by the last get must never be the one replaced.
+  assert(win->nwindows >= 2);
+
+  win->fd = open(fname, O_RDWR);
+  assert(win->fd != -1);
+  struct stat stat;
+  assert(!fstat(win->fd, &stat));
+  win->size = stat.st_size;
+
+  win->windows = calloc(win->nwindows, sizeof(struct mm_window));
+  win->clock = 0;
+  DEBUG_PRINT("%s opened for windowed access (%d x %lu bytes)\n", fname,
+              win->nwindows, win->window_size);
+}
+
+// Helper function that unmaps window w.
+static void unmap_window(struct mm_window *w) {
+  munmap(w->start, w->len);
+  w->start = NULL;
+}
+
+void *mm_window_get(mm_window_t *win, size_t off, size_t len) {
+  if (off + len > win->size) {
+    return NULL;
+  }
+
+  // use a window that holds the range, or else replace the least recently
+  // used (or an unused) window.
+  struct mm_window *lru = &win->windows[0];
+  for (int i = 0; i < win->nwindows; i++) {
+    struct mm_window *w = &win->windows[i];
+    if (w->start && off >= w->off && off + len <= w->off + w->len) {
+      w->used = ++win->clock;
+      return w->start + (off - w->off);
+    }
+    if (!w->start || (lru->start && w->used < lru->used)) {
+      lru = w;
+    }
+  }
+  if (lru->start) {
+    unmap_window(lru);
+  }
+
+  // map from the page holding off, for at least window_size bytes.
+  size_t page = sysconf(_SC_PAGESIZE);
+  lru->off = off / page * page;
+  lru->len = off + len - lru->off;
+  if (lru->len < win->window_size) {
+    lru->len = win->window_size;
+  }
+  if (lru->off + lru->len > win->size) {
+    lru->len = win->size - lru->off;
+  }
+  lru->start = mmap(NULL, lru->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    win->fd, lru->off);
+  assert(lru->start != MAP_FAILED);
+  lru->used = ++win->clock;
+  return lru->start + (off - lru->off);
+}
+
+void mm_window_release(mm_window_t *win, size_t off) {
+  for (int i = 0; i < win->nwindows; i++) {
+    struct mm_window *w = &win->windows[i];
+    if (w->start && w->off + w->len <= off) {
+      unmap_window(w);
+    }
+  }
+}
+
+void mm_window_close(mm_window_t *win) {
+  mm_window_release(win, SIZE_MAX);
+  free(win->windows);
+  close(win->fd);
 }
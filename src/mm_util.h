@@ -2,15 +2,124 @@
 #define __MM_UTIL_H__
 
 #include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef struct mm_region_t mm_region_t;
 struct mm_region_t {
   void *start; // pointer to start of memory region
   size_t size; // total size of memory region
-  int fd;      // file descriptor for mmap'ed file
+  int fd;      // file descriptor for mmap'ed file, or -1 if borrowed
+  int flags;   // mmap flags (MAP_SHARED or MAP_PRIVATE) of the mapping
 };
 
+// A region may also borrow part of a mapping made by someone else (such as a
+// section of a boot image, see boot_image.h), in which case its fd is -1 and
+// its flags are the lender's (0 if unknown). Closing a borrowed region does
+// nothing; the lender unmaps it.
+
+// Map a file into memory. If size is nonzero, the file is created (or
+// extended) to be size bytes; otherwise the whole existing file is mapped.
+//
+// Mappings are shared: opening a file that is already mapped (the same inode,
+// whatever the path used to reach it) with size zero returns the live mapping
+// instead of mapping it again. The mapping is reference counted and only
+// unmapped by the last mm_close. Creating (size nonzero) a file that is
+// already mapped is an error, since it would reinitialize the file under the
+// mapping's other users.
 void mm_open(const char *fname, size_t size, mm_region_t *region);
+
+// Keep a file mapped, so that later mm_opens of it (with size zero) share the
+// mapping, until region is passed to mm_close. Unlike mm_open, this is quiet:
+// it returns -1 (and does nothing) if the file does not exist or cannot be
+// mapped, and 0 once it is pinned. The contents are not read.
+int mm_pin(const char *fname, mm_region_t *region);
+
+// Map an existing file privately (copy-on-write). Pages are shared with the
+// file until they are written; writes are never written back to the file.
+// Private mappings are never shared with other opens.
+void mm_open_private(const char *fname, mm_region_t *region);
+
+// Tell the kernel that the pages of region from addr to addr + len will not be
+// used again soon, so their memory can be reclaimed. Contents are kept: a later
+// access faults the page back in. Only whole pages are released (the partial
+// page at the end of the range is not).
+void mm_release(mm_region_t *region, void *addr, size_t len);
+
+// Release a mapped region (borrowed regions are left mapped).
 void mm_close(mm_region_t *region);
 
+// ---------------------
+// windowed file access
+// ---------------------
+//
+// A windowed file is accessed through a bounded number of mappings (windows)
+// of part of the file, rather than one mapping of the whole file, so that
+// neither the address space nor the memory used grows with the file size.
+//
+// Typical usage:
+//
+//    mm_window_t win;
+//    mm_window_open(filename, 0, 0, &win);
+//    for (size_t off = 0; off + len <= win.size; off += len) {
+//      char *rec = mm_window_get(&win, off, len);
+//      ...
+//      // done with everything before off
+//      mm_window_release(&win, off);
+//    }
+//    mm_window_close(&win);
+//
+// mm_window_get maps a window starting at (or just before) the requested range
+// if no current window holds it. At most nwindows windows are mapped; when
+// another is needed, the least recently used window is unmapped. A pointer
+// returned by mm_window_get is valid until its window is unmapped: at least
+// until the next call to mm_window_get, and as long as fewer than nwindows other
+// windows have been used since. Windows are window_size bytes, or larger if a
+// single request needs more. Windowed files are not thread-safe; use one
+// mm_window_t per thread.
+
+// Default window size and count.
+#define MM_WINDOW_SIZE ((size_t)16 << 20)
+#define MM_WINDOWS 8
+
+// One mapped window.
+struct mm_window {
+  void *start;   // pointer to start of window, or NULL if unused
+  size_t off;    // file offset of window start
+  size_t len;    // length of window
+  uint64_t used; // clock value at last use
+};
+
+typedef struct mm_window_t mm_window_t;
+struct mm_window_t {
+  int fd;                    // file descriptor of file
+  size_t size;               // size of file
+  size_t window_size;        // default size of each window
+  int nwindows;              // maximum windows mapped at once
+  struct mm_window *windows; // windows
+  uint64_t clock;            // use counter (for LRU replacement)
+};
+
+// Open an existing file for windowed access, using at most nwindows windows of
+// window_size bytes (defaults are used for zero values).
+void mm_window_open(const char *fname, size_t window_size, int nwindows,
+                    mm_window_t *win);
+
+// Return a pointer to bytes off to off + len of the file, or NULL if that is
+// past the end of the file.
+void *mm_window_get(mm_window_t *win, size_t off, size_t len);
+
+// Unmap windows that lie wholly before file offset off.
+void mm_window_release(mm_window_t *win, size_t off);
+
+// Unmap all windows and close the file.
+void mm_window_close(mm_window_t *win);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
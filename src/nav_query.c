@@ -0,0 +1,512 @@
+#include "nav_query.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// names of the fields, in element order.
+static const char *field_names[NQ_FIELDS] = {"lon", "lat", "dist", "name"};
+
+// ---------
+// compiling
+// ---------
+
+// parser state
+struct parser {
+  const char *expr; // whole expression
+  const char *p;    // current position
+  nav_query_t *q;   // query being compiled
+};
+
+// Helper function that records a compile error at the current position.
+static int error(struct parser *ps, const char *msg) {
+  ps->q->error = msg;
+  ps->q->error_pos = ps->p - ps->expr;
+  return -1;
+}
+
+static void skip_space(struct parser *ps) {
+  while (isspace((unsigned char)*ps->p)) {
+    ps->p++;
+  }
+}
+
+// Helper function that consumes the keyword kw if it is next. Returns nonzero
+// if it was.
+static int keyword(struct parser *ps, const char *kw) {
+  skip_space(ps);
+  size_t len = strlen(kw);
+  if (strncmp(ps->p, kw, len) ||
+      isalnum((unsigned char)ps->p[len]) || ps->p[len] == '_') {
+    return 0;
+  }
+  ps->p += len;
+  return 1;
+}
+
+// Helper function that consumes the symbol sym if it is next.
+static int symbol(struct parser *ps, const char *sym) {
+  skip_space(ps);
+  size_t len = strlen(sym);
+  if (strncmp(ps->p, sym, len)) {
+    return 0;
+  }
+  ps->p += len;
+  return 1;
+}
+
+// Helper function that appends an instruction. Returns its index.
+static uint32_t emit(nav_query_t *q, enum nq_op op) {
+  if (q->len == q->cap) {
+    q->cap = q->cap ? 2 * q->cap : 16;
+    q->code = realloc(q->code, q->cap * sizeof(struct nq_insn));
+  }
+  struct nq_insn *insn = &q->code[q->len];
+  memset(insn, 0, sizeof(*insn));
+  insn->op = op;
+  return q->len++;
+}
+
+static int number(struct parser *ps, double *v) {
+  skip_space(ps);
+  char *end;
+  *v = strtod(ps->p, &end);
+  if (end == ps->p) {
+    return error(ps, "expected a number");
+  }
+  ps->p = end;
+  return 0;
+}
+
+static int string(struct parser *ps, struct nq_insn *insn) {
+  skip_space(ps);
+  char quote = *ps->p;
+  if (quote != '\'' && quote != '"') {
+    return error(ps, "expected a quoted string");
+  }
+  const char *end = strchr(ps->p + 1, quote);
+  if (!end) {
+    return error(ps, "unterminated string");
+  }
+  insn->str_len = end - ps->p - 1;
+  insn->str = strndup(ps->p + 1, insn->str_len);
+  ps->p = end + 1;
+  return 0;
+}
+
+static int parse_expr(struct parser *ps);
+
+// pred := num_field cmp number | num_field 'between' number 'and' number
+//       | 'name' ('=' | 'prefix' | 'contains') string
+static int parse_pred(struct parser *ps) {
+  nav_query_t *q = ps->q;
+  int field = -1;
+  for (int f = 0; f < NQ_FIELDS && field < 0; f++) {
+    if (keyword(ps, field_names[f])) {
+      field = f;
+    }
+  }
+  if (field < 0) {
+    return error(ps, "expected a field (lon, lat, dist or name)");
+  }
+
+  if (field == NQ_NAME) {
+    enum nq_op op;
+    if (symbol(ps, "=")) {
+      op = NQ_NAME_EQ;
+    } else if (keyword(ps, "prefix")) {
+      op = NQ_PREFIX;
+    } else if (keyword(ps, "contains")) {
+      op = NQ_CONTAINS;
+    } else {
+      return error(ps, "expected =, prefix or contains");
+    }
+    uint32_t i = emit(q, op);
+    return string(ps, &q->code[i]);
+  }
+
+  // numeric predicates are all ranges (!= is the complement of =).
+  uint32_t i = emit(q, NQ_RANGE);
+  struct nq_insn *insn = &q->code[i];
+  insn->field = field;
+  insn->lo = -HUGE_VAL;
+  insn->hi = HUGE_VAL;
+  double v;
+  int negate = 0;
+  if (keyword(ps, "between")) {
+    if (number(ps, &insn->lo) || !keyword(ps, "and") ||
+        number(ps, &insn->hi)) {
+      return q->error ? -1 : error(ps, "expected 'and'");
+    }
+  } else if (symbol(ps, "<=")) {
+    if (number(ps, &v)) {
+      return -1;
+    }
+    insn->hi = v;
+  } else if (symbol(ps, ">=")) {
+    if (number(ps, &v)) {
+      return -1;
+    }
+    insn->lo = v;
+  } else if (symbol(ps, "!=")) {
+    if (number(ps, &v)) {
+      return -1;
+    }
+    insn->lo = insn->hi = v;
+    negate = 1;
+  } else if (symbol(ps, "<")) {
+    if (number(ps, &v)) {
+      return -1;
+    }
+    insn->hi = v;
+    insn->hi_open = 1;
+  } else if (symbol(ps, ">")) {
+    if (number(ps, &v)) {
+      return -1;
+    }
+    insn->lo = v;
+    insn->lo_open = 1;
+  } else if (symbol(ps, "=")) {
+    if (number(ps, &v)) {
+      return -1;
+    }
+    insn->lo = insn->hi = v;
+  } else {
+    return error(ps, "expected a comparison");
+  }
+  if (negate) {
+    emit(q, NQ_NOT);
+  }
+  return 0;
+}
+
+// factor := 'not' factor | '(' expr ')' | pred
+static int parse_factor(struct parser *ps) {
+  if (keyword(ps, "not")) {
+    if (parse_factor(ps)) {
+      return -1;
+    }
+    emit(ps->q, NQ_NOT);
+    return 0;
+  }
+  if (symbol(ps, "(")) {
+    if (parse_expr(ps)) {
+      return -1;
+    }
+    return symbol(ps, ")") ? 0 : error(ps, "expected )");
+  }
+  return parse_pred(ps);
+}
+
+// term := factor ('and' factor)*
+static int parse_term(struct parser *ps) {
+  if (parse_factor(ps)) {
+    return -1;
+  }
+  while (keyword(ps, "and")) {
+    // skip the right side (and the NQ_AND) if the left matched nothing.
+    uint32_t jump = emit(ps->q, NQ_JZ);
+    if (parse_factor(ps)) {
+      return -1;
+    }
+    emit(ps->q, NQ_AND);
+    ps->q->code[jump].skip = ps->q->len - jump - 1;
+  }
+  return 0;
+}
+
+// expr := term ('or' term)*
+static int parse_expr(struct parser *ps) {
+  if (parse_term(ps)) {
+    return -1;
+  }
+  while (keyword(ps, "or")) {
+    // skip the right side (and the NQ_OR) if the left matched everything.
+    uint32_t jump = emit(ps->q, NQ_JALL);
+    if (parse_term(ps)) {
+      return -1;
+    }
+    emit(ps->q, NQ_OR);
+    ps->q->code[jump].skip = ps->q->len - jump - 1;
+  }
+  return 0;
+}
+
+int nav_query_compile(const char *expr, nav_query_t *q) {
+  assert(q);
+  memset(q, 0, sizeof(*q));
+  struct parser ps = {expr, expr, q};
+  int err = parse_expr(&ps);
+  skip_space(&ps);
+  if (!err && *ps.p) {
+    err = error(&ps, "unexpected input");
+  }
+
+  // the stack depth of a program is its nesting: skipped code (the right side
+  // of an and/or, and the and/or) leaves the depth unchanged.
+  int depth = 0;
+  for (uint32_t i = 0; !err && i < q->len; i++) {
+    uint8_t op = q->code[i].op;
+    depth += op <= NQ_CONTAINS ? 1 : (op == NQ_AND || op == NQ_OR) ? -1 : 0;
+    if (depth > NQ_MAX_DEPTH) {
+      q->error = "expression is nested too deeply";
+      q->error_pos = 0;
+      err = -1;
+    }
+  }
+
+  if (err) {
+    const char *msg = q->error;
+    int pos = q->error_pos;
+    nav_query_free(q);
+    q->error = msg;
+    q->error_pos = pos;
+    return -1;
+  }
+  DEBUG_PRINT("compiled %u instructions\n", q->len);
+  return 0;
+}
+
+void nav_query_free(nav_query_t *q) {
+  for (uint32_t i = 0; i < q->len; i++) {
+    free(q->code[i].str);
+  }
+  free(q->code);
+  memset(q, 0, sizeof(*q));
+}
+
+// -------
+// running
+// -------
+
+// one batch's elements, and their fields as far as they have been needed.
+struct batch {
+  const char *start[NQ_FIELDS][NQ_BATCH]; // field starts, NULL if missing
+  double num[NQ_NAME][NQ_BATCH];          // numeric fields, NaN if invalid
+  int located;                            // fields with starts set
+  uint8_t parsed[NQ_NAME];                // nonzero if num[f] is set
+  int n;                                  // number of elements
+  uint64_t valid;                         // mask of the batch's elements
+};
+
+// powers of ten for parse_num.
+static const double pow10s[] = {1e0, 1e1, 1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+
+// Helper function that parses a decimal number ([-]digits[.digits]) ending at
+// ';' or the end of the element, without strtod. The digits are collected as
+// one integer and scaled once, which rounds exactly like strtod for up to 15
+// digits; longer numbers fall back to strtod. Returns NaN if s is not a number.
+static double parse_num(const char *s) {
+  const char *c = s;
+  int neg = *c == '-';
+  c += neg;
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int frac = -1;
+  for (;; c++) {
+    if (*c >= '0' && *c <= '9') {
+      mantissa = mantissa * 10 + (*c - '0');
+      digits++;
+      frac += frac >= 0;
+    } else if (*c == '.' && frac < 0) {
+      frac = 0;
+    } else {
+      break;
+    }
+  }
+  if (!digits || (*c && *c != ';')) {
+    return NAN;
+  }
+  if (digits > 15) {
+    return strtod(s, NULL);
+  }
+  double v = frac > 0 ? mantissa / pow10s[frac] : (double)mantissa;
+  return neg ? -v : v;
+}
+
+// Helper function that finds the starts of fields up to f for the batch.
+static void locate(struct batch *b, int f) {
+  for (; b->located <= f; b->located++) {
+    const char **prev = b->start[b->located - 1];
+    const char **cur = b->start[b->located];
+    for (int i = 0; i < b->n; i++) {
+      const char *sep = prev[i] ? strchr(prev[i], ';') : NULL;
+      cur[i] = sep ? sep + 1 : NULL;
+    }
+  }
+}
+
+// Helper function that parses numeric field f for the batch.
+static double *column(struct batch *b, int f) {
+  if (!b->parsed[f]) {
+    locate(b, f);
+    for (int i = 0; i < b->n; i++) {
+      const char *s = b->start[f][i];
+      b->num[f][i] = s ? parse_num(s) : NAN;
+    }
+    b->parsed[f] = 1;
+  }
+  return b->num[f];
+}
+
+// Helper function that evaluates a name predicate for the batch.
+static uint64_t name_mask(struct batch *b, struct nq_insn *insn) {
+  locate(b, NQ_NAME);
+  uint64_t mask = 0;
+  for (int i = 0; i < b->n; i++) {
+    const char *name = b->start[NQ_NAME][i];
+    int match = 0;
+    if (name && insn->op == NQ_PREFIX) {
+      match = !strncmp(name, insn->str, insn->str_len);
+    } else if (name && insn->op == NQ_NAME_EQ) {
+      match = !strcmp(name, insn->str);
+    } else if (name) {
+      match = strstr(name, insn->str) != NULL;
+    }
+    mask |= (uint64_t)match << i;
+  }
+  return mask;
+}
+
+// Helper function that runs the program over one batch. Returns the mask of
+// matching elements.
+static uint64_t run_batch(nav_query_t *q, struct batch *b) {
+  uint64_t stack[NQ_MAX_DEPTH];
+  int sp = 0;
+  for (uint32_t pc = 0; pc < q->len; pc++) {
+    struct nq_insn *insn = &q->code[pc];
+    switch (insn->op) {
+    case NQ_RANGE: {
+      double *v = column(b, insn->field);
+      double lo = insn->lo;
+      double hi = insn->hi;
+      int lo_closed = !insn->lo_open;
+      int hi_closed = !insn->hi_open;
+      uint64_t mask = 0;
+      for (int i = 0; i < b->n; i++) {
+        // NaN (missing or invalid) compares false.
+        int match = (v[i] > lo || (lo_closed && v[i] == lo)) &&
+                    (v[i] < hi || (hi_closed && v[i] == hi));
+        mask |= (uint64_t)match << i;
+      }
+      stack[sp++] = mask;
+      break;
+    }
+    case NQ_NAME_EQ:
+    case NQ_PREFIX:
+    case NQ_CONTAINS:
+      stack[sp++] = name_mask(b, insn);
+      break;
+    case NQ_AND:
+      sp--;
+      stack[sp - 1] &= stack[sp];
+      break;
+    case NQ_OR:
+      sp--;
+      stack[sp - 1] |= stack[sp];
+      break;
+    case NQ_NOT:
+      stack[sp - 1] = ~stack[sp - 1] & b->valid;
+      break;
+    case NQ_JZ:
+      if (!stack[sp - 1]) {
+        pc += insn->skip;
+      }
+      break;
+    case NQ_JALL:
+      if (stack[sp - 1] == b->valid) {
+        pc += insn->skip;
+      }
+      break;
+    }
+  }
+  assert(sp == 1);
+  return stack[0];
+}
+
+// A thread's range of elements, and its results.
+struct nq_slice {
+  nav_query_t *q;    // query
+  strtable_t *tbl;   // table
+  uint32_t lo, hi;   // range of element indices
+  uint32_t *matches; // where to put matching indices, or NULL
+  uint32_t count;    // number of matches
+};
+
+static void *run_slice(void *arg) {
+  struct nq_slice *s = arg;
+  struct batch *b = malloc(sizeof(struct batch));
+  s->count = 0;
+  for (uint32_t base = s->lo; base < s->hi; base += NQ_BATCH) {
+    b->n = s->hi - base < NQ_BATCH ? s->hi - base : NQ_BATCH;
+    b->valid = b->n == 64 ? UINT64_MAX : (1ULL << b->n) - 1;
+    for (int i = 0; i < b->n; i++) {
+      b->start[0][i] = get_element(s->tbl, base + i);
+    }
+    b->located = 1;
+    memset(b->parsed, 0, sizeof(b->parsed));
+
+    uint64_t mask = run_batch(s->q, b);
+    if (s->matches) {
+      while (mask) {
+        s->matches[s->count++] = base + __builtin_ctzll(mask);
+        mask &= mask - 1;
+      }
+    } else {
+      s->count += __builtin_popcountll(mask);
+    }
+  }
+  free(b);
+  return NULL;
+}
+
+uint32_t nav_query_run(nav_query_t *q, strtable_t *tbl, int nthreads,
+                       uint32_t *matches) {
+  uint32_t len = strtable_len(tbl);
+  uint32_t batches = (len + NQ_BATCH - 1) / NQ_BATCH;
+  nthreads = nthreads ? nthreads : sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > batches) {
+    nthreads = batches ? batches : 1;
+  }
+
+  // each thread gets whole batches, and writes its matches where its range
+  // starts in matches.
+  uint32_t width = (batches + nthreads - 1) / nthreads * NQ_BATCH;
+  struct nq_slice *slices = malloc(nthreads * sizeof(struct nq_slice));
+  pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+  for (int t = 0; t < nthreads; t++) {
+    struct nq_slice *s = &slices[t];
+    s->q = q;
+    s->tbl = tbl;
+    s->lo = (uint64_t)t * width < len ? t * width : len;
+    s->hi = (uint64_t)s->lo + width < len ? s->lo + width : len;
+    s->matches = matches ? matches + s->lo : NULL;
+    if (nthreads == 1) {
+      run_slice(s);
+    } else {
+      pthread_create(&threads[t], NULL, run_slice, s);
+    }
+  }
+
+  // gather the matches at the front, in order.
+  uint32_t total = 0;
+  for (int t = 0; t < nthreads; t++) {
+    if (nthreads > 1) {
+      pthread_join(threads[t], NULL);
+    }
+    if (matches) {
+      memmove(matches + total, slices[t].matches,
+              slices[t].count * sizeof(uint32_t));
+    }
+    total += slices[t].count;
+  }
+  free(threads);
+  free(slices);
+  return total;
+}
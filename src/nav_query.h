@@ -0,0 +1,119 @@
+#ifndef __NAV_QUERY_H__
+#define __NAV_QUERY_H__
+
+#include <stdint.h>
+
+#include "strtable.h"
+
+typedef struct nav_query_t nav_query_t;
+
+// -----------------------------
+// nav catalog filter queries
+// -----------------------------
+//
+// A nav query is a filter expression over the "lon;lat;dist;name" elements of
+// a nav table, compiled to a small bytecode program and run over the table in
+// batches, on several threads.
+//
+// Typical usage:
+//
+//    nav_query_t q;
+//    if (nav_query_compile("dist < 1000 or (lat between -2 and 2 and "
+//                          "name prefix 'HD')", &q)) {
+//      printf("%s at %d\n", q.error, q.error_pos);
+//    }
+//    uint32_t *matches = malloc(strtable_len(&nav) * sizeof(uint32_t));
+//    uint32_t n = nav_query_run(&q, &nav, 0, matches);
+//    // matches[0..n-1] are the indices of matching elements, in order
+//    nav_query_free(&q);
+//
+// Expressions:
+//
+//    expr := term ('or' term)*
+//    term := factor ('and' factor)*
+//    factor := 'not' factor | '(' expr ')' | pred
+//    pred := num_field ('<' | '<=' | '>' | '>=' | '=' | '!=') number
+//          | num_field 'between' number 'and' number    (inclusive)
+//          | 'name' ('=' | 'prefix' | 'contains') string
+//    num_field := 'lon' | 'lat' | 'dist'
+//
+// Strings are quoted with ' or ".
+//
+// Programs work on masks of a batch of NQ_BATCH (64) elements, one bit per
+// element, kept on a small stack: each predicate pushes the mask of the
+// batch's elements that satisfy it, and 'and', 'or' and 'not' combine masks.
+// The interpreter's cost is thus paid once per instruction per batch rather
+// than per element. The right side of an 'and' is skipped for batches where
+// the left side matched nothing (and of an 'or', where it matched everything).
+//
+// Fields are only located and parsed as predicates need them, once per batch:
+// a numeric predicate skips to its field and parses only that number (with a
+// small decimal parser rather than strtod), and no field past the last one used
+// is looked at. Elements that lack a field never match predicates on it.
+//
+// The table is split into one contiguous range of batches per thread.
+
+// Number of elements in a batch (bits in a mask).
+#define NQ_BATCH 64
+// Maximum depth of the mask stack (nesting of an expression).
+#define NQ_MAX_DEPTH 32
+
+// element fields
+enum nq_field {
+  NQ_LON,
+  NQ_LAT,
+  NQ_DIST,
+  NQ_NAME,
+  NQ_FIELDS, // number of fields
+};
+
+// instructions
+enum nq_op {
+  NQ_RANGE,    // push mask of lo < or <= field < or <= hi
+  NQ_NAME_EQ,  // push mask of name equal to str
+  NQ_PREFIX,   // push mask of name starting with str
+  NQ_CONTAINS, // push mask of name containing str
+  NQ_AND,      // pop two masks, push their intersection
+  NQ_OR,       // pop two masks, push their union
+  NQ_NOT,      // replace the top mask with its complement
+  NQ_JZ,       // skip skip instructions if the top mask is empty
+  NQ_JALL,     // skip skip instructions if the top mask is full
+};
+
+// one instruction
+struct nq_insn {
+  uint8_t op;       // enum nq_op
+  uint8_t field;    // enum nq_field (NQ_RANGE)
+  uint8_t lo_open;  // nonzero if lo is excluded (NQ_RANGE)
+  uint8_t hi_open;  // nonzero if hi is excluded (NQ_RANGE)
+  uint32_t skip;    // instructions to skip (NQ_JZ, NQ_JALL)
+  double lo;        // lower bound (NQ_RANGE)
+  double hi;        // upper bound (NQ_RANGE)
+  char *str;        // string operand (name ops)
+  uint32_t str_len; // length of str
+};
+
+// compiled query struct
+struct nav_query_t {
+  struct nq_insn *code; // program
+  uint32_t len;         // number of instructions
+  uint32_t cap;         // allocated instructions
+  const char *error;    // description of a compile error, or NULL
+  int error_pos;        // offset in the expression of the error
+};
+
+// Compile expr into q. Returns 0, or -1 if expr is invalid (q->error and
+// q->error_pos describe the problem; q needs no nav_query_free).
+int nav_query_compile(const char *expr, nav_query_t *q);
+
+// Run q over tbl with nthreads threads (one per processor if 0). If matches is
+// not NULL, it must have room for strtable_len(tbl) indices, and is filled
+// with the indices of the matching elements in increasing order. Returns the
+// number of matching elements.
+uint32_t nav_query_run(nav_query_t *q, strtable_t *tbl, int nthreads,
+                       uint32_t *matches);
+
+// Free a compiled query.
+void nav_query_free(nav_query_t *q);
+
+#endif
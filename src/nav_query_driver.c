@@ -0,0 +1,80 @@
+#include "nav_query.h"
+#include "strtable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void usage(const char *name) {
+  printf("usage: %s nav expr [-t threads] [-r repeats] [-p]\n"
+         "  runs the filter expr over the nav table nav, and prints the\n"
+         "  number of matches and the scan rate (the best of repeats runs).\n"
+         "  -p prints the matching elements. For example:\n"
+         "    %s db/nav \"dist < 1000 or (lat between -2 and 2 and name prefix "
+         "'HD')\"\n",
+         name, name);
+}
+
+double seconds(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    usage(argv[0]);
+    return 1;
+  }
+  int nthreads = 0;
+  int repeats = 1;
+  int print = 0;
+  for (int i = 3; i < argc; i++) {
+    if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      nthreads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      repeats = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-p")) {
+      print = 1;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  nav_query_t q;
+  if (nav_query_compile(argv[2], &q)) {
+    printf("%s\n%*s^ %s\n", argv[2], q.error_pos, "", q.error);
+    return 1;
+  }
+
+  strtable_t nav;
+  strtable_open(argv[1], 0, &nav);
+  uint32_t len = strtable_len(&nav);
+  uint32_t *matches = malloc((len + 1) * sizeof(uint32_t));
+
+  uint32_t n = 0;
+  double best = 0;
+  for (int r = 0; r < repeats; r++) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    n = nav_query_run(&q, &nav, nthreads, matches);
+    double t = seconds(&start);
+    best = r == 0 || t < best ? t : best;
+  }
+
+  if (print) {
+    for (uint32_t i = 0; i < n; i++) {
+      printf("%u: %s\n", matches[i], get_element(&nav, matches[i]));
+    }
+  }
+  printf("%u of %u elements match (%u instructions, %.3f ms, %.1f M "
+         "elements/s)\n",
+         n, len, q.len, best * 1e3, best > 0 ? len / best / 1e6 : 0);
+
+  free(matches);
+  nav_query_free(&q);
+  strtable_close(&nav);
+  return 0;
+}
@@ -1,8 +1,12 @@
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "boot.h"
+#include "log_sink.h"
+#include "stats.h"
 
 #define DYNLIB_PATH "/opt/share/251/lab4-dyn"
 #define PARAMS_PATH "db/params"
@@ -11,7 +15,12 @@
 
 int main(int argc, char **argv) {
   int quiet = 0;
-  struct boot_params params = {DYNLIB_PATH, PARAMS_PATH, DB_PATH, LOG_PATH};
+  enum log_level level = LOG_ITEM;
+  enum log_mode mode = LOG_TEXT;
+  uint64_t progress_every = 0;
+  int dump_stats = 0;
+  struct boot_params params = {DYNLIB_PATH, PARAMS_PATH, DB_PATH, LOG_PATH,
+                               NULL, 0, 0, 0};
   for (int i = 1; i < argc; i++) {
     if (!strcmp(argv[i], "-quiet")) {
       quiet |= QUIET_SKIP_IO;
@@ -26,11 +35,37 @@ int main(int argc, char **argv) {
       params.db_path = strstr(argv[i], "=") + 1;
     } else if (!strncmp(argv[i], "-lpath=", 7)) {
       params.log_path = strstr(argv[i], "=") + 1;
+    } else if (!strncmp(argv[i], "-image=", 7)) {
+      params.image_path = strstr(argv[i], "=") + 1;
+    } else if (!strcmp(argv[i], "-async")) {
+      params.async_log = 1;
+    } else if (!strcmp(argv[i], "-validate=full")) {
+      params.full_validate = 1;
+    } else if (!strcmp(argv[i], "-validate=incremental")) {
+      params.incremental_validate = 1;
+    } else if (!strcmp(argv[i], "-log=json")) {
+      mode = LOG_JSON;
+    } else if (!strcmp(argv[i], "-log=progress")) {
+      mode = LOG_PROGRESS;
+    } else if (!strncmp(argv[i], "-progress=", 10)) {
+      progress_every = strtoull(strstr(argv[i], "=") + 1, NULL, 10);
+    } else if (!strcmp(argv[i], "-loglevel=info")) {
+      level = LOG_INFO;
+    } else if (!strcmp(argv[i], "-loglevel=warn")) {
+      level = LOG_WARN;
+    } else if (!strcmp(argv[i], "-stats")) {
+      dump_stats = 1;
     } else {
       printf("Unknown argument %s\n", argv[i]);
       exit(1);
     }
   }
+  log_init(STDOUT_FILENO, level, mode, progress_every);
+  stats_dump_on_signal(SIGUSR1);
   boot(params, quiet);
+  if (dump_stats) {
+    log_flush();
+    stats_dump(STDERR_FILENO);
+  }
   return 0;
 }
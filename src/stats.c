@@ -0,0 +1,136 @@
+#include "stats.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// One thread's counts; only the owning thread writes them.
+struct stats_thread {
+  struct stats_snapshot ops[STATS_OPS]; // counts of each operation
+  struct stats_thread *next;            // next thread's counts
+};
+
+#ifdef STATS
+static const char *op_names[STATS_OPS] = {
+    "add_element", "get_element", "get_element_len", "bl_append",
+    "bl_next",     "bl_prev",     "array_open",      "mm_open"};
+#endif
+
+// every thread's counts; the lock is only taken to add a thread.
+static struct stats_thread *threads = NULL;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct stats_thread *mine = NULL;
+
+// Helper function that stores v in *p, so that concurrent snapshots read
+// either the old or the new value.
+static inline void store(uint64_t *p, uint64_t v) {
+  __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t load(const uint64_t *p) {
+  return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+void stats_record(enum stats_op op, uint64_t ns) {
+  if (!mine) {
+    mine = calloc(1, sizeof(struct stats_thread));
+    pthread_mutex_lock(&threads_lock);
+    mine->next = threads;
+    // publish the thread's counts once they are initialized.
+    __atomic_store_n(&threads, mine, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&threads_lock);
+  }
+
+  struct stats_snapshot *s = &mine->ops[op];
+  int bucket = 63 - __builtin_clzll(ns | 1);
+  store(&s->count, s->count + 1);
+  store(&s->total_ns, s->total_ns + ns);
+  store(&s->buckets[bucket], s->buckets[bucket] + 1);
+  if (ns > s->max_ns) {
+    store(&s->max_ns, ns);
+  }
+}
+
+void stats_snapshot(struct stats_snapshot *snap) {
+  memset(snap, 0, STATS_OPS * sizeof(struct stats_snapshot));
+  struct stats_thread *t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE);
+  for (; t; t = t->next) {
+    for (int op = 0; op < STATS_OPS; op++) {
+      struct stats_snapshot *s = &t->ops[op];
+      snap[op].count += load(&s->count);
+      snap[op].total_ns += load(&s->total_ns);
+      uint64_t max = load(&s->max_ns);
+      if (max > snap[op].max_ns) {
+        snap[op].max_ns = max;
+      }
+      for (int b = 0; b < STATS_BUCKETS; b++) {
+        snap[op].buckets[b] += load(&s->buckets[b]);
+      }
+    }
+  }
+}
+
+uint64_t stats_percentile(const struct stats_snapshot *snap, double p) {
+  // the histogram may be a few counts ahead of count; use its own total.
+  uint64_t total = 0;
+  for (int b = 0; b < STATS_BUCKETS; b++) {
+    total += snap->buckets[b];
+  }
+  uint64_t rank = p * total;
+  uint64_t seen = 0;
+  for (int b = 0; b < STATS_BUCKETS; b++) {
+    seen += snap->buckets[b];
+    if (seen > rank) {
+      uint64_t bound = b == 63 ? UINT64_MAX : (2ULL << b) - 1;
+      return bound < snap->max_ns ? bound : snap->max_ns;
+    }
+  }
+  return snap->max_ns;
+}
+
+void stats_dump(int fd) {
+  char line[160];
+  int len;
+#ifdef STATS
+  struct stats_snapshot snap[STATS_OPS];
+  stats_snapshot(snap);
+  len = snprintf(line, sizeof(line), "%-16s %10s %10s %10s %10s %10s %12s\n",
+                 "op", "count", "mean ns", "p50 ns", "p99 ns", "p999 ns",
+                 "max ns");
+  assert(write(fd, line, len) == len);
+  for (int op = 0; op < STATS_OPS; op++) {
+    struct stats_snapshot *s = &snap[op];
+    if (!s->count) {
+      continue;
+    }
+    len = snprintf(line, sizeof(line),
+                   "%-16s %10lu %10lu %10lu %10lu %10lu %12lu\n", op_names[op],
+                   s->count, s->total_ns / s->count,
+                   stats_percentile(s, 0.5), stats_percentile(s, 0.99),
+                   stats_percentile(s, 0.999), s->max_ns);
+    assert(write(fd, line, len) == len);
+  }
+#else
+  len = snprintf(line, sizeof(line),
+                 "stats: not enabled (build with make DEFINE=-DSTATS)\n");
+  assert(write(fd, line, len) == len);
+#endif
+}
+
+// Signal handler that dumps stats. (snprintf is not strictly
+// async-signal-safe, but doesn't allocate for these formats.)
+static void dump_handler(int signo) { stats_dump(STDERR_FILENO); }
+
+void stats_dump_on_signal(int signo) {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = dump_handler;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  assert(!sigaction(signo, &sa, NULL));
+}
@@ -0,0 +1,95 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdint.h>
+#include <time.h>
+
+// ---------------------------------
+// storage operation latency stats
+// ---------------------------------
+//
+// When built with STATS defined (make DEFINE=-DSTATS), the storage operations
+// below count their calls and record their latencies in log-bucketed
+// histograms. Without STATS, the STATS_BEGIN/STATS_END macros are empty, so the
+// operations cost nothing extra.
+//
+// Typical usage:
+//
+//    // in an instrumented function
+//    STATS_BEGIN(STATS_GET_ELEMENT);
+//    ...
+//    STATS_END(STATS_GET_ELEMENT); // at the (single) exit
+//
+//    // anywhere
+//    struct stats_snapshot snap[STATS_OPS];
+//    stats_snapshot(snap);
+//    uint64_t p99 = stats_percentile(&snap[STATS_GET_ELEMENT], 0.99);
+//
+//    // or print a table on SIGUSR1 (and at any time with stats_dump)
+//    stats_dump_on_signal(SIGUSR1);
+//
+// Each thread records into its own storage, which only it writes, so recording
+// takes no locks and no atomic read-modify-writes; snapshots add up every
+// thread's storage. Bucket b of a histogram counts latencies of 2^b to
+// 2^(b+1) - 1 nanoseconds (bucket 0 also counts 0).
+
+// instrumented operations.
+enum stats_op {
+  STATS_ADD_ELEMENT,
+  STATS_GET_ELEMENT,
+  STATS_GET_ELEMENT_LEN,
+  STATS_BL_APPEND,
+  STATS_BL_NEXT,
+  STATS_BL_PREV,
+  STATS_ARRAY_OPEN,
+  STATS_MM_OPEN,
+  STATS_OPS, // number of operations
+};
+
+// Number of histogram buckets.
+#define STATS_BUCKETS 64
+
+// counts of one operation
+struct stats_snapshot {
+  uint64_t count;                  // number of calls
+  uint64_t total_ns;               // total latency
+  uint64_t max_ns;                 // largest latency
+  uint64_t buckets[STATS_BUCKETS]; // latency histogram
+};
+
+#ifdef STATS
+
+// Return the current time in nanoseconds.
+static inline uint64_t stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define STATS_BEGIN(op) uint64_t stats_start_##op = stats_now()
+#define STATS_END(op) stats_record((op), stats_now() - stats_start_##op)
+
+#else
+
+#define STATS_BEGIN(op)
+#define STATS_END(op)
+
+#endif
+
+// Record one call of op taking ns nanoseconds (use the STATS macros).
+void stats_record(enum stats_op op, uint64_t ns);
+
+// Add up every thread's counts into snap (an array of STATS_OPS).
+void stats_snapshot(struct stats_snapshot *snap);
+
+// Return an upper bound of the p-th quantile (0 <= p <= 1) of the latencies in
+// snap.
+uint64_t stats_percentile(const struct stats_snapshot *snap, double p);
+
+// Write a table of counts and latencies of each operation to fd.
+void stats_dump(int fd);
+
+// Call stats_dump(STDERR_FILENO) when signal signo is received.
+void stats_dump_on_signal(int signo);
+
+#endif
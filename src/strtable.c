@@ -3,9 +3,73 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "stats.h"
 #include "util.h"
 
-void strtable_open(char *path, uint32_t create_size, strtable_t *tbl) {
+// Header characters for each table version, unsorted and sorted (frozen).
+// Version 0 is a table with an unrecognized header, which is read as version
+// 1.
+static const char *headers[3][2] = {{NULL, NULL},
+                                    {"STBL", "STBS"},
+                                    {"STB2", "STS2"}};
+
+// helper function to return the total size of the table.
+static inline uint64_t table_size(strtable_t *table) {
+  return table->version == 2 ? table->metadata64->size
+                             : table->metadata->size;
+}
+
+// helper function to return the offset of element idx.
+static inline uint64_t el_offset(strtable_t *table, unsigned int idx) {
+  return table->version == 2 ? table->elements64[idx].offset
+                             : table->elements[idx].offset;
+}
+
+// helper function to return the address of index entry idx.
+static inline void *el_entry(strtable_t *table, unsigned int idx) {
+  return table->version == 2 ? (void *)&table->elements64[idx]
+                             : (void *)&table->elements[idx];
+}
+
+uint64_t strtable_size_for(uint32_t n, uint64_t data_size) {
+  uint64_t size = sizeof(struct table_metadata) +
+                  n * sizeof(struct table_element) + data_size;
+  if (size <= UINT32_MAX) {
+    return size;
+  }
+  // too large for a version 1 table.
+  return sizeof(struct table_metadata64) + n * sizeof(struct table_element64) +
+         data_size;
+}
+
+// Helper function that validates the table in tbl's region, finds its version
+// and sets its element pointers.
+static void init_table(strtable_t *tbl) {
+  // validate that this is a strtable (sorted tables are frozen; see
+  // strtable_sort.h), and find its version.
+  tbl->version = 0;
+  for (int v = 1; v <= 2; v++) {
+    if (strncmp((char *)tbl->metadata, headers[v][0], 4) == 0 ||
+        strncmp((char *)tbl->metadata, headers[v][1], 4) == 0) {
+      tbl->version = v;
+    }
+  }
+  assert(tbl->version);
+
+  // elements begin right past the metadata; set elements pointers to point to
+  // the first byte past the metadata.
+  tbl->elements = tbl->mm_region.start + sizeof(struct table_metadata);
+  tbl->elements64 = tbl->mm_region.start + sizeof(struct table_metadata64);
+
+  // validate that size was stored correctly.
+  if (tbl->version == 2) {
+    assert(table_size(tbl) == tbl->mm_region.size);
+  } else {
+    assert(tbl->metadata->size == tbl->mm_region.size);
+  }
+}
+
+void strtable_open(char *path, uint64_t create_size, strtable_t *tbl) {
   assert(tbl);
 
   // open backing file
@@ -18,28 +82,40 @@ void strtable_open(char *path, uint32_t create_size, strtable_t *tbl) {
 
   free(tpath);
 
-  // metadata is stored in table; set metadata pointer to point to the start of
-  // the region.
+  // metadata is stored in table; set metadata pointers to point to the start
+  // of the region.
   tbl->metadata = tbl->mm_region.start;
-  // elements begin right past the metadata; set elements pointer to point to
-  // the first byte past the metadata.
-  tbl->elements = tbl->mm_region.start + sizeof(struct table_metadata);
+  tbl->metadata64 = tbl->mm_region.start;
 
-  // if table is being created, initialize the header.
+  // if table is being created, initialize the header. Tables that are too
+  // large for 32-bit sizes and offsets are created as version 2 tables.
   if (create_size) {
     DEBUG_PRINT("initializing header\n");
-    // add header characters
-    memcpy((char *)tbl->metadata, "STBL", 4);
-    // there are initially no elements in the table
-    tbl->metadata->len = 0;
-    tbl->metadata->size = create_size;
+    if (create_size > UINT32_MAX) {
+      memcpy((char *)tbl->metadata64, headers[2][0], 4);
+      tbl->metadata64->len = 0;
+      tbl->metadata64->size = create_size;
+    } else {
+      // add header characters
+      memcpy((char *)tbl->metadata, headers[1][0], 4);
+      // there are initially no elements in the table
+      tbl->metadata->len = 0;
+      tbl->metadata->size = create_size;
+    }
   }
 
-  // validate that this is a strtable.
-  assert(strncmp((char *)tbl->metadata, "STBL", 4) == 0);
+  init_table(tbl);
+}
 
-  // validate that size was stored correctly.
-  assert(tbl->metadata->size == tbl->mm_region.size);
+void strtable_view(void *start, size_t size, strtable_t *tbl) {
+  assert(tbl);
+  tbl->mm_region.start = start;
+  tbl->mm_region.size = size;
+  tbl->mm_region.fd = -1;
+  tbl->mm_region.flags = 0;
+  tbl->metadata = start;
+  tbl->metadata64 = start;
+  init_table(tbl);
 }
 
 void strtable_close(strtable_t *tbl) {
@@ -49,74 +125,104 @@ void strtable_close(strtable_t *tbl) {
 
 uint32_t strtable_len(strtable_t *table) {
   // the table metadata stores the length
-  return table->metadata->len;
+  return table->version == 2 ? table->metadata64->len : table->metadata->len;
+}
+
+uint64_t strtable_size(strtable_t *table) { return table_size(table); }
+
+int strtable_frozen(strtable_t *table) {
+  if (!table->version) {
+    // unrecognized header (read as version 1); it has no frozen form.
+    return 0;
+  }
+  return strncmp((char *)table->metadata, headers[table->version][1], 4) == 0;
+}
+
+void strtable_freeze(strtable_t *table) {
+  if (!table->version) {
+    return;
+  }
+  memcpy((char *)table->metadata, headers[table->version][1], 4);
 }
 
 // helper function to return the end of the table.
 void *end(strtable_t *table) {
-  return ((void *)table->metadata) + table->metadata->size;
+  return ((void *)table->metadata) + table_size(table);
 }
 
 char *add_element(strtable_t *table, const char *str) {
-  DEBUG_PRINT("cur elements %d\n", table->metadata->len);
+  STATS_BEGIN(STATS_ADD_ELEMENT);
+  void *soffset = NULL;
+  uint32_t n = strtable_len(table);
+  DEBUG_PRINT("cur elements %d\n", n);
+
+  if (strtable_frozen(table)) {
+    // sorted tables are frozen.
+    goto out;
+  }
 
   // compute the offset that the new element will _end_ at. if the table is
   // empty, this will be the end of the file. if the table is nonempty, this
   // will be where the previous elements starts.
-  // clang-format off
-  uint32_t last_el_start =
-      table->metadata->len > 0 ? 
-          table->elements[table->metadata->len - 1].offset :
-          0;
-  // clang-format on
+  uint64_t last_el_start = n > 0 ? el_offset(table, n - 1) : 0;
 
   size_t len = strlen(str) + 1; // len of element includes \0
   // start offset of element; where it will be written
-  void *soffset = end(table) - last_el_start - len;
+  soffset = end(table) - last_el_start - len;
 
   DEBUG_PRINT("table end: %p\n", end(table));
   DEBUG_PRINT("last el start: %p\n", NULL + last_el_start);
   DEBUG_PRINT("start offset: %p\n", soffset);
 
   // ensure start offset of element will be past the end of the index.
-  if (soffset < (void *)&table->elements[table->metadata->len + 1]) {
-    DEBUG_PRINT("does not fit; end of elements: %p\n",
-                (void *)&table->elements[table->metadata->len + 1]);
+  if (soffset < el_entry(table, n + 1)) {
+    DEBUG_PRINT("does not fit; end of elements: %p\n", el_entry(table, n + 1));
     // string doesn't fit!
-    return NULL;
+    soffset = NULL;
+    goto out;
   }
 
   // copy the element to its position in the table.
   strncpy(soffset, str, len);
   // add offset to index and increment index pointer.
-  table->elements[table->metadata->len].offset = end(table) - soffset;
-  table->metadata->len++;
-  DEBUG_PRINT("new elements %d\n", table->metadata->len);
+  if (table->version == 2) {
+    table->elements64[n].offset = end(table) - soffset;
+    table->metadata64->len++;
+  } else {
+    table->elements[n].offset = end(table) - soffset;
+    table->metadata->len++;
+  }
+  DEBUG_PRINT("new elements %d\n", strtable_len(table));
 
+out:
+  STATS_END(STATS_ADD_ELEMENT);
   return soffset;
 }
 
 char *get_element(strtable_t *table, unsigned int idx) {
-  if (idx >= table->metadata->len) {
-    // Invalid index.
-    return NULL;
+  STATS_BEGIN(STATS_GET_ELEMENT);
+  char *element = NULL;
+  if (idx < strtable_len(table)) {
+    // return pointer to start of element (NULL for an invalid index).
+    element = end(table) - el_offset(table, idx);
   }
-
-  // return pointer to start of element.
-  return end(table) - table->elements[idx].offset;
+  STATS_END(STATS_GET_ELEMENT);
+  return element;
 }
 
 int get_element_len(strtable_t *table, unsigned int idx) {
-  if (idx >= table->metadata->len) {
+  STATS_BEGIN(STATS_GET_ELEMENT_LEN);
+  int len;
+  if (idx >= strtable_len(table)) {
     // Invalid index.
-    return -1;
-  }
-
-  if (idx == 0) {
+    len = -1;
+  } else if (idx == 0) {
     // first element size is offset.
-    return table->elements[0].offset;
+    len = el_offset(table, 0);
+  } else {
+    // return difference between offsets.
+    len = el_offset(table, idx) - el_offset(table, idx - 1);
   }
-
-  // return difference between offsets.
-  return table->elements[idx].offset - table->elements[idx - 1].offset;
+  STATS_END(STATS_GET_ELEMENT_LEN);
+  return len;
 }
@@ -63,7 +63,9 @@ typedef struct strtable_t strtable_t;
 //   3. A data section storing the elements.
 //
 // The metadata header begins with the four characters STBL -- this identifies
-// the file as being a string table file type. Immediately following this header
+// the file as being a string table file type (sorted tables, which cannot be
+// appended to, begin with STBS instead; see strtable_sort.h, and version 2
+// tables are described below). Immediately following this header
 // at index four is a 4-byte unsigned integer representing the total size of the
 // table in bytes (called size), followed by a 4-byte unsigned integer
 // representing the number of elements currently stored in the file (called
@@ -84,6 +86,21 @@ typedef struct strtable_t strtable_t;
 // the space after the null terminator is either the end of the table OR the
 // start of another string.
 //
+// Version 2 tables (header STB2, or STS2 when sorted) are used for tables
+// larger than 4 GiB. They have the same layout, but a wider header and 64-bit
+// offsets:
+//         byte | contents      | description
+//         -----|---------------|-------------
+//            0 | STB2          | identifying marker
+//            4 | n             | uint32 number of elements
+//            8 | size          | uint64 size of file
+//           16 | index[0]      | element 0 metadata (uint64 offset)
+//              | ...           |
+//      16 + 8i | index[i]      | element i metadata
+//
+// strtable_open creates a version 2 table when the requested size does not fit
+// in 32 bits, and opens either version.
+//
 // Note: strtable strings returned by get_element are mutable and changes to the
 // string are reflected on disk and for subsequent gets. One can always
 // determine the available size for mutations to an element by calling
@@ -96,11 +113,21 @@ struct table_metadata {
   uint32_t len;  // number of elements
 };
 
+// table metadata struct (version 2)
+struct table_metadata64 {
+  char hdr[4];   // header chars
+  uint32_t len;  // number of elements
+  uint64_t size; // total size of table
+};
+
 // strtable struct
 struct strtable_t {
-  struct table_metadata *metadata; // pointer to metadata/table start
-  struct table_element *elements;  // pointer to elements metadata start
-  mm_region_t mm_region;           // memory map info
+  struct table_metadata *metadata;     // pointer to metadata/table start
+  struct table_element *elements;      // pointer to elements metadata start
+  struct table_metadata64 *metadata64; // metadata (version 2)
+  struct table_element64 *elements64;  // elements metadata (version 2)
+  int version;                         // table format version (1 or 2)
+  mm_region_t mm_region;               // memory map info
 };
 
 // element metadata
@@ -108,11 +135,20 @@ struct table_element {
   uint32_t offset; // currently only storing element offset
 };
 
+// element metadata (version 2)
+struct table_element64 {
+  uint64_t offset; // element offset
+};
+
 // Create a strtable.
 //
 // If table exists, size should be 0. When size is nonzero, the table will be
 // created with the given size.
-void strtable_open(char *path, uint32_t size, strtable_t *tbl);
+void strtable_open(char *path, uint64_t size, strtable_t *tbl);
+
+// Set up tbl to use the table file contents at start (size bytes) in memory that
+// is already mapped, as a borrowed region (see mm_util.h).
+void strtable_view(void *start, size_t size, strtable_t *tbl);
 
 // Close a table
 //
@@ -122,12 +158,26 @@ void strtable_close(strtable_t *tbl);
 // Add an element to the table.
 //
 // Returns pointer to the copy of str in the table, or NULL if the string did
-// not fit in the table.
+// not fit in the table (or the table is sorted).
 char *add_element(strtable_t *table, const char *str);
 
 // Get the length of the table (in terms of number of elements).
 uint32_t strtable_len(strtable_t *table);
 
+// Get the total size of the table in bytes.
+uint64_t strtable_size(strtable_t *table);
+
+// Return the size of a table that exactly fits n elements totalling data_size
+// bytes (including null terminators).
+uint64_t strtable_size_for(uint32_t n, uint64_t data_size);
+
+// Returns nonzero if the table is frozen (sorted). Elements cannot be added to
+// frozen tables.
+int strtable_frozen(strtable_t *table);
+
+// Freeze a table, marking it as sorted (see strtable_sort.h).
+void strtable_freeze(strtable_t *table);
+
 // Return the element at index idx. Returns null if index is not in table range.
 char *get_element(strtable_t *table, unsigned int idx);
 
@@ -0,0 +1,92 @@
+#include "ef_index.h"
+#include "strtable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_PATH "strtable_bench"
+#define LOOKUPS 10000000
+
+// Return the current time in nanoseconds.
+uint64_t now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+  uint32_t n = argc > 1 ? atoi(argv[1]) : 1000000;
+  char buf[32];
+
+  // build a table of short nav-like names.
+  strtable_t table;
+  strtable_open(BENCH_PATH, strtable_size_for(n, n * 16ULL), &table);
+  for (uint32_t i = 0; i < n; i++) {
+    snprintf(buf, sizeof(buf), "HD %u", (uint32_t)rand() % 1000000);
+    add_element(&table, buf);
+  }
+  ef_build(&table, BENCH_PATH);
+
+  ef_index_t ef;
+  ef_open(BENCH_PATH, &table, &ef);
+  size_t flat_size = (table.version == 2 ? sizeof(struct table_element64)
+                                         : sizeof(struct table_element)) *
+                     (size_t)n;
+  printf("%u elements\n", n);
+  printf("flat index:         %10lu bytes\n", flat_size);
+  printf("elias-fano index:   %10lu bytes (%.2f bits/element)\n",
+         ef.mm_region.size, 8.0 * ef.mm_region.size / n);
+
+  uint32_t *idx = malloc(LOOKUPS * sizeof(uint32_t));
+  for (uint32_t i = 0; i < LOOKUPS; i++) {
+    idx[i] = (uint32_t)rand() % n;
+  }
+
+  // random lookups; sum lengths so the work is not optimized away.
+  uint64_t start = now();
+  uint64_t flat_sum = 0;
+  for (uint32_t i = 0; i < LOOKUPS; i++) {
+    flat_sum += get_element_len(&table, idx[i]) + *get_element(&table, idx[i]);
+  }
+  uint64_t flat_ns = now() - start;
+
+  start = now();
+  uint64_t ef_sum = 0;
+  for (uint32_t i = 0; i < LOOKUPS; i++) {
+    ef_sum += ef_get_element_len(&ef, &table, idx[i]) +
+              *ef_get_element(&ef, &table, idx[i]);
+  }
+  uint64_t ef_ns = now() - start;
+
+  printf("random lookup:      flat %6.1f ns, elias-fano %6.1f ns%s\n",
+         (double)flat_ns / LOOKUPS, (double)ef_ns / LOOKUPS,
+         flat_sum == ef_sum ? "" : " (MISMATCH!)");
+
+  // sequential scan.
+  start = now();
+  flat_sum = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    flat_sum += get_element_len(&table, i);
+  }
+  flat_ns = now() - start;
+
+  start = now();
+  ef_sum = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    ef_sum += ef_get_element_len(&ef, &table, i);
+  }
+  ef_ns = now() - start;
+
+  printf("sequential lookup:  flat %6.1f ns, elias-fano %6.1f ns%s\n",
+         (double)flat_ns / n, (double)ef_ns / n,
+         flat_sum == ef_sum ? "" : " (MISMATCH!)");
+
+  free(idx);
+  ef_close(&ef);
+  strtable_close(&table);
+  remove(BENCH_PATH ".stb");
+  remove(BENCH_PATH ".sef");
+  return 0;
+}
@@ -1,4 +1,8 @@
 #include "strtable.h"
+#include "fc_strtable.h"
+#include "strtable_intern.h"
+#include "strtable_mut.h"
+#include "strtable_sort.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,6 +17,22 @@ void usage() {
          "c              close table\n"
          "l index        get element length\n"
          "s              get table length\n"
+         "i element      intern element (append if not present)\n"
+         "u              get intern stats\n"
+         "o name         write sorted copy of table\n"
+         "b key          find first element >= key (sorted tables)\n"
+         "p prefix       find elements with prefix (sorted tables)\n"
+         "O name         write copy of nav table sorted by name field\n"
+         "N prefix       find elements named prefix... (sorted by name)\n"
+         "z name restart compress table (front coding)\n"
+         "f index        get compressed element\n"
+         "M name size    open mutable table\n"
+         "A element      add element to mutable table\n"
+         "G id           get mutable element\n"
+         "U id element   update mutable element\n"
+         "D id           delete mutable element\n"
+         "K              compact mutable table\n"
+         "S              get mutable table stats\n"
          "q              quit\n");
 }
 
@@ -22,6 +42,16 @@ int main(int argc, char **argv) {
   int tmp_int;
   char *tmp_str;
   strtable_t tbl;
+  fc_strtable_t fc;
+  int fc_opened = 0;
+  strtable_intern_t intern;
+  char *path = NULL;
+  int intern_opened = 0;
+  unsigned int idx;
+  struct intern_stats stats;
+  unsigned int first, last;
+  strtable_mut_t mut;
+  struct mut_stats mstats;
 
   usage();
   printf("> ");
@@ -39,6 +69,9 @@ int main(int argc, char **argv) {
       }
       printf("Opening file %s (size %d)\n", str, tmp_int);
       strtable_open(str, tmp_int, &tbl);
+      free(path);
+      path = strdup(str);
+      intern_opened = 0;
       printf("table offset: %p\n", tbl.metadata);
       break;
     case 'a':
@@ -52,8 +85,30 @@ int main(int argc, char **argv) {
       printf("get element %d: %s (%p)\n", tmp_int, tmp_str ? tmp_str : "-",
              tmp_str);
       break;
+    case 'i':
+      if (!intern_opened) {
+        intern_open(path, &tbl, &intern);
+        intern_opened = 1;
+      }
+      tmp_str = intern_element(&intern, str, &idx);
+      printf("interned element %s; %s (index %u, %p)\n", str,
+             tmp_str ? "OK" : "FAILED", idx, tmp_str);
+      break;
+    case 'u':
+      if (!intern_opened) {
+        intern_open(path, &tbl, &intern);
+        intern_opened = 1;
+      }
+      intern_stats(&intern, &stats);
+      printf("lookups %lu, hits %lu, distinct %u, ratio %.2f\n", stats.lookups,
+             stats.hits, stats.distinct, stats.ratio);
+      break;
     case 'c':
       printf("closing table...\n");
+      if (intern_opened) {
+        intern_close(&intern);
+        intern_opened = 0;
+      }
       strtable_close(&tbl);
       break;
     case 'l':
@@ -64,6 +119,83 @@ int main(int argc, char **argv) {
     case 's':
       printf("table len: %d\n", strtable_len(&tbl));
       break;
+    case 'o':
+    case 'O':
+      strtable_compact(&tbl, str, *op == 'O' ? &strtable_key_name : NULL, 0);
+      printf("wrote sorted table %s\n", str);
+      break;
+    case 'b':
+      first = strtable_lower_bound(&tbl, NULL, str);
+      printf("lower bound of %s: %u\n", str, first);
+      break;
+    case 'p':
+    case 'N':
+      // names have spaces; the prefix is the rest of the line.
+      tmp_str = strtok(NULL, "");
+      if (tmp_str) {
+        tmp_str[-1] = ' ';
+      }
+      printf("%u elements with prefix %s\n",
+             strtable_prefix_range(&tbl, *op == 'N' ? &strtable_key_name : NULL,
+                                   str, &first, &last),
+             str);
+      for (unsigned int i = first; i < last; i++) {
+        printf("  %u: %s\n", i, get_element(&tbl, i));
+      }
+      break;
+    case 'z':
+      tmp_str = strtok(NULL, " ");
+      tmp_int = tmp_str ? atoi(tmp_str) : FC_DEFAULT_RESTART;
+      if (fc_opened) {
+        fc_close(&fc);
+      }
+      printf("compressed %lu bytes into %u bytes\n", strtable_size(&tbl),
+             fc_compress(&tbl, str, tmp_int));
+      fc_open(str, &fc);
+      fc_opened = 1;
+      break;
+    case 'f':
+      tmp_int = atoi(str);
+      printf("get compressed element %d: %s (len %d)\n", tmp_int,
+             fc_get_element(&fc, tmp_int) ? fc_get_element(&fc, tmp_int) : "-",
+             fc_get_element_len(&fc, tmp_int));
+      break;
+    case 'M':
+      tmp_str = strtok(NULL, " ");
+      mut_open(str, tmp_str ? atoi(tmp_str) : 0, &mut);
+      printf("opened mutable table %s (generation %u)\n", str,
+             mut.metadata->generation);
+      break;
+    case 'A':
+      printf("added element %s; id %ld\n", str, mut_add(&mut, str));
+      break;
+    case 'G':
+      tmp_int = atoi(str);
+      tmp_str = mut_get(&mut, tmp_int);
+      printf("get element %d: %s (len %d)\n", tmp_int, tmp_str ? tmp_str : "-",
+             mut_get_len(&mut, tmp_int));
+      break;
+    case 'U':
+      tmp_int = atoi(str);
+      tmp_str = strtok(NULL, " ");
+      printf("update element %d: %s\n", tmp_int,
+             mut_update(&mut, tmp_int, tmp_str) ? "OK" : "FAILED");
+      break;
+    case 'D':
+      tmp_int = atoi(str);
+      printf("delete element %d: %s\n", tmp_int,
+             mut_delete(&mut, tmp_int) ? "FAILED" : "OK");
+      break;
+    case 'K':
+      mut_compact(&mut);
+      printf("compacted into generation %u\n", mut.metadata->generation);
+      break;
+    case 'S':
+      mut_stats(&mut, &mstats);
+      printf("generation %u, %u ids, %u live, %lu live bytes, %lu dead bytes\n",
+             mstats.generation, mstats.len, mstats.live, mstats.live_bytes,
+             mstats.dead_bytes);
+      break;
     case 'q':
     case 'e':
       return 0;
@@ -0,0 +1,234 @@
+#include "strtable_intern.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "util.h"
+
+// Minimum number of slots in an index.
+#define MIN_CAPACITY 64
+
+// Helper function that returns the hash stored in slots for str.
+static uint32_t hash_str(const char *str) {
+  return (uint32_t)fnv1a(FNV_INIT, str, strlen(str));
+}
+
+// Helper function that returns the checksum identifying the first n elements
+// of table: the FNV-1a hash of its first and last of them (each with its null
+// terminator).
+static uint64_t table_checksum(strtable_t *table, uint32_t n) {
+  uint64_t h = FNV_INIT;
+  if (n) {
+    const char *first = get_element(table, 0);
+    const char *last = get_element(table, n - 1);
+    h = fnv1a(h, first, strlen(first) + 1);
+    h = fnv1a(h, last, strlen(last) + 1);
+  }
+  return h;
+}
+
+// Helper function that returns the smallest valid capacity with room for n
+// elements.
+static uint32_t capacity_for(uint32_t n) {
+  uint32_t capacity = MIN_CAPACITY;
+  while (capacity < 2 * n) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+// Helper function that returns the slot holding str, or the empty slot where
+// str would be inserted.
+static struct intern_slot *find(strtable_intern_t *in, const char *str,
+                                uint32_t hash) {
+  uint32_t mask = in->metadata->capacity - 1;
+  uint32_t i = hash & mask;
+  while (in->slots[i].idx) {
+    if (in->slots[i].hash == hash &&
+        !strcmp(get_element(in->table, in->slots[i].idx - 1), str)) {
+      return &in->slots[i];
+    }
+    i = (i + 1) & mask;
+  }
+  return &in->slots[i];
+}
+
+// Map the index file with room for capacity slots.
+static void map_index(strtable_intern_t *in, uint32_t capacity) {
+  size_t size =
+      sizeof(struct intern_metadata) + capacity * sizeof(struct intern_slot);
+  mm_open(in->path, size, &in->mm_region);
+  in->metadata = in->mm_region.start;
+  in->slots = in->mm_region.start + sizeof(struct intern_metadata);
+}
+
+// Add table elements that are not yet indexed to the index, growing it if
+// necessary.
+static void catch_up(strtable_intern_t *in);
+
+// Rebuild the index from the table with the given number of slots. Statistics
+// are kept.
+static void rebuild(strtable_intern_t *in, uint32_t capacity) {
+  DEBUG_PRINT("rebuilding %s with %u slots\n", in->path, capacity);
+  uint64_t lookups = 0;
+  uint64_t hits = 0;
+  if (in->metadata) {
+    lookups = in->metadata->lookups;
+    hits = in->metadata->hits;
+    mm_close(&in->mm_region);
+  }
+
+  map_index(in, capacity);
+  memset(in->mm_region.start, 0, in->mm_region.size);
+  memcpy(in->metadata->hdr, "STHI", 4);
+  in->metadata->capacity = capacity;
+  in->metadata->lookups = lookups;
+  in->metadata->hits = hits;
+  in->metadata->table_size = strtable_size(in->table);
+  in->metadata->checksum = table_checksum(in->table, 0);
+
+  catch_up(in);
+}
+
+static void catch_up(strtable_intern_t *in) {
+  uint32_t len = strtable_len(in->table);
+  if (in->metadata->indexed == len) {
+    return;
+  }
+  if (4 * len >= 3 * in->metadata->capacity) {
+    // too full; rebuild will index every element.
+    uint32_t capacity = in->metadata->capacity;
+    while (4 * len >= 3 * capacity) {
+      capacity *= 2;
+    }
+    rebuild(in, capacity);
+    return;
+  }
+
+  for (uint32_t i = in->metadata->indexed; i < len; i++) {
+    const char *str = get_element(in->table, i);
+    uint32_t hash = hash_str(str);
+    struct intern_slot *slot = find(in, str, hash);
+    if (!slot->idx) {
+      // only index the first copy of duplicate elements.
+      slot->hash = hash;
+      slot->idx = i + 1;
+      in->metadata->distinct++;
+    }
+  }
+  in->metadata->indexed = len;
+  in->metadata->checksum = table_checksum(in->table, len);
+}
+
+// Helper function that returns nonzero if the index was built for in->table.
+static int matches(strtable_intern_t *in) {
+  struct intern_metadata *md = in->metadata;
+  if (md->table_size != strtable_size(in->table) ||
+      md->indexed > strtable_len(in->table)) {
+    return 0;
+  }
+  return table_checksum(in->table, md->indexed) == md->checksum;
+}
+
+// Helper function that returns nonzero if the index capacity is a power of
+// two of at least MIN_CAPACITY and its slots fit in the mapped file.
+static int valid_capacity(strtable_intern_t *in) {
+  uint32_t capacity = in->metadata->capacity;
+  if (capacity < MIN_CAPACITY || (capacity & (capacity - 1))) {
+    return 0;
+  }
+  uint64_t slots = (uint64_t)capacity * sizeof(struct intern_slot);
+  return in->mm_region.size >= sizeof(struct intern_metadata) + slots;
+}
+
+void intern_open(const char *path, strtable_t *table, strtable_intern_t *in) {
+  assert(in);
+  assert(table);
+
+  in->table = table;
+  in->metadata = NULL;
+  in->path = malloc(strlen(path) + 5);
+  strcpy(in->path, path);
+  strcat(in->path, ".sth");
+  DEBUG_PRINT("opening %s\n", in->path);
+
+  struct stat st;
+  if (stat(in->path, &st) || st.st_size < sizeof(struct intern_metadata)) {
+    // no index yet; build one from the table.
+    rebuild(in, capacity_for(strtable_len(table)));
+    return;
+  }
+
+  mm_open(in->path, 0, &in->mm_region);
+  in->metadata = in->mm_region.start;
+  in->slots = in->mm_region.start + sizeof(struct intern_metadata);
+
+  // validate that this is an intern index.
+  assert(strncmp((char *)in->metadata, "STHI", 4) == 0);
+
+  if (!valid_capacity(in)) {
+    // corrupt index; start over.
+    in->metadata->lookups = in->metadata->hits = 0;
+    rebuild(in, capacity_for(strtable_len(table)));
+  } else if (!matches(in)) {
+    // index is for a different table; start over.
+    in->metadata->lookups = in->metadata->hits = 0;
+    rebuild(in, in->metadata->capacity);
+  } else {
+    catch_up(in);
+  }
+}
+
+void intern_close(strtable_intern_t *in) {
+  mm_close(&in->mm_region);
+  free(in->path);
+}
+
+char *intern_element(strtable_intern_t *in, const char *str,
+                     unsigned int *idx) {
+  // index anything appended without interning first.
+  catch_up(in);
+  in->metadata->lookups++;
+
+  uint32_t hash = hash_str(str);
+  struct intern_slot *slot = find(in, str, hash);
+  if (slot->idx) {
+    // duplicate; return the existing copy.
+    in->metadata->hits++;
+    if (idx) {
+      *idx = slot->idx - 1;
+    }
+    return get_element(in->table, slot->idx - 1);
+  }
+
+  char *added = add_element(in->table, str);
+  if (!added) {
+    // string doesn't fit!
+    return NULL;
+  }
+
+  uint32_t len = strtable_len(in->table);
+  slot->hash = hash;
+  slot->idx = len;
+  in->metadata->indexed = len;
+  in->metadata->distinct++;
+  in->metadata->checksum = table_checksum(in->table, len);
+  if (idx) {
+    *idx = len - 1;
+  }
+
+  if (4 * len >= 3 * in->metadata->capacity) {
+    rebuild(in, in->metadata->capacity * 2);
+  }
+  return added;
+}
+
+void intern_stats(strtable_intern_t *in, struct intern_stats *stats) {
+  stats->lookups = in->metadata->lookups;
+  stats->hits = in->metadata->hits;
+  stats->distinct = in->metadata->distinct;
+  uint64_t appended = stats->lookups - stats->hits;
+  stats->ratio = appended ? (double)stats->lookups / appended : 1.0;
+}
@@ -0,0 +1,113 @@
+#ifndef __STRTABLE_INTERN_H__
+#define __STRTABLE_INTERN_H__
+
+#include <stdint.h>
+
+#include "mm_util.h"
+#include "strtable.h"
+
+typedef struct strtable_intern_t strtable_intern_t;
+
+// ----------------------------------------------
+// strtable interning usage and file format/layout
+// ----------------------------------------------
+//
+// An intern index lets a strtable be used as a set of distinct strings.
+// intern_element looks a string up before appending it, and returns the
+// existing copy (and its index) if the string is already in the table.
+//
+// Typical usage:
+//
+//    strtable_t table;
+//    strtable_open(filename, table_size_bytes, &table);
+//
+//    strtable_intern_t intern;
+//    intern_open(filename, &table, &intern);
+//
+//    unsigned int idx;
+//    char *str = intern_element(&intern, string, &idx);
+//    ...
+//    intern_close(&intern);
+//    strtable_close(&table);
+//
+// The index is a hash table stored next to the table in a file with the
+// ".sth" extension. It is an open-addressed (linear probing) table of slots
+// following a header:
+//
+// | STHI | capacity | indexed | distinct | lookups | hits | table_size |
+// | checksum | slot 0 | slot 1 | ...
+//
+// capacity is the number of slots (a power of two). indexed is the number of
+// table elements that have been added to the index; elements appended to the
+// table with add_element are added to the index on the next intern_open or
+// intern_element. distinct is the number of different strings among them (the
+// slots in use). lookups and hits count calls to intern_element and how many
+// of them found an existing element.
+//
+// table_size and checksum identify the indexed table: its size, and the FNV-1a
+// hash of its first and last indexed elements (each with its null terminator).
+// They are checked in constant time, so they catch a table that was recreated
+// or replaced, not one whose elements were modified in place. intern_open
+// rebuilds an index whose table does not match them, or whose capacity is not
+// a power of two that fits in the file.
+//
+// Each slot stores the low 32 bits of the FNV-1a hash of an element and its
+// index plus one (zero marks an empty slot). The index grows (and is rebuilt
+// from the table) when it becomes 3/4 full.
+//
+// Interned elements must not be modified in place.
+
+// intern index metadata struct
+struct intern_metadata {
+  char hdr[4];         // header chars
+  uint32_t capacity;   // number of slots
+  uint32_t indexed;    // number of table elements in the index
+  uint32_t distinct;   // number of different strings in the index
+  uint64_t lookups;    // number of intern_element calls
+  uint64_t hits;       // number of intern_element calls that found a duplicate
+  uint64_t table_size; // size of the indexed table
+  uint64_t checksum;   // FNV-1a hash of the first and last indexed elements
+};
+
+// intern index slot
+struct intern_slot {
+  uint32_t hash; // low bits of element hash
+  uint32_t idx;  // element index + 1, or 0 if empty
+};
+
+// intern index struct
+struct strtable_intern_t {
+  strtable_t *table;                // table being indexed
+  struct intern_metadata *metadata; // pointer to metadata/index start
+  struct intern_slot *slots;        // pointer to first slot
+  mm_region_t mm_region;            // memory map info
+  char *path;                       // path of the index file
+};
+
+// intern index statistics
+struct intern_stats {
+  uint64_t lookups;  // number of intern_element calls
+  uint64_t hits;     // number of duplicates returned
+  uint32_t distinct; // number of different strings in the table
+  double ratio;      // lookups per appended element
+};
+
+// Open (or create) the intern index for table. path should be the path the
+// table was opened with.
+void intern_open(const char *path, strtable_t *table, strtable_intern_t *in);
+
+// Close an intern index.
+void intern_close(strtable_intern_t *in);
+
+// Add an element to the table if it is not already present.
+//
+// Returns pointer to the copy of str in the table, or NULL if the string was
+// not present and did not fit in the table. If idx is non-null, it is set to
+// the element's index.
+char *intern_element(strtable_intern_t *in, const char *str,
+                     unsigned int *idx);
+
+// Get statistics about the intern index.
+void intern_stats(strtable_intern_t *in, struct intern_stats *stats);
+
+#endif
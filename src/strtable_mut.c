@@ -0,0 +1,268 @@
+#include "strtable_mut.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// Minimum number of remap entries.
+#define MIN_CAPACITY 64
+
+// Helper function that returns the path of generation gen of the table at
+// path (without the ".stb" extension). The result must be freed.
+static char *table_path(const char *path, uint32_t gen) {
+  char *tpath = malloc(strlen(path) + 16);
+  if (gen) {
+    sprintf(tpath, "%s.g%u", path, gen);
+  } else {
+    strcpy(tpath, path);
+  }
+  return tpath;
+}
+
+// Helper function that returns the path of the remap file of the table at
+// path, with suffix appended. The result must be freed.
+static char *remap_path(const char *path, const char *suffix) {
+  char *rpath = malloc(strlen(path) + strlen(suffix) + 5);
+  strcpy(rpath, path);
+  strcat(rpath, ".stm");
+  strcat(rpath, suffix);
+  return rpath;
+}
+
+// Map the remap file rpath with room for capacity entries into region.
+static void map_remap(const char *rpath, uint32_t capacity,
+                      mm_region_t *region) {
+  size_t size = sizeof(struct mut_metadata) + capacity * sizeof(uint32_t);
+  mm_open(rpath, size, region);
+}
+
+// Helper function that sets the remap pointers of m from its mapped region.
+static void init_remap(strtable_mut_t *m) {
+  m->metadata = m->mm_region.start;
+  m->remap = m->mm_region.start + sizeof(struct mut_metadata);
+}
+
+void mut_open(const char *path, uint64_t size, strtable_mut_t *m) {
+  assert(m);
+  m->path = strdup(path);
+  char *rpath = remap_path(path, "");
+  DEBUG_PRINT("opening %s\n", rpath);
+
+  struct stat st;
+  if (!stat(rpath, &st) && st.st_size >= sizeof(struct mut_metadata)) {
+    mm_open(rpath, 0, &m->mm_region);
+    init_remap(m);
+    // validate that this is a remap file.
+    assert(strncmp((char *)m->metadata, "STMR", 4) == 0);
+
+    char *tpath = table_path(path, m->metadata->generation);
+    strtable_open(tpath, 0, &m->table);
+    free(tpath);
+    free(rpath);
+    return;
+  }
+
+  // no remap yet; generation 0 is the table at path, and each element is its
+  // own id.
+  strtable_open((char *)path, size, &m->table);
+  uint32_t len = strtable_len(&m->table);
+  uint32_t capacity = MIN_CAPACITY;
+  while (capacity < len) {
+    capacity *= 2;
+  }
+  map_remap(rpath, capacity, &m->mm_region);
+  memset(m->mm_region.start, 0, m->mm_region.size);
+  init_remap(m);
+
+  memcpy(m->metadata->hdr, "STMR", 4);
+  m->metadata->capacity = capacity;
+  m->metadata->len = len;
+  m->metadata->live = len;
+  for (uint32_t i = 0; i < len; i++) {
+    m->remap[i] = i;
+    m->metadata->live_bytes += get_element_len(&m->table, i);
+  }
+  free(rpath);
+}
+
+void mut_close(strtable_mut_t *m) {
+  strtable_close(&m->table);
+  mm_close(&m->mm_region);
+  free(m->path);
+}
+
+// Helper function that returns the table index of id, or MUT_DELETED if id is
+// out of range or deleted.
+static uint32_t lookup(strtable_mut_t *m, uint32_t id) {
+  return id < m->metadata->len ? m->remap[id] : MUT_DELETED;
+}
+
+// Compact the table if most of its data section is dead.
+static void maybe_compact(strtable_mut_t *m) {
+  if (m->metadata->dead_bytes > m->metadata->live_bytes) {
+    mut_compact(m);
+  }
+}
+
+// Append str to the table, compacting first if it doesn't fit but compaction
+// would free space. Returns pointer to the copy, or NULL if it doesn't fit.
+static char *append(strtable_mut_t *m, const char *str) {
+  char *added = add_element(&m->table, str);
+  if (!added && m->metadata->dead_bytes) {
+    mut_compact(m);
+    added = add_element(&m->table, str);
+  }
+  return added;
+}
+
+int64_t mut_add(strtable_mut_t *m, const char *str) {
+  if (!append(m, str)) {
+    // string doesn't fit!
+    return -1;
+  }
+
+  if (m->metadata->len == m->metadata->capacity) {
+    // remap is full; double it.
+    uint32_t capacity = m->metadata->capacity * 2;
+    char *rpath = remap_path(m->path, "");
+    mm_close(&m->mm_region);
+    map_remap(rpath, capacity, &m->mm_region);
+    init_remap(m);
+    m->metadata->capacity = capacity;
+    free(rpath);
+  }
+
+  uint32_t idx = strtable_len(&m->table) - 1;
+  uint32_t id = m->metadata->len++;
+  m->remap[id] = idx;
+  m->metadata->live++;
+  m->metadata->live_bytes += get_element_len(&m->table, idx);
+  return id;
+}
+
+char *mut_get(strtable_mut_t *m, uint32_t id) {
+  uint32_t idx = lookup(m, id);
+  return idx == MUT_DELETED ? NULL : get_element(&m->table, idx);
+}
+
+int mut_get_len(strtable_mut_t *m, uint32_t id) {
+  uint32_t idx = lookup(m, id);
+  return idx == MUT_DELETED ? -1 : get_element_len(&m->table, idx);
+}
+
+char *mut_update(strtable_mut_t *m, uint32_t id, const char *str) {
+  uint32_t idx = lookup(m, id);
+  if (idx == MUT_DELETED) {
+    return NULL;
+  }
+
+  size_t len = strlen(str) + 1;
+  int old_len = get_element_len(&m->table, idx);
+  if (len <= old_len) {
+    // fits in the element's space; update in place.
+    char *el = get_element(&m->table, idx);
+    memcpy(el, str, len);
+    return el;
+  }
+
+  // relocate: append the new copy and remap id to it. append may compact,
+  // which moves the old copy (but not its length).
+  if (!append(m, str)) {
+    // string doesn't fit!
+    return NULL;
+  }
+  uint32_t new_idx = strtable_len(&m->table) - 1;
+  m->remap[id] = new_idx;
+  m->metadata->dead_bytes += old_len;
+  m->metadata->live_bytes += get_element_len(&m->table, new_idx) - old_len;
+
+  maybe_compact(m);
+  return mut_get(m, id);
+}
+
+int mut_delete(strtable_mut_t *m, uint32_t id) {
+  uint32_t idx = lookup(m, id);
+  if (idx == MUT_DELETED) {
+    return -1;
+  }
+  int len = get_element_len(&m->table, idx);
+  m->remap[id] = MUT_DELETED;
+  m->metadata->live--;
+  m->metadata->live_bytes -= len;
+  m->metadata->dead_bytes += len;
+
+  maybe_compact(m);
+  return 0;
+}
+
+void mut_compact(strtable_mut_t *m) {
+  uint32_t gen = m->metadata->generation + 1;
+  char *tpath = table_path(m->path, gen);
+  char *rpath = remap_path(m->path, "");
+  char *new_rpath = remap_path(m->path, ".new");
+  DEBUG_PRINT("compacting %s into generation %u (%lu dead bytes)\n", m->path,
+              gen, m->metadata->dead_bytes);
+
+  // write the live elements, in id order, into the next generation.
+  strtable_t next;
+  strtable_open(tpath, strtable_size(&m->table), &next);
+  mm_region_t region;
+  map_remap(new_rpath, m->metadata->capacity, &region);
+  memset(region.start, 0, region.size);
+  struct mut_metadata *metadata = region.start;
+  uint32_t *remap = region.start + sizeof(struct mut_metadata);
+
+  memcpy(metadata->hdr, "STMR", 4);
+  metadata->generation = gen;
+  metadata->capacity = m->metadata->capacity;
+  metadata->len = m->metadata->len;
+  metadata->live = m->metadata->live;
+  for (uint32_t id = 0; id < m->metadata->len; id++) {
+    if (m->remap[id] == MUT_DELETED) {
+      remap[id] = MUT_DELETED;
+      continue;
+    }
+    char *added = add_element(&next, get_element(&m->table, m->remap[id]));
+    // live elements always fit; they fit in the old generation.
+    assert(added);
+    remap[id] = strtable_len(&next) - 1;
+    metadata->live_bytes += get_element_len(&next, remap[id]);
+  }
+
+  // the new generation must be on disk before the remap file points to it.
+  msync(next.mm_region.start, next.mm_region.size, MS_SYNC);
+  msync(region.start, region.size, MS_SYNC);
+  assert(!rename(new_rpath, rpath));
+
+  // switch to the new generation, and remove the old one (generation 0 is the
+  // original table, which is left in place).
+  strtable_close(&m->table);
+  mm_close(&m->mm_region);
+  m->table = next;
+  m->mm_region = region;
+  init_remap(m);
+  if (gen > 1) {
+    char *old = table_path(m->path, gen - 1);
+    old = realloc(old, strlen(old) + 5);
+    strcat(old, ".stb");
+    unlink(old);
+    free(old);
+  }
+
+  free(new_rpath);
+  free(rpath);
+  free(tpath);
+}
+
+void mut_stats(strtable_mut_t *m, struct mut_stats *stats) {
+  stats->generation = m->metadata->generation;
+  stats->len = m->metadata->len;
+  stats->live = m->metadata->live;
+  stats->live_bytes = m->metadata->live_bytes;
+  stats->dead_bytes = m->metadata->dead_bytes;
+}
@@ -0,0 +1,127 @@
+#ifndef __STRTABLE_MUT_H__
+#define __STRTABLE_MUT_H__
+
+#include <stdint.h>
+
+#include "mm_util.h"
+#include "strtable.h"
+
+typedef struct strtable_mut_t strtable_mut_t;
+
+// ---------------------------------------------
+// mutable strtable usage and file format/layout
+// ---------------------------------------------
+//
+// A mutable strtable is a strtable whose elements can be updated (to strings of
+// any length) and deleted. Elements are named by stable ids rather than by
+// their index in the table: a remap table, stored next to the table in a file
+// with the ".stm" extension, maps each id to the index of the element's current
+// copy.
+//
+// Typical usage:
+//
+//    strtable_mut_t table;
+//    mut_open(filename, table_size_bytes, &table);
+//
+//    int64_t id = mut_add(&table, string);
+//    mut_update(&table, id, longer_string);
+//    char *str = mut_get(&table, id);
+//    mut_delete(&table, id);
+//    ...
+//    mut_close(&table);
+//
+// An update that fits in the element's current space is made in place;
+// otherwise the new string is appended and the id remapped to it. Deleting an
+// element marks its id as deleted (a tombstone). In both cases the space of the
+// old copy is dead, and the remap header counts it.
+//
+// Compaction rewrites the live elements into a new table (the next
+// generation), and then replaces the remap file with one pointing into the new
+// table by renaming it over the old one -- so the table is switched atomically,
+// and a crash leaves either the old or the new generation in use. Ids do not
+// change. Generation 0 is the table at path itself (so an existing strtable can
+// be opened as a mutable table; it is left unchanged once compacted), and
+// generation g > 0 is the table at path.g<g>, which is removed once the next
+// generation is in use. mut_compact compacts on request; tables are also
+// compacted when dead space exceeds live space, and when an element does not
+// fit but dead space would make room for it.
+//
+// The remap file format is:
+//
+// | STMR | generation | capacity | len | live | pad | live_bytes | dead_bytes |
+// | remap[0] | remap[1] | ...
+//
+// where len is the number of ids given out, live the number not deleted, and
+// capacity the number of remap entries allocated. live_bytes and dead_bytes are
+// the space (in the table's data section) used by live elements and by old
+// copies. Each remap entry is a uint32 index into the table, or MUT_DELETED.
+//
+// Other handles on the same table see the new generation once they reopen it.
+
+// remap entry of deleted ids.
+#define MUT_DELETED UINT32_MAX
+
+// remap metadata struct
+struct mut_metadata {
+  char hdr[4];         // header chars
+  uint32_t generation; // generation of the table in use
+  uint32_t capacity;   // number of remap entries
+  uint32_t len;        // number of ids
+  uint32_t live;       // number of ids not deleted
+  uint32_t pad;        // unused
+  uint64_t live_bytes; // bytes used by live elements
+  uint64_t dead_bytes; // bytes used by old copies of elements
+};
+
+// mutable table struct
+struct strtable_mut_t {
+  strtable_t table;              // current generation of the table
+  struct mut_metadata *metadata; // pointer to remap metadata/start
+  uint32_t *remap;               // element index of each id
+  mm_region_t mm_region;         // memory map info of remap file
+  char *path;                    // path the table was opened with
+};
+
+// mutable table statistics
+struct mut_stats {
+  uint32_t generation; // generation of the table in use
+  uint32_t len;        // number of ids
+  uint32_t live;       // number of ids not deleted
+  uint64_t live_bytes; // bytes used by live elements
+  uint64_t dead_bytes; // bytes used by old copies of elements
+};
+
+// Open a mutable table at path. If size is nonzero and there is no table yet,
+// it is created with the given size; generations created by compaction have
+// the same size.
+void mut_open(const char *path, uint64_t size, strtable_mut_t *m);
+
+// Close a mutable table.
+void mut_close(strtable_mut_t *m);
+
+// Add an element. Returns its id, or -1 if it did not fit in the table.
+int64_t mut_add(strtable_mut_t *m, const char *str);
+
+// Return the element with the given id, or null if id is out of range or the
+// element was deleted.
+char *mut_get(strtable_mut_t *m, uint32_t id);
+
+// Return the length of the element with the given id (the space available for
+// in-place changes), or -1 if id is out of range or the element was deleted.
+int mut_get_len(strtable_mut_t *m, uint32_t id);
+
+// Replace the element with the given id by str. Returns pointer to the new
+// copy, or null if id is out of range or deleted, or str did not fit.
+char *mut_update(strtable_mut_t *m, uint32_t id, const char *str);
+
+// Delete the element with the given id. Returns 0, or -1 if id is out of range
+// or already deleted.
+int mut_delete(strtable_mut_t *m, uint32_t id);
+
+// Compact the table into a new generation holding only live elements.
+void mut_compact(strtable_mut_t *m);
+
+// Get statistics about the table.
+void mut_stats(strtable_mut_t *m, struct mut_stats *stats);
+
+#endif
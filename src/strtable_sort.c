@@ -0,0 +1,225 @@
+#define _GNU_SOURCE
+#include "strtable_sort.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// A run of the index array being sorted or merged by one thread.
+struct run {
+  strtable_t *table;         // table being sorted
+  const strtable_key_t *key; // sort key of each element
+  uint32_t *src;             // element indicies to sort/merge
+  uint32_t *dst;             // merge output
+  uint32_t lo;               // first position in run
+  uint32_t mid;              // start of second half (merges only)
+  uint32_t hi;               // one past last position in run
+};
+
+// Helper function that returns the name field of a nav element.
+static const char *name_field(const char *element) {
+  const char *name = strrchr(element, ';');
+  return name ? name + 1 : element;
+}
+
+const strtable_key_t strtable_key_name = {"name", name_field};
+
+// Helper function that returns the sort key of element idx.
+static inline const char *key_of(strtable_t *table, const strtable_key_t *key,
+                                 unsigned int idx) {
+  char *element = get_element(table, idx);
+  return key ? key->get(element) : element;
+}
+
+// Helper function that returns the key name stored in a sorted table (between
+// its index and its data), or NULL if there is no room for one.
+static char *key_tag(strtable_t *table) {
+  uint32_t n = strtable_len(table);
+  char *index_end = table->version == 2 ? (char *)(table->elements64 + n)
+                                        : (char *)(table->elements + n);
+  char *data = n ? get_element(table, n - 1)
+                 : (char *)table->metadata + strtable_size(table);
+  return data - index_end >= KEY_TAG_LEN ? index_end : NULL;
+}
+
+// Compare two element indicies by their keys.
+static int cmp_idx(const void *a, const void *b, void *run) {
+  struct run *r = run;
+  return strcmp(key_of(r->table, r->key, *(uint32_t *)a),
+                key_of(r->table, r->key, *(uint32_t *)b));
+}
+
+// Thread function that sorts a run in place.
+static void *sort_run(void *arg) {
+  struct run *r = arg;
+  qsort_r(r->src + r->lo, r->hi - r->lo, sizeof(uint32_t), cmp_idx, r);
+  return NULL;
+}
+
+// Thread function that merges the sorted halves [lo, mid) and [mid, hi) of
+// src into dst.
+static void *merge_run(void *arg) {
+  struct run *r = arg;
+  uint32_t i = r->lo;
+  uint32_t j = r->mid;
+  uint32_t k = r->lo;
+  while (i < r->mid && j < r->hi) {
+    if (cmp_idx(&r->src[j], &r->src[i], r) < 0) {
+      r->dst[k++] = r->src[j++];
+    } else {
+      r->dst[k++] = r->src[i++];
+    }
+  }
+  memcpy(r->dst + k, r->src + i, (r->mid - i) * sizeof(uint32_t));
+  k += r->mid - i;
+  memcpy(r->dst + k, r->src + j, (r->hi - j) * sizeof(uint32_t));
+  return NULL;
+}
+
+// Sort the element indicies of table by key using nthreads threads. Returns a
+// malloc'd array that must be freed by the caller.
+static uint32_t *sort_indicies(strtable_t *table, const strtable_key_t *key,
+                               int nthreads) {
+  uint32_t n = strtable_len(table);
+  // allocate at least one entry so that empty tables get non-NULL arrays.
+  uint32_t *idx = malloc((n ? n : 1) * sizeof(uint32_t));
+  uint32_t *tmp = malloc((n ? n : 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; i++) {
+    idx[i] = i;
+  }
+
+  if (nthreads > n) {
+    nthreads = n ? n : 1;
+  }
+  pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+  struct run *runs = malloc(nthreads * sizeof(struct run));
+
+  // sort one run per thread.
+  uint32_t width = (n + nthreads - 1) / nthreads;
+  for (int t = 0; t < nthreads; t++) {
+    runs[t] = (struct run){table, key, idx, tmp, 0, 0, 0};
+    runs[t].lo = t * width < n ? t * width : n;
+    runs[t].hi = runs[t].lo + width < n ? runs[t].lo + width : n;
+    pthread_create(&threads[t], NULL, sort_run, &runs[t]);
+  }
+  for (int t = 0; t < nthreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  // merge pairs of runs until there is a single run.
+  for (; width < n; width *= 2) {
+    int nmerges = 0;
+    for (uint32_t lo = 0; lo < n; lo += 2 * width) {
+      struct run *r = &runs[nmerges];
+      *r = (struct run){table, key, idx, tmp, lo, 0, 0};
+      r->mid = lo + width < n ? lo + width : n;
+      r->hi = lo + 2 * width < n ? lo + 2 * width : n;
+      pthread_create(&threads[nmerges++], NULL, merge_run, r);
+    }
+    for (int t = 0; t < nmerges; t++) {
+      pthread_join(threads[t], NULL);
+    }
+    uint32_t *swap = idx;
+    idx = tmp;
+    tmp = swap;
+  }
+
+  free(runs);
+  free(threads);
+  free(tmp);
+  return idx;
+}
+
+void strtable_compact(strtable_t *src, const char *dst_path,
+                      const strtable_key_t *key, int nthreads) {
+  assert(src);
+  assert(!key || strlen(key->name) < KEY_TAG_LEN);
+  if (!nthreads) {
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  uint32_t n = strtable_len(src);
+  uint32_t *idx = sort_indicies(src, key, nthreads);
+
+  // size the new table to fit the elements and the key name exactly.
+  uint64_t data_size = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    data_size += strlen(get_element(src, i)) + 1;
+  }
+  uint64_t size = strtable_size_for(n, data_size + KEY_TAG_LEN);
+  DEBUG_PRINT("compacting %u elements into %lu bytes\n", n, size);
+
+  strtable_t dst;
+  strtable_open((char *)dst_path, size, &dst);
+  for (uint32_t i = 0; i < n; i++) {
+    char *added = add_element(&dst, get_element(src, idx[i]));
+    assert(added);
+  }
+  // record the key between the index and the data.
+  char *tag = key_tag(&dst);
+  assert(tag);
+  memset(tag, 0, KEY_TAG_LEN);
+  if (key) {
+    strcpy(tag, key->name);
+  }
+  // mark the table as sorted; this freezes it.
+  strtable_freeze(&dst);
+  strtable_close(&dst);
+
+  free(idx);
+}
+
+int strtable_is_sorted(strtable_t *table) { return strtable_frozen(table); }
+
+int strtable_sorted_by(strtable_t *table, const strtable_key_t *key) {
+  if (!strtable_is_sorted(table)) {
+    return 0;
+  }
+  const char *name = key ? key->name : "";
+  char *tag = key_tag(table);
+  if (!tag) {
+    // no key recorded; sorted by the whole element.
+    return !*name;
+  }
+  return strncmp(tag, name, KEY_TAG_LEN) == 0;
+}
+
+unsigned int strtable_lower_bound(strtable_t *table, const strtable_key_t *key,
+                                  const char *str) {
+  assert(strtable_sorted_by(table, key));
+  unsigned int lo = 0;
+  unsigned int hi = strtable_len(table);
+  while (lo < hi) {
+    unsigned int mid = lo + (hi - lo) / 2;
+    if (strcmp(key_of(table, key, mid), str) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+unsigned int strtable_prefix_range(strtable_t *table, const strtable_key_t *key,
+                                   const char *prefix, unsigned int *first,
+                                   unsigned int *last) {
+  size_t len = strlen(prefix);
+  *first = strtable_lower_bound(table, key, prefix);
+
+  // elements starting with prefix follow first; find the first that doesn't.
+  unsigned int lo = *first;
+  unsigned int hi = strtable_len(table);
+  while (lo < hi) {
+    unsigned int mid = lo + (hi - lo) / 2;
+    if (strncmp(key_of(table, key, mid), prefix, len) <= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *last = lo;
+  return *last - *first;
+}
@@ -0,0 +1,89 @@
+#ifndef __STRTABLE_SORT_H__
+#define __STRTABLE_SORT_H__
+
+#include <stdint.h>
+
+#include "strtable.h"
+
+// ---------------------------------
+// sorted (frozen) strtable searches
+// ---------------------------------
+//
+// A strtable can be compacted into a sorted table: a new table holding the
+// same elements, with element i being the one with the i-th smallest key (in
+// strcmp order). An element's key is the element itself, or the part of it
+// picked out by a key (such as strtable_key_name, the name field of a
+// "lon;lat;dist;name" nav element). Sorted tables are marked with the header
+// characters STBS instead of STBL (STS2 instead of STB2 for version 2 tables),
+// and are frozen -- add_element always fails on them. Otherwise they are
+// ordinary strtables and are opened and read with the strtable functions.
+//
+// The name of the key a table was sorted by is stored in the table, in
+// KEY_TAG_LEN bytes between its index and its data (all zeros when sorted by
+// the whole element; tables without room for it are read as sorted by the
+// whole element). Searches must use the same key, and assert that they do.
+//
+// Typical usage:
+//
+//    strtable_t table;
+//    strtable_open(filename, 0, &table);
+//    strtable_compact(&table, sorted_filename, &strtable_key_name, 0);
+//    strtable_close(&table);
+//
+//    strtable_t sorted;
+//    strtable_open(sorted_filename, 0, &sorted);
+//
+//    // Iterate, in order, over all elements named "HD 1...".
+//    unsigned int first, last;
+//    strtable_prefix_range(&sorted, &strtable_key_name, "HD 1", &first, &last);
+//    for (unsigned int i = first; i < last; i++) {
+//      char *str = get_element(&sorted, i);
+//      ...
+//    }
+//
+// Searches are binary searches over the table's index, so they take
+// O(log n) string comparisons.
+
+// Number of bytes holding the key name in a sorted table.
+#define KEY_TAG_LEN 16
+
+typedef struct strtable_key_t strtable_key_t;
+
+// sort key struct. get returns a pointer into element, to its null terminated
+// key; name must be shorter than KEY_TAG_LEN.
+struct strtable_key_t {
+  const char *name;                        // key name stored in sorted tables
+  const char *(*get)(const char *element); // returns the key of element
+};
+
+// Key picking out the name field of a nav element (the part after its last
+// ';', or all of it if it has none).
+extern const strtable_key_t strtable_key_name;
+
+// Write a copy of src sorted by key (the whole element if key is NULL), and
+// frozen, to dst_path (".stb" is appended). The copy is exactly large enough to
+// hold the elements of src and the key name. The sort is split across nthreads
+// threads; if nthreads is 0, one thread per CPU is used.
+void strtable_compact(strtable_t *src, const char *dst_path,
+                      const strtable_key_t *key, int nthreads);
+
+// Returns nonzero if table is a sorted table.
+int strtable_is_sorted(strtable_t *table);
+
+// Returns nonzero if table is a sorted table sorted by key (the whole element
+// if key is NULL).
+int strtable_sorted_by(strtable_t *table, const strtable_key_t *key);
+
+// Return the index of the first element whose key is not less than str, or
+// the table length if every key is less than str. table must be sorted by key.
+unsigned int strtable_lower_bound(strtable_t *table, const strtable_key_t *key,
+                                  const char *str);
+
+// Find the elements whose key starts with prefix. On return, elements first
+// through last - 1 are those elements (first == last if there are none).
+// Returns the number of elements found. table must be sorted by key.
+unsigned int strtable_prefix_range(strtable_t *table, const strtable_key_t *key,
+                                   const char *prefix, unsigned int *first,
+                                   unsigned int *last);
+
+#endif
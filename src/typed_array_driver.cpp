@@ -0,0 +1,38 @@
+#include "disk_array.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+void usage(const char *name) {
+  printf("usage: %s name [n]\n"
+         "  opens the array name as an array of uint64_t (creating it with n\n"
+         "  elements 0, 1, ... if n is given), and prints its size, sum and\n"
+         "  largest element.\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  try {
+    if (argc > 2) {
+      auto arr = disk_array<uint64_t>::create(argv[1], atoi(argv[2]));
+      std::iota(arr.begin(), arr.end(), 0);
+    }
+    disk_array<uint64_t> arr(argv[1]);
+    uint64_t sum = std::accumulate(arr.begin(), arr.end(), uint64_t{0});
+    auto max = std::max_element(arr.begin(), arr.end());
+    printf("%zu elements, sum %lu, max %lu\n", arr.size(), sum,
+           max != arr.end() ? *max : 0);
+  } catch (const std::exception &e) {
+    printf("%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,195 @@
+#include "validate.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "util.h"
+
+#define AS_INT(expr) *((uint32_t *)(expr))
+
+// Helper function that returns path with the ".vwm" extension (malloc'd).
+static char *vwm_path(const char *path) {
+  char *tpath = malloc(strlen(path) + 5);
+  strcpy(tpath, path);
+  strcat(tpath, ".vwm");
+  return tpath;
+}
+
+// Helper function that sets the identity (device and inode) of the file open
+// as fd in id.
+static void file_id(int fd, struct val_mark *id) {
+  struct stat st;
+  memset(&st, 0, sizeof(st));
+  if (fd != -1) {
+    fstat(fd, &st);
+  }
+  id->dev = st.st_dev;
+  id->ino = st.st_ino;
+}
+
+// Helper function that returns nonzero if mark was made for the file whose
+// identity is id.
+static int same_file(struct val_mark *mark, struct val_mark *id) {
+  return mark->dev == id->dev && mark->ino == id->ino;
+}
+
+// Helper function that empties a watermark for a file of size bytes (and
+// identity id).
+static void reset(struct val_mark *mark, uint64_t size, struct val_mark *id) {
+  memcpy(mark->hdr, "VWMK", 4);
+  mark->runs = 0;
+  mark->dev = id->dev;
+  mark->ino = id->ino;
+  mark->anchor = FNV_INIT;
+  mark->size = size;
+  mark->count = 0;
+  mark->end = 0;
+  mark->checksum = FNV_INIT;
+}
+
+void val_load(const char *path, struct val_mark *mark) {
+  char *tpath = vwm_path(path);
+  int fd = open(tpath, O_RDONLY);
+  free(tpath);
+  if (fd < 0 || read(fd, mark, sizeof(*mark)) != sizeof(*mark) ||
+      memcmp(mark->hdr, "VWMK", 4)) {
+    struct val_mark none;
+    memset(&none, 0, sizeof(none));
+    reset(mark, 0, &none);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+int val_save(const char *path, struct val_mark *mark) {
+  char *tpath = vwm_path(path);
+  int fd = open(tpath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  free(tpath);
+  if (fd < 0) {
+    return -1;
+  }
+  int err = write(fd, mark, sizeof(*mark)) == sizeof(*mark) ? 0 : -1;
+  close(fd);
+  return err;
+}
+
+// Helper function that counts a validation, and returns nonzero if it is to be
+// a full pass.
+static int full_pass(struct val_mark *mark, int full) {
+  if (full || ++mark->runs >= VAL_FULL_EVERY) {
+    mark->runs = 0;
+    return 1;
+  }
+  return 0;
+}
+
+// Helper function that extends a strtable prefix checksum by element idx.
+static uint64_t hash_element(uint64_t h, strtable_t *tbl, uint32_t idx) {
+  return fnv1a(h, get_element(tbl, idx), get_element_len(tbl, idx));
+}
+
+uint32_t val_table_start(struct val_mark *mark, strtable_t *tbl, int full,
+                         int *mismatch) {
+  uint32_t len = strtable_len(tbl);
+  uint64_t size = strtable_size(tbl);
+  struct val_mark id;
+  file_id(tbl->mm_region.fd, &id);
+  *mismatch = 0;
+  if (!same_file(mark, &id) || mark->size != size || mark->count > len ||
+      mark->end ||
+      (mark->count &&
+       hash_element(FNV_INIT, tbl, mark->count - 1) != mark->anchor)) {
+    DEBUG_PRINT("watermark does not match; validating everything\n");
+    reset(mark, size, &id);
+    return 0;
+  }
+  if (full_pass(mark, full)) {
+    uint64_t h = FNV_INIT;
+    for (uint32_t i = 0; i < mark->count; i++) {
+      h = hash_element(h, tbl, i);
+    }
+    if (h != mark->checksum) {
+      DEBUG_PRINT("prefix of %lu elements changed\n", mark->count);
+      *mismatch = 1;
+      reset(mark, size, &id);
+    }
+  }
+  DEBUG_PRINT("validating from element %lu of %u\n", mark->count, len);
+  return mark->count;
+}
+
+void val_table_extend(struct val_mark *mark, strtable_t *tbl, uint32_t idx) {
+  assert(idx == mark->count);
+  mark->checksum = hash_element(mark->checksum, tbl, idx);
+  mark->anchor = hash_element(FNV_INIT, tbl, idx);
+  mark->count++;
+}
+
+// Helper function that returns the anchor of a list whose validated blocks
+// run from first to end: the hash of the last of them (header, data and
+// footer), or FNV_INIT if there are none. Returns 0 if the footer before end
+// does not fit.
+static uint64_t list_anchor(char *start, uint64_t first, uint64_t end) {
+  if (end == first) {
+    return FNV_INIT;
+  }
+  uint64_t len = AS_INT(start + end - sizeof(uint32_t)) + 2 * sizeof(uint32_t);
+  if (len > end - first) {
+    return 0;
+  }
+  return fnv1a(FNV_INIT, start + end - len, len);
+}
+
+int val_list(struct val_mark *mark, block_list_t *lst, int full,
+             int *mismatch) {
+  char *start = lst->start;
+  uint64_t size = lst->mm_region.size;
+  // the first block follows the 8 byte head.
+  uint64_t first = 2 * sizeof(uint32_t);
+  struct val_mark id;
+  file_id(lst->mm_region.fd, &id);
+  *mismatch = 0;
+  if (!same_file(mark, &id) || mark->size != size || mark->end > size ||
+      mark->end < first ||
+      list_anchor(start, first, mark->end) != mark->anchor) {
+    DEBUG_PRINT("watermark does not match; validating everything\n");
+    reset(mark, size, &id);
+    mark->end = first;
+  } else if (full_pass(mark, full) &&
+             fnv1a(FNV_INIT, start + first, mark->end - first) !=
+                 mark->checksum) {
+    DEBUG_PRINT("prefix of %lu blocks changed\n", mark->count);
+    *mismatch = 1;
+    reset(mark, size, &id);
+    mark->end = first;
+  }
+
+  DEBUG_PRINT("validating from block %lu (offset %lu)\n", mark->count,
+              mark->end);
+  // each block needs its header, data and footer, and the tail after it.
+  while (mark->end + sizeof(uint32_t) <= size) {
+    uint32_t block_size = AS_INT(start + mark->end);
+    if (!block_size) {
+      // the tail.
+      return 0;
+    }
+    uint64_t block_end = mark->end + block_size + 2 * sizeof(uint32_t);
+    if (block_end + 2 * sizeof(uint32_t) > size ||
+        AS_INT(start + block_end - sizeof(uint32_t)) != block_size) {
+      DEBUG_PRINT("invalid block at offset %lu\n", mark->end);
+      return -1;
+    }
+    mark->checksum =
+        fnv1a(mark->checksum, start + mark->end, block_end - mark->end);
+    mark->anchor = fnv1a(FNV_INIT, start + mark->end, block_end - mark->end);
+    mark->end = block_end;
+    mark->count++;
+  }
+  // no tail.
+  return -1;
+}
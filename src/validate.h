@@ -0,0 +1,101 @@
+#ifndef __VALIDATE_H__
+#define __VALIDATE_H__
+
+#include <stdint.h>
+
+#include "block_list.h"
+#include "strtable.h"
+
+// ---------------------------------
+// incremental validation watermarks
+// ---------------------------------
+//
+// Elements (or blocks) that were valid when a file was last validated are
+// not changed by appending to it. A watermark records how much of a file has
+// been validated, and a checksum of that prefix, in a small file next to it
+// (with the ".vwm" extension). Validation then only checks what was added
+// since, and the prefix is only read again, to compare its checksum, on a full
+// pass: when asked to, and every VAL_FULL_EVERY validations.
+//
+// The boot sequence only keeps watermarks when asked to (-validate=incremental;
+// see nav_system.c), since they are files written next to the databases.
+//
+// Typical usage:
+//
+//    struct val_mark mark;
+//    val_load(filename, &mark);
+//    int mismatch = 0;
+//    uint32_t len = strtable_len(&table);
+//    for (uint32_t i = val_table_start(&mark, &table, full, &mismatch);
+//         i < len; i++) {
+//      if (!element_is_valid(&table, i)) {
+//        break;
+//      }
+//      val_table_extend(&mark, &table, i);
+//    }
+//    val_save(filename, &mark);
+//
+// The checksum of a strtable's prefix is the FNV-1a hash of the space of each
+// of its elements (get_element_len bytes from get_element), in index order; of
+// a list's, the FNV-1a hash of its bytes from the first block to the end of
+// the last validated block. Both can thus be extended as elements and blocks
+// are validated.
+//
+// A watermark that does not match its file is discarded, and the whole file
+// validated: one made for a different file (device and inode), or for a file
+// of a different size, or that covers more than the file holds, or whose last
+// validated element or block no longer matches the anchor, the FNV-1a hash of
+// that element or block recorded with it. These checks read one element or
+// block, so appends (through any process) keep the watermark, and a file that
+// was replaced or rewritten is noticed unless its new contents happen to end
+// the prefix with the same element.
+//
+// Anything else written in place below the watermark is only noticed by a
+// full pass, which then validates the file again from the start. In
+// particular, the watermark is unsound for tables updated in place with
+// strtable_mut (see strtable_mut.h): an element rewritten by mut_update may
+// be invalid until the next full pass. Use full validation for them.
+//
+// Watermarks are written without syncing: a lost watermark only means more is
+// validated at the next boot.
+
+// Number of validations between full passes.
+#define VAL_FULL_EVERY 16
+
+// watermark file contents
+struct val_mark {
+  char hdr[4];       // header chars
+  uint32_t runs;     // validations since the last full pass
+  uint64_t dev;      // device of the validated file
+  uint64_t ino;      // inode of the validated file
+  uint64_t anchor;   // FNV-1a hash of the last validated element or block
+  uint64_t size;     // size of the validated file
+  uint64_t count;    // number of elements or blocks validated
+  uint64_t end;      // list offset of the first block not validated (lists)
+  uint64_t checksum; // FNV-1a hash of the validated prefix
+};
+
+// Load the watermark of the file path (".vwm" is appended). A missing or
+// invalid watermark loads as an empty one.
+void val_load(const char *path, struct val_mark *mark);
+
+// Save the watermark of the file path. Returns 0, or -1 if it could not be
+// written.
+int val_save(const char *path, struct val_mark *mark);
+
+// Start validating tbl: returns the index of the first element to validate.
+// On a full pass (if full is nonzero, or it is time for one), the prefix
+// checksum is compared, and mismatch set to 1 if it does not match.
+uint32_t val_table_start(struct val_mark *mark, strtable_t *tbl, int full,
+                         int *mismatch);
+
+// Mark element idx (the first element not yet validated) as valid.
+void val_table_extend(struct val_mark *mark, strtable_t *tbl, uint32_t idx);
+
+// Validate the blocks of lst added since the watermark (after a full pass, as
+// for val_table_start): each block's header and footer must match and lie
+// within the list. Returns 0, or -1 if a block is invalid (the watermark is
+// then at that block).
+int val_list(struct val_mark *mark, block_list_t *lst, int full, int *mismatch);
+
+#endif
@@ -0,0 +1,439 @@
+#define _GNU_SOURCE
+#include "wal.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "util.h"
+
+// Helper function that rounds len up to a multiple of 8.
+static uint64_t pad8(uint64_t len) { return (len + 7) & ~(uint64_t)7; }
+
+// Helper function that writes len bytes at off, retrying short writes.
+// Returns 0, or -1 on error.
+static int pwrite_all(int fd, const void *data, uint64_t len, uint64_t off) {
+  while (len) {
+    ssize_t n = pwrite(fd, data, len, off);
+    if (n < 0) {
+      return -1;
+    }
+    data += n;
+    len -= n;
+    off += n;
+  }
+  return 0;
+}
+
+// -------------------------
+// record buffers
+// -------------------------
+
+// Helper function that empties a buffer, leaving room for a group header.
+static void buf_reset(struct wal_buf *buf) {
+  buf->size = sizeof(struct wal_group);
+  buf->n = 0;
+  buf->txns = 0;
+}
+
+static void buf_init(struct wal_buf *buf) {
+  buf->cap = 4096;
+  buf->data = malloc(buf->cap);
+  buf_reset(buf);
+}
+
+// Helper function that adds a record of len bytes to buf, and returns a
+// pointer to where its data goes.
+static char *buf_add(struct wal_buf *buf, uint32_t file, uint32_t kind,
+                     uint64_t off, uint32_t len) {
+  uint64_t need = buf->size + sizeof(struct wal_record) + pad8(len);
+  if (need > buf->cap) {
+    while (need > buf->cap) {
+      buf->cap *= 2;
+    }
+    buf->data = realloc(buf->data, buf->cap);
+  }
+  struct wal_record *rec = (struct wal_record *)(buf->data + buf->size);
+  rec->file = file;
+  rec->kind = kind;
+  rec->len = len;
+  rec->off = off;
+  char *data = (char *)(rec + 1);
+  // zero the padding, so that logged bytes are always the same.
+  memset(data + len, 0, pad8(len) - len);
+  buf->size = need;
+  buf->n++;
+  return data;
+}
+
+// Helper function that returns the next record of buf after rec (the first if
+// rec is NULL), or NULL after the last.
+static struct wal_record *buf_next(struct wal_buf *buf,
+                                   struct wal_record *rec) {
+  char *next = rec ? (char *)(rec + 1) + pad8(rec->len)
+                   : buf->data + sizeof(struct wal_group);
+  return next < buf->data + buf->size ? (struct wal_record *)next : NULL;
+}
+
+// -------------------------
+// applying records
+// -------------------------
+
+// Helper function that returns the list tail of f after the committed appends.
+static uint64_t list_tail(struct wal_file *f) {
+  if (!f->tail) {
+    init_tail(f->lst);
+    f->tail = f->lst->tail - f->lst->start;
+  }
+  return f->tail;
+}
+
+// Helper function that copies n records (size bytes at recs) into the attached
+// files. Returns 0, or -1 if a record is not for an attached file or does not
+// fit in it (records before it are applied).
+static int apply(wal_t *wal, char *recs, uint64_t size, uint32_t n) {
+  char *end = recs + size;
+  for (uint32_t i = 0; i < n; i++) {
+    struct wal_record *rec = (struct wal_record *)recs;
+    if (recs + sizeof(*rec) > end ||
+        (char *)(rec + 1) + pad8(rec->len) > end) {
+      return -1;
+    }
+    struct wal_file *f =
+        rec->file < WAL_MAX_FILES ? &wal->files[rec->file] : NULL;
+    if (!f || !f->region || rec->off + rec->len > f->region->size ||
+        (rec->kind == WAL_APPEND &&
+         (!f->lst || rec->len < 4 * sizeof(uint32_t)))) {
+      DEBUG_PRINT("invalid record for file %u at %lu\n", rec->file, rec->off);
+      return -1;
+    }
+    char *dst = f->region->start + rec->off;
+    char *data = (char *)(rec + 1);
+    if (rec->kind == WAL_APPEND) {
+      // write the header (the old tail) last, so that readers of the list
+      // stop at the old tail until the block is in place (see bl_append_v).
+      memcpy(dst + sizeof(uint32_t), data + sizeof(uint32_t),
+             rec->len - sizeof(uint32_t));
+      __atomic_store_n((uint32_t *)dst, *(uint32_t *)data, __ATOMIC_RELEASE);
+      f->lst->tail = dst + rec->len - 2 * sizeof(uint32_t);
+      if (f->lst->notify) {
+        f->lst->notify(f->lst);
+      }
+    } else {
+      memcpy(dst, data, rec->len);
+    }
+    recs = (char *)(rec + 1) + pad8(rec->len);
+  }
+  return 0;
+}
+
+// -------------------------
+// log file
+// -------------------------
+
+// Helper function that syncs the attached files and empties the log, so that
+// the next group written is numbered seq. Returns 0, or -1 on error.
+static int checkpoint(wal_t *wal, uint64_t seq) {
+  for (int i = 0; i < WAL_MAX_FILES; i++) {
+    mm_region_t *region = wal->files[i].region;
+    if (region && msync(region->start, region->size, MS_SYNC)) {
+      DEBUG_PRINT("could not sync file %d\n", i);
+      return -1;
+    }
+  }
+  // groups left behind if the truncation is lost are out of sequence.
+  struct wal_header header = {{'W', 'A', 'L', 'F'}, 0, seq};
+  if (pwrite_all(wal->fd, &header, sizeof(header), 0) ||
+      ftruncate(wal->fd, sizeof(header)) || fdatasync(wal->fd)) {
+    return -1;
+  }
+  wal->size = sizeof(header);
+  DEBUG_PRINT("checkpoint; next group %lu\n", seq);
+  return 0;
+}
+
+// Helper function that writes the group being filled, syncs the log and
+// applies the group. Called, and returns, with the lock held.
+static void write_group(wal_t *wal) {
+  wal->writing = 1;
+  struct wal_buf tmp = wal->flush;
+  wal->flush = wal->group;
+  wal->group = tmp;
+  uint64_t seq = wal->seq++;
+  pthread_mutex_unlock(&wal->lock);
+
+  struct wal_buf *buf = &wal->flush;
+  struct wal_group *group = (struct wal_group *)buf->data;
+  memcpy(group->hdr, "WALG", 4);
+  group->n = buf->n;
+  group->size = buf->size - sizeof(*group);
+  group->seq = seq;
+  group->checksum = fnv1a(FNV_INIT, group + 1, group->size);
+  int ok = !wal->error &&
+           !pwrite_all(wal->fd, buf->data, buf->size, wal->size) &&
+           !fdatasync(wal->fd);
+  if (ok) {
+    wal->size += buf->size;
+    // the records were checked when they were staged.
+    assert(!apply(wal, (char *)(group + 1), group->size, group->n));
+    if (wal->size > WAL_CHECKPOINT) {
+      checkpoint(wal, seq + 1);
+    }
+  }
+
+  pthread_mutex_lock(&wal->lock);
+  if (!ok) {
+    DEBUG_PRINT("could not write group %lu\n", seq);
+    wal->error = 1;
+  }
+  wal->groups++;
+  wal->txns += buf->txns;
+  wal->syncs++;
+  buf_reset(buf);
+  wal->durable = seq + 1;
+  wal->writing = 0;
+  pthread_cond_broadcast(&wal->cond);
+}
+
+void wal_open(const char *fname, wal_t *wal) {
+  memset(wal, 0, sizeof(*wal));
+  char *tpath = malloc(strlen(fname) + 5);
+  strcpy(tpath, fname);
+  strcat(tpath, ".wal");
+  DEBUG_PRINT("opening log %s\n", tpath);
+  wal->fd = open(tpath, O_RDWR | O_CREAT, 0600);
+  assert(wal->fd >= 0);
+  free(tpath);
+
+  struct wal_header header;
+  if (pread(wal->fd, &header, sizeof(header), 0) == sizeof(header)) {
+    assert(!memcmp(header.hdr, "WALF", 4));
+    wal->seq = header.seq;
+  } else {
+    // new log.
+    struct wal_header empty = {{'W', 'A', 'L', 'F'}, 0, 0};
+    assert(!pwrite_all(wal->fd, &empty, sizeof(empty), 0));
+    assert(!fdatasync(wal->fd));
+  }
+  wal->size = lseek(wal->fd, 0, SEEK_END);
+  wal->durable = wal->seq;
+  pthread_mutex_init(&wal->lock, NULL);
+  pthread_cond_init(&wal->cond, NULL);
+  buf_init(&wal->group);
+  buf_init(&wal->flush);
+}
+
+// Helper function that attaches region (of owner) as file id.
+static struct wal_file *attach(wal_t *wal, uint32_t id, mm_region_t *region,
+                               void *owner) {
+  assert(id < WAL_MAX_FILES);
+  assert(!wal->files[id].region);
+  // the log writes to the file through its mapping.
+  assert(region->fd != -1);
+  wal->files[id].region = region;
+  wal->files[id].owner = owner;
+  return &wal->files[id];
+}
+
+void wal_attach_array(wal_t *wal, uint32_t id, disk_array_t *arr) {
+  attach(wal, id, &arr->mm_region, arr);
+}
+
+void wal_attach_table(wal_t *wal, uint32_t id, strtable_t *tbl) {
+  attach(wal, id, &tbl->mm_region, tbl);
+}
+
+void wal_attach_list(wal_t *wal, uint32_t id, block_list_t *lst) {
+  attach(wal, id, &lst->mm_region, lst)->lst = lst;
+}
+
+uint64_t wal_recover(wal_t *wal) {
+  char *log = malloc(wal->size);
+  assert(!wal->size || log);
+  uint64_t size = pread(wal->fd, log, wal->size, 0);
+  uint64_t off = sizeof(struct wal_header);
+  uint64_t replayed = 0;
+  while (off + sizeof(struct wal_group) <= size) {
+    struct wal_group *group = (struct wal_group *)(log + off);
+    if (memcmp(group->hdr, "WALG", 4) || group->seq != wal->seq ||
+        group->size > size - off - sizeof(*group) ||
+        fnv1a(FNV_INIT, group + 1, group->size) != group->checksum) {
+      // the end of the log, or a group that was never committed.
+      break;
+    }
+    if (apply(wal, (char *)(group + 1), group->size, group->n)) {
+      break;
+    }
+    DEBUG_PRINT("replayed group %lu (%u records)\n", group->seq, group->n);
+    replayed++;
+    wal->seq++;
+    off += sizeof(*group) + group->size;
+  }
+  free(log);
+
+  wal->durable = wal->seq;
+  wal->recovered = 1;
+  assert(!checkpoint(wal, wal->seq));
+  return replayed;
+}
+
+int wal_checkpoint(wal_t *wal) {
+  pthread_mutex_lock(&wal->lock);
+  while (wal->writing) {
+    pthread_cond_wait(&wal->cond, &wal->lock);
+  }
+  int err = checkpoint(wal, wal->seq);
+  pthread_mutex_unlock(&wal->lock);
+  return err;
+}
+
+void wal_close(wal_t *wal) {
+  if (wal->recovered && !wal->error) {
+    wal_checkpoint(wal);
+  }
+  close(wal->fd);
+  free(wal->group.data);
+  free(wal->flush.data);
+  pthread_cond_destroy(&wal->cond);
+  pthread_mutex_destroy(&wal->lock);
+}
+
+// -------------------------
+// transactions
+// -------------------------
+
+void wal_txn_begin(wal_t *wal, wal_txn_t *txn) {
+  txn->wal = wal;
+  buf_init(&txn->buf);
+}
+
+// Helper function that returns the id of the file attached for owner, or -1.
+static int find_file(wal_t *wal, void *owner) {
+  for (int i = 0; i < WAL_MAX_FILES; i++) {
+    if (wal->files[i].region && wal->files[i].owner == owner) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int wal_put(wal_txn_t *txn, uint32_t id, uint64_t off, const void *data,
+            uint32_t len) {
+  if (id >= WAL_MAX_FILES || !txn->wal->files[id].region ||
+      off + len > txn->wal->files[id].region->size) {
+    return -1;
+  }
+  memcpy(buf_add(&txn->buf, id, WAL_PUT, off, len), data, len);
+  return 0;
+}
+
+int wal_array_set(wal_txn_t *txn, disk_array_t *arr, uint64_t idx,
+                  const void *elem) {
+  int id = find_file(txn->wal, arr);
+  if (id < 0 || idx >= *arr->n) {
+    return -1;
+  }
+  uint64_t off = (char *)arr->array - (char *)arr->mm_region.start +
+                 idx * *arr->element_size;
+  return wal_put(txn, id, off, elem, *arr->element_size);
+}
+
+int wal_element_set(wal_txn_t *txn, strtable_t *tbl, uint32_t idx,
+                    const char *str) {
+  int id = find_file(txn->wal, tbl);
+  size_t len = strlen(str) + 1;
+  if (id < 0 || idx >= strtable_len(tbl) ||
+      len > (size_t)get_element_len(tbl, idx)) {
+    return -1;
+  }
+  uint64_t off = get_element(tbl, idx) - (char *)tbl->mm_region.start;
+  return wal_put(txn, id, off, str, len);
+}
+
+int wal_bl_append(wal_txn_t *txn, block_list_t *lst, const char *block,
+                  uint32_t block_size) {
+  int id = find_file(txn->wal, lst);
+  if (id < 0 || !block_size) {
+    return -1;
+  }
+  // the position is not known until commit.
+  memcpy(buf_add(&txn->buf, id, WAL_APPEND, 0, block_size), block, block_size);
+  return 0;
+}
+
+void wal_txn_abort(wal_txn_t *txn) {
+  free(txn->buf.data);
+  txn->buf.data = NULL;
+}
+
+// Helper function that checks that the appends of txn fit in their lists,
+// after the appends already committed. Called with the lock held.
+static int appends_fit(wal_txn_t *txn) {
+  wal_t *wal = txn->wal;
+  uint64_t tails[WAL_MAX_FILES] = {0};
+  for (struct wal_record *rec = buf_next(&txn->buf, NULL); rec;
+       rec = buf_next(&txn->buf, rec)) {
+    if (rec->kind != WAL_APPEND) {
+      continue;
+    }
+    struct wal_file *f = &wal->files[rec->file];
+    uint64_t tail = tails[rec->file] ? tails[rec->file] : list_tail(f);
+    // as bl_append: the block, its header and footer, and a new tail.
+    if (tail + rec->len + 4 * sizeof(uint32_t) > f->region->size) {
+      return 0;
+    }
+    tails[rec->file] = tail + rec->len + 2 * sizeof(uint32_t);
+  }
+  return 1;
+}
+
+int wal_commit(wal_txn_t *txn) {
+  wal_t *wal = txn->wal;
+  assert(wal->recovered);
+  pthread_mutex_lock(&wal->lock);
+  if (wal->error || !appends_fit(txn)) {
+    pthread_mutex_unlock(&wal->lock);
+    wal_txn_abort(txn);
+    return -1;
+  }
+
+  // add the records to the group being filled, giving appends their place.
+  for (struct wal_record *rec = buf_next(&txn->buf, NULL); rec;
+       rec = buf_next(&txn->buf, rec)) {
+    char *data = (char *)(rec + 1);
+    if (rec->kind == WAL_PUT) {
+      memcpy(buf_add(&wal->group, rec->file, WAL_PUT, rec->off, rec->len),
+             data, rec->len);
+      continue;
+    }
+    struct wal_file *f = &wal->files[rec->file];
+    uint32_t size = rec->len;
+    uint64_t tail = list_tail(f);
+    // | size | data | size | 0 | 0 |, written over the old tail.
+    char *out = buf_add(&wal->group, rec->file, WAL_APPEND, tail,
+                        size + 4 * sizeof(uint32_t));
+    memcpy(out, &size, sizeof(uint32_t));
+    memcpy(out + sizeof(uint32_t), data, size);
+    memcpy(out + sizeof(uint32_t) + size, &size, sizeof(uint32_t));
+    memset(out + 2 * sizeof(uint32_t) + size, 0, 2 * sizeof(uint32_t));
+    f->tail = tail + size + 2 * sizeof(uint32_t);
+  }
+  wal->group.txns++;
+  wal_txn_abort(txn);
+
+  // wait for the group to be written, writing it if no one else is writing.
+  uint64_t seq = wal->seq;
+  while (wal->durable <= seq) {
+    if (!wal->writing) {
+      write_group(wal);
+    } else {
+      pthread_cond_wait(&wal->cond, &wal->lock);
+    }
+  }
+  int err = wal->error ? -1 : 0;
+  pthread_mutex_unlock(&wal->lock);
+  return err;
+}
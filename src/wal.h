@@ -0,0 +1,214 @@
+#ifndef __WAL_H__
+#define __WAL_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "block_list.h"
+#include "disk_array.h"
+#include "mm_util.h"
+#include "strtable.h"
+
+typedef struct wal_t wal_t;
+typedef struct wal_txn_t wal_txn_t;
+
+// ---------------------------------
+// write-ahead log file and protocol
+// ---------------------------------
+//
+// A write-ahead log (WAL) makes updates to several mapped files (disk arrays,
+// strtables and block lists) atomic and durable together: a transaction's
+// writes are first appended to the log and synced, and only then copied into
+// the mapped files. After a crash, the writes of every transaction in the log
+// are copied again (replayed), so each transaction either happened in every
+// file or in none.
+//
+// Typical usage:
+//
+//    wal_t wal;
+//    wal_open(filename, &wal);
+//    wal_attach_table(&wal, 0, &nav);
+//    wal_attach_list(&wal, 1, &log);
+//    wal_recover(&wal);
+//    ...
+//    wal_txn_t txn;
+//    wal_txn_begin(&wal, &txn);
+//    wal_element_set(&txn, &nav, idx, "1.5;2.5;10;HD 1234");
+//    wal_bl_append(&txn, &log, entry, entry_size);
+//    if (wal_commit(&txn)) {
+//      // nothing was written
+//    }
+//    ...
+//    wal_close(&wal);
+//
+// Files are attached with an id, which is how log records name them; a file
+// must be attached with the same id every time the log is opened. Once
+// attached, a file must only be changed through the log.
+//
+// Records are physical: each is a range of bytes and where in which file they
+// go, so replaying a record twice is harmless. A transaction is staged in
+// memory (nothing is visible until it commits); a block list append is given
+// its position in the list when the transaction commits.
+//
+// Commits are grouped: transactions committed while a group is being written
+// go into the next group, and whichever committer finds no group being
+// written writes the next one, with one write and one fdatasync for all of its
+// transactions, and then applies it. wal_commit returns once the transaction's
+// group is durable and applied.
+//
+// The log file (fname.wal) is a header followed by groups:
+//         byte | contents      | description
+//         -----|---------------|-------------
+//            0 | WALF          | identifying marker
+//            4 | pad           |
+//            8 | seq           | uint64 number of the first group
+//           16 | group         | first group
+//              | ...           |
+//
+// and each group is a group header followed by its records:
+//         byte | contents      | description
+//         -----|---------------|-------------
+//            0 | WALG          | identifying marker
+//            4 | n             | uint32 number of records
+//            8 | size          | uint64 bytes of records
+//           16 | seq           | uint64 group number
+//           24 | checksum      | uint64 FNV-1a hash of the records
+//           32 | record[0]     | first record (header, then data)
+//              | ...           |
+//
+// Each record's data is padded to 8 bytes. Groups are numbered in the order
+// they are written, across checkpoints. Replay stops at the first group that
+// is incomplete, whose checksum does not match (a group whose write was cut
+// short by the crash, which was never committed) or that is out of sequence
+// (left over from before a checkpoint).
+//
+// When the log grows past WAL_CHECKPOINT bytes, the attached files are synced
+// and the log is emptied (a checkpoint); wal_close also checkpoints.
+
+// Maximum number of attached files.
+#define WAL_MAX_FILES 16
+// Log size that triggers a checkpoint.
+#define WAL_CHECKPOINT ((uint64_t)64 << 20)
+
+// record kinds
+enum wal_kind {
+  WAL_PUT,    // bytes written at off
+  WAL_APPEND, // block list append at off (ends with the list's new tail)
+};
+
+// log file header
+struct wal_header {
+  char hdr[4];  // header chars
+  uint32_t pad; // unused
+  uint64_t seq; // number of the first group in the log
+};
+
+// group header
+struct wal_group {
+  char hdr[4];       // header chars
+  uint32_t n;        // number of records
+  uint64_t size;     // bytes of records that follow
+  uint64_t seq;      // group number
+  uint64_t checksum; // FNV-1a hash of the records
+};
+
+// record header (followed by len bytes, padded to 8)
+struct wal_record {
+  uint16_t file; // attached file id
+  uint16_t kind; // enum wal_kind
+  uint32_t len;  // bytes of data
+  uint64_t off;  // offset in the file
+};
+
+// an attached file
+struct wal_file {
+  mm_region_t *region; // its mapping, or NULL if no file has this id
+  void *owner;         // the attached array, table or list
+  block_list_t *lst;   // the attached list, or NULL
+  uint64_t tail;       // list tail after the committed appends (0 if unknown)
+};
+
+// a buffer of records
+struct wal_buf {
+  char *data;    // group header, then records
+  uint64_t size; // bytes used
+  uint64_t cap;  // bytes allocated
+  uint32_t n;    // number of records
+  uint32_t txns; // number of transactions
+};
+
+// log struct
+struct wal_t {
+  int fd;                                // log file
+  uint64_t size;                         // size of the log file
+  struct wal_file files[WAL_MAX_FILES];  // attached files, by id
+  int recovered;                         // nonzero after wal_recover
+  int error;                             // nonzero after a log write failed
+  pthread_mutex_t lock;                  // protects everything below
+  pthread_cond_t cond;                   // signals written groups
+  struct wal_buf group;                  // the group being filled
+  struct wal_buf flush;                  // the group being written
+  uint64_t seq;                          // number of the group being filled
+  uint64_t durable;                      // groups before this are applied
+  int writing;                           // nonzero while a group is written
+  uint64_t groups;                       // groups written (statistics)
+  uint64_t txns;                         // transactions written (statistics)
+  uint64_t syncs;                        // fdatasyncs (statistics)
+};
+
+// transaction struct
+struct wal_txn_t {
+  wal_t *wal;         // log it commits to
+  struct wal_buf buf; // staged records
+};
+
+// Open the log fname, creating it if it does not exist. Files are then
+// attached and wal_recover called before transactions are committed.
+void wal_open(const char *fname, wal_t *wal);
+
+// Attach an open array, table or list to the log under the id id (less than
+// WAL_MAX_FILES).
+void wal_attach_array(wal_t *wal, uint32_t id, disk_array_t *arr);
+void wal_attach_table(wal_t *wal, uint32_t id, strtable_t *tbl);
+void wal_attach_list(wal_t *wal, uint32_t id, block_list_t *lst);
+
+// Replay the groups in the log into the attached files, and checkpoint.
+// Returns the number of groups replayed.
+uint64_t wal_recover(wal_t *wal);
+
+// Sync the attached files and empty the log. Returns 0, or -1 if the files
+// could not be synced (the log is then kept).
+int wal_checkpoint(wal_t *wal);
+
+// Checkpoint and close the log (the attached files stay open).
+void wal_close(wal_t *wal);
+
+// Start a transaction on wal.
+void wal_txn_begin(wal_t *wal, wal_txn_t *txn);
+
+// Stage writes. Each returns 0, or -1 if the write is invalid (nothing is
+// staged then).
+//
+// wal_put writes len bytes of data at offset off of file id.
+int wal_put(wal_txn_t *txn, uint32_t id, uint64_t off, const void *data,
+            uint32_t len);
+// wal_array_set sets element idx of arr to the element_size bytes at elem.
+int wal_array_set(wal_txn_t *txn, disk_array_t *arr, uint64_t idx,
+                  const void *elem);
+// wal_element_set replaces element idx of tbl by str, which must fit in the
+// element's space (see get_element_len).
+int wal_element_set(wal_txn_t *txn, strtable_t *tbl, uint32_t idx,
+                    const char *str);
+// wal_bl_append appends a block to lst.
+int wal_bl_append(wal_txn_t *txn, block_list_t *lst, const char *block,
+                  uint32_t block_size);
+
+// Commit a transaction: returns once it is durable and applied, with 0, or
+// with -1 if it was not written (an append did not fit in its list, or the log
+// could not be written). The transaction is finished either way.
+int wal_commit(wal_txn_t *txn);
+
+// Drop a transaction's staged writes.
+void wal_txn_abort(wal_txn_t *txn);
+
+#endif
@@ -0,0 +1,205 @@
+#include "block_list.h"
+#include "disk_array.h"
+#include "strtable.h"
+#include "wal.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 64
+#define SLOT "%02d:%-29lu" // nav element of a thread (fits any count)
+
+void usage(const char *name) {
+  printf("usage: %s dir run n [threads] [-msync]\n"
+         "       %s dir check\n"
+         "  run commits n transactions on each of threads threads, each of\n"
+         "  which updates the thread's nav element and params entry and\n"
+         "  appends a log entry, in dir/{nav,params,log} through dir/wal\n"
+         "  (creating them if needed, and recovering after a crash). -msync\n"
+         "  writes the files directly and syncs each of them instead.\n"
+         "  check tests that the three files agree for every thread.\n",
+         name, name);
+}
+
+struct files {
+  strtable_t nav;
+  disk_array_t params;
+  block_list_t log;
+  wal_t wal;
+  int use_msync;
+  pthread_mutex_t lock; // serializes direct writes (-msync)
+};
+
+struct worker {
+  struct files *files;
+  int id;
+  uint64_t n;
+  uint64_t first;
+};
+
+// Helper function that returns dir/name (malloc'd).
+char *path(const char *dir, const char *name) {
+  char *p = malloc(strlen(dir) + strlen(name) + 2);
+  sprintf(p, "%s/%s", dir, name);
+  return p;
+}
+
+void open_files(const char *dir, int create, struct files *f) {
+  char *nav = path(dir, "nav");
+  char *params = path(dir, "params");
+  char *log = path(dir, "log");
+  char *wal = path(dir, "wal");
+  if (create) {
+    strtable_open(nav, 64 * MAX_THREADS + 4096, &f->nav);
+    char slot[64];
+    for (int t = 0; t < MAX_THREADS; t++) {
+      sprintf(slot, SLOT, t, 0UL);
+      add_element(&f->nav, slot);
+    }
+    array_open(params, MAX_THREADS, sizeof(uint64_t), &f->params);
+    bl_open(log, (uint64_t)256 << 20, &f->log);
+  } else {
+    strtable_open(nav, 0, &f->nav);
+    array_open(params, 0, sizeof(uint64_t), &f->params);
+    bl_open(log, 0, &f->log);
+  }
+  wal_open(wal, &f->wal);
+  wal_attach_table(&f->wal, 0, &f->nav);
+  wal_attach_array(&f->wal, 1, &f->params);
+  wal_attach_list(&f->wal, 2, &f->log);
+  printf("replayed %lu groups\n", wal_recover(&f->wal));
+  free(nav);
+  free(params);
+  free(log);
+  free(wal);
+}
+
+void close_files(struct files *f) {
+  wal_close(&f->wal);
+  bl_close(&f->log);
+  array_close(&f->params);
+  strtable_close(&f->nav);
+}
+
+void *run(void *arg) {
+  struct worker *w = arg;
+  struct files *f = w->files;
+  char slot[64];
+  for (uint64_t k = w->first; k < w->first + w->n; k++) {
+    sprintf(slot, SLOT, w->id, k);
+    if (f->use_msync) {
+      // direct writes, made durable one file at a time.
+      pthread_mutex_lock(&f->lock);
+      strcpy(get_element(&f->nav, w->id), slot);
+      ((uint64_t *)f->params.array)[w->id] = k;
+      bl_append(slot, strlen(slot) + 1, &f->log);
+      pthread_mutex_unlock(&f->lock);
+      msync(f->nav.mm_region.start, f->nav.mm_region.size, MS_SYNC);
+      msync(f->params.mm_region.start, f->params.mm_region.size, MS_SYNC);
+      msync(f->log.mm_region.start, f->log.mm_region.size, MS_SYNC);
+      continue;
+    }
+    wal_txn_t txn;
+    wal_txn_begin(&f->wal, &txn);
+    wal_element_set(&txn, &f->nav, w->id, slot);
+    wal_array_set(&txn, &f->params, w->id, &k);
+    wal_bl_append(&txn, &f->log, slot, strlen(slot) + 1);
+    if (wal_commit(&txn)) {
+      printf("thread %d: commit %lu failed\n", w->id, k);
+      break;
+    }
+  }
+  return NULL;
+}
+
+// Check that, for every thread, the params entry, the nav element and the
+// thread's log entries all show the same number of transactions.
+int check(struct files *f) {
+  uint64_t counts[MAX_THREADS] = {0};
+  uint64_t last[MAX_THREADS] = {0};
+  int bad = 0;
+  uint32_t size;
+  for (char *b = bl_next(NULL, &size, &f->log); b;
+       b = bl_next(b, &size, &f->log)) {
+    int t = atoi(b);
+    uint64_t k = strtoull(b + 3, NULL, 10);
+    if (t < 0 || t >= MAX_THREADS || k != last[t] + 1) {
+      printf("log entry %s out of order\n", b);
+      bad = 1;
+      continue;
+    }
+    counts[t]++;
+    last[t] = k;
+  }
+  for (int t = 0; t < MAX_THREADS; t++) {
+    uint64_t param = ((uint64_t *)f->params.array)[t];
+    uint64_t nav = strtoull(get_element(&f->nav, t) + 3, NULL, 10);
+    if (param != last[t] || nav != last[t]) {
+      printf("thread %d: log %lu, params %lu, nav %lu\n", t, last[t], param,
+             nav);
+      bad = 1;
+    }
+  }
+  printf("%s\n", bad ? "MISMATCH" : "OK");
+  return bad;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    usage(argv[0]);
+    return 1;
+  }
+  char *probe = path(argv[1], "params.arr");
+  int create = access(probe, F_OK) != 0;
+  free(probe);
+
+  struct files f;
+  memset(&f, 0, sizeof(f));
+  pthread_mutex_init(&f.lock, NULL);
+  open_files(argv[1], create, &f);
+
+  int err = 0;
+  if (!strcmp(argv[2], "check")) {
+    err = check(&f);
+  } else if (!strcmp(argv[2], "run") && argc > 3) {
+    uint64_t n = strtoull(argv[3], NULL, 10);
+    int nthreads = argc > 4 && argv[4][0] != '-' ? atoi(argv[4]) : 1;
+    f.use_msync = !strcmp(argv[argc - 1], "-msync");
+    if (nthreads < 1 || nthreads > MAX_THREADS) {
+      usage(argv[0]);
+      return 1;
+    }
+    pthread_t threads[MAX_THREADS];
+    struct worker workers[MAX_THREADS];
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < nthreads; t++) {
+      // continue from the thread's last committed transaction.
+      workers[t] = (struct worker){&f, t, n,
+                                   ((uint64_t *)f.params.array)[t] + 1};
+      pthread_create(&threads[t], NULL, run, &workers[t]);
+    }
+    for (int t = 0; t < nthreads; t++) {
+      pthread_join(threads[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double secs =
+        (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%lu transactions in %.3f s (%.0f/s)", n * nthreads, secs,
+           n * nthreads / secs);
+    if (!f.use_msync) {
+      printf(": %lu groups, %lu syncs", f.wal.groups, f.wal.syncs);
+    }
+    printf("\n");
+  } else {
+    usage(argv[0]);
+    err = 1;
+  }
+  close_files(&f);
+  return err;
+}